@@ -1,20 +1,28 @@
 #include "gui/class_spectra_view.h"
 
+#include <QFileDialog>
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QLineEdit>
 #include <QListWidget>
 #include <QListWidgetItem>
+#include <QMessageBox>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QString>
+#include <QStringList>
+#include <QTimer>
 #include <QtDebug>
 #include <QVBoxLayout>
 
 #include <algorithm>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include "gui/class_spectrum_row.h"
+#include "hsi/peak_fitter.h"
+#include "hsi/spectral_library_loader.h"
 #include "hsi/spectrum.h"
 #include "util/util.h"
 
@@ -33,6 +41,33 @@ static const QString kNewSpectrumButtonText = "Add Spectrum";
 static const QString kNewSpectrumButtonToolTip(
     "Add a new empty spectrum to the dictionary. "
     "You can edit or remove it later.");
+static const QString kImportLibraryButtonText = "Import Library";
+static const QString kImportLibraryButtonToolTip(
+    "Import measured spectra from an ENVI spectral library (*.sli) or an "
+    "ASCII table of wavelengths and values. Peaks can be added on top of "
+    "them.");
+static const QString kImportLibraryDialogTitle = "Import Spectral Library";
+static const QString kImportLibraryErrorDialogTitle =
+    "Spectral Library Import Failed";
+static const QString kFitPeaksButtonText = "Fit Peaks";
+static const QString kFitPeaksButtonToolTip(
+    "Replace every imported (tabulated) spectrum with a set of fitted peaks, "
+    "which can be generated at any resolution.");
+static const QString kFitPeaksDialogTitle = "Peak Fitting";
+static const QString kFitPeaksNoSpectraMessage =
+    "There are no imported spectra to fit.";
+static const QString kFitPeaksCancelButtonText = "Cancel Fit";
+static const QString kFitPeaksConfirmMessage =
+    "Replace the imported values of these spectra with the fitted peaks? This "
+    "cannot be undone.";
+
+// How often (in milliseconds) the progress of a running peak fit is updated.
+constexpr int kFitProgressUpdateInterval = 200;
+
+// Fitted spectra with a larger RMS error than this are reported as poor fits,
+// and at most this many of them are listed by name.
+constexpr double kPoorFitRMSError = 0.02;
+constexpr int kMaxNumListedPoorFits = 10;
 
 }  // namespace
 
@@ -41,7 +76,8 @@ ClassSpectraView::ClassSpectraView(
     std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra)
     : num_bands_(num_bands),
       next_spectrum_number_(1),
-      spectra_(spectra) {
+      spectra_(spectra),
+      fit_finished_(false) {
 
   setStyleSheet(util::GetStylesheetRelativePath(kQtClassSpectraViewStyle));
 
@@ -81,6 +117,47 @@ ClassSpectraView::ClassSpectraView(
       this,
       SLOT(NewSpectrumButtonPressed()));
 
+  // Add a button to import spectra from spectral library files.
+  QPushButton* import_library_button =
+      new QPushButton(kImportLibraryButtonText);
+  import_library_button->setToolTip(kImportLibraryButtonToolTip);
+  layout_->addWidget(import_library_button);
+  layout_->setAlignment(import_library_button, Qt::AlignCenter);
+  connect(
+      import_library_button,
+      SIGNAL(released()),
+      this,
+      SLOT(ImportLibraryButtonPressed()));
+
+  // Add a button to convert the imported spectra into peaks. The fit runs in
+  // the background, and its progress bar and cancel button are only shown
+  // while it runs.
+  fit_peaks_button_ = new QPushButton(kFitPeaksButtonText);
+  fit_peaks_button_->setToolTip(kFitPeaksButtonToolTip);
+  layout_->addWidget(fit_peaks_button_);
+  layout_->setAlignment(fit_peaks_button_, Qt::AlignCenter);
+  connect(
+      fit_peaks_button_,
+      SIGNAL(released()),
+      this,
+      SLOT(FitPeaksButtonPressed()));
+  fit_progress_bar_ = new QProgressBar();
+  fit_progress_bar_->setVisible(false);
+  layout_->addWidget(fit_progress_bar_);
+  fit_cancel_button_ = new QPushButton(kFitPeaksCancelButtonText);
+  fit_cancel_button_->setVisible(false);
+  layout_->addWidget(fit_cancel_button_);
+  layout_->setAlignment(fit_cancel_button_, Qt::AlignCenter);
+  connect(
+      fit_cancel_button_,
+      SIGNAL(released()),
+      this,
+      SLOT(FitCancelButtonPressed()));
+  fit_progress_timer_ = new QTimer(this);
+  fit_progress_timer_->setInterval(kFitProgressUpdateInterval);
+  connect(
+      fit_progress_timer_, SIGNAL(timeout()), this, SLOT(UpdateFitProgress()));
+
   // Add a default spectrum to begin with (typically the background spectrum).
   if (spectra_->empty()) {
     InsertNewSpectrum(kDefaultSpectrumName);
@@ -89,17 +166,19 @@ ClassSpectraView::ClassSpectraView(
   }
 }
 
+ClassSpectraView::~ClassSpectraView() {
+  if (fit_thread_.joinable()) {
+    peak_fitter_->Cancel();
+    fit_thread_.join();
+  }
+}
+
 void ClassSpectraView::UpdateGUI() {
-  // Remove any existing rows:
-//  for (ClassSpectrumRow* row : class_spectrum_rows_) {
-//    layout_->removeWidget(row);
-//    delete row;
-//  }
-// TODO: Fix this...?
-  for (int i = 0; i < class_spectrum_rows_.size(); ++i) {
-    QListWidgetItem* list_item = spectra_list_->takeItem(i);
+  // Remove any existing rows. Taking an item shifts the remaining items up, so
+  // the first item is taken each time.
+  for (ClassSpectrumRow* row : class_spectrum_rows_) {
+    QListWidgetItem* list_item = spectra_list_->takeItem(0);
     delete list_item;
-    ClassSpectrumRow* row = class_spectrum_rows_[i];
     delete row;
   }
   class_spectrum_rows_.clear();
@@ -154,6 +233,157 @@ void ClassSpectraView::NewSpectrumButtonPressed() {
   InsertNewSpectrum(new_spectrum_name);
 }
 
+void ClassSpectraView::ImportLibraryButtonPressed() {
+  const QStringList file_names = QFileDialog::getOpenFileNames(
+      this,
+      kImportLibraryDialogTitle,     // Dialog caption.
+      util::GetRootCodeDirectory(),  // Default directory.
+      "Spectral Libraries (*.sli *.txt *.csv *.asc);;All Files (*)");
+  // The spectra are resampled to the current number of bands. Only rows for
+  // the newly imported spectra are added.
+  SpectralLibraryLoader library_loader(spectra_, *num_bands_);
+  for (const QString& file_name : file_names) {
+    const int first_new_spectrum = spectra_->size();
+    if (!library_loader.LoadLibraryFromFile(file_name)) {
+      QMessageBox::critical(
+          this,
+          kImportLibraryErrorDialogTitle,
+          library_loader.GetErrorMessage());
+      return;
+    }
+    for (int i = first_new_spectrum; i < spectra_->size(); ++i) {
+      AddClassSpectrumRow(spectra_->at(i));
+    }
+  }
+}
+
+void ClassSpectraView::FitPeaksButtonPressed() {
+  if (fit_thread_.joinable()) {
+    return;
+  }
+  // Only the spectra with tabulated values are fitted. They are copied here,
+  // on the GUI thread, and the fit thread only ever touches the copies.
+  fit_original_spectra_.clear();
+  fit_spectra_.clear();
+  for (const std::shared_ptr<Spectrum>& spectrum : *spectra_) {
+    if (!spectrum->GetTabulatedValues().empty()) {
+      fit_original_spectra_.push_back(spectrum);
+      fit_spectra_.push_back(
+          std::shared_ptr<Spectrum>(new Spectrum(*spectrum)));
+    }
+  }
+  if (fit_spectra_.empty()) {
+    QMessageBox::information(
+        this, kFitPeaksDialogTitle, kFitPeaksNoSpectraMessage);
+    return;
+  }
+  peak_fitter_ = std::shared_ptr<PeakFitter>(new PeakFitter(*num_bands_));
+  fit_results_.clear();
+  fit_finished_ = false;
+  std::shared_ptr<PeakFitter> peak_fitter = peak_fitter_;
+  fit_thread_ = std::thread([this, peak_fitter]() {
+    fit_results_ = peak_fitter->FitSpectra(fit_spectra_);
+    fit_finished_ = true;
+  });
+
+  fit_peaks_button_->setEnabled(false);
+  fit_progress_bar_->setRange(0, fit_spectra_.size());
+  fit_progress_bar_->setValue(0);
+  fit_progress_bar_->setVisible(true);
+  fit_cancel_button_->setEnabled(true);
+  fit_cancel_button_->setVisible(true);
+  fit_progress_timer_->start();
+}
+
+void ClassSpectraView::FitCancelButtonPressed() {
+  if (peak_fitter_ != nullptr) {
+    peak_fitter_->Cancel();
+    fit_cancel_button_->setEnabled(false);
+  }
+}
+
+void ClassSpectraView::UpdateFitProgress() {
+  if (peak_fitter_ == nullptr) {
+    return;
+  }
+  if (fit_finished_) {
+    FinishFit();
+    return;
+  }
+  fit_progress_bar_->setValue(peak_fitter_->GetNumSpectraFitted());
+}
+
+void ClassSpectraView::FinishFit() {
+  fit_progress_timer_->stop();
+  fit_thread_.join();
+  fit_peaks_button_->setEnabled(true);
+  fit_progress_bar_->setVisible(false);
+  fit_cancel_button_->setVisible(false);
+  peak_fitter_.reset();
+  fit_spectra_.clear();
+  std::vector<PeakFitResult> results;
+  results.swap(fit_results_);
+  if (results.empty()) {
+    fit_original_spectra_.clear();
+    return;  // The fit was canceled.
+  }
+
+  double total_rms_error = 0.0;
+  int worst_result_index = 0;
+  std::vector<int> poor_result_indices;
+  const int num_results = results.size();
+  for (int i = 0; i < num_results; ++i) {
+    total_rms_error += results[i].rms_error;
+    if (results[i].rms_error > results[worst_result_index].rms_error) {
+      worst_result_index = i;
+    }
+    if (results[i].rms_error > kPoorFitRMSError) {
+      poor_result_indices.push_back(i);
+    }
+  }
+  QString fit_message =
+      "Fitted " + QString::number(num_results) + " spectra.\n" +
+      "Mean RMS error: " +
+      QString::number(total_rms_error / num_results) + "\n" +
+      "Largest RMS error: " +
+      QString::number(results[worst_result_index].rms_error) + " (" +
+      results[worst_result_index].spectrum->GetName() + ")\n";
+  if (!poor_result_indices.empty()) {
+    const int num_poor_results = poor_result_indices.size();
+    fit_message += "\n" + QString::number(num_poor_results) +
+        " spectra fit poorly (RMS error above " +
+        QString::number(kPoorFitRMSError) + "):\n";
+    const int num_listed_results =
+        std::min(num_poor_results, kMaxNumListedPoorFits);
+    for (int i = 0; i < num_listed_results; ++i) {
+      const PeakFitResult& result = results[poor_result_indices[i]];
+      fit_message += "    " + result.spectrum->GetName() + " (" +
+          QString::number(result.rms_error) + ")\n";
+    }
+    if (num_poor_results > num_listed_results) {
+      fit_message += "    and " +
+          QString::number(num_poor_results - num_listed_results) +
+          " more.\n";
+    }
+  }
+  fit_message += "\n" + kFitPeaksConfirmMessage;
+  const QMessageBox::StandardButton answer = QMessageBox::question(
+      this, kFitPeaksDialogTitle, fit_message,
+      QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+  if (answer == QMessageBox::Yes) {
+    // Spectra that were deleted during the fit are skipped.
+    for (int i = 0; i < num_results; ++i) {
+      const auto original = std::find(
+          spectra_->begin(), spectra_->end(), fit_original_spectra_[i]);
+      if (original != spectra_->end()) {
+        *original = results[i].spectrum;
+      }
+    }
+    UpdateGUI();
+  }
+  fit_original_spectra_.clear();
+}
+
 void ClassSpectraView::RowCloneButtonPressed(QWidget* caller) {
   const ClassSpectrumRow* spectrum_row =
       dynamic_cast<ClassSpectrumRow*>(caller);
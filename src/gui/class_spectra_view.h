@@ -12,13 +12,19 @@
 #include <QBoxLayout>
 #include <QLineEdit>
 #include <QListWidget>
+#include <QProgressBar>
+#include <QPushButton>
 #include <QString>
+#include <QTimer>
 #include <QWidget>
 
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include "gui/class_spectrum_row.h"
+#include "hsi/peak_fitter.h"
 #include "hsi/spectrum.h"
 
 namespace hsi_data_generator {
@@ -31,6 +37,9 @@ class ClassSpectraView : public QWidget {
       std::shared_ptr<int> num_bands,
       std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra);
 
+  // Cancels any running peak fit and waits for its thread to stop.
+  ~ClassSpectraView() override;
+
   // Updates the GUI to reset all rows in accordance to the current spectra.
   // This should only be called when an external object modifies the spectra_
   // list (e.g. the main window through a menu action). It is also used during
@@ -45,8 +54,15 @@ class ClassSpectraView : public QWidget {
  private slots:  // NOLINT
   void NumberOfBandsInputChanged();
   void NewSpectrumButtonPressed();
+  void ImportLibraryButtonPressed();
+  void FitPeaksButtonPressed();
+  void FitCancelButtonPressed();
   void RowCloneButtonPressed(QWidget* caller);
 
+  // Called periodically while a peak fit is running to update the progress
+  // bar, and to finish the fit once the thread is done.
+  void UpdateFitProgress();
+
  private:
   // The layout used by this widget.
   QBoxLayout* layout_;
@@ -75,6 +91,29 @@ class ClassSpectraView : public QWidget {
   // modify the number of bands for rendering purposes.
   std::vector<ClassSpectrumRow*> class_spectrum_rows_;
 
+  // The button to start a peak fit, and the progress display and cancel
+  // button that are only shown while it runs.
+  QPushButton* fit_peaks_button_;
+  QProgressBar* fit_progress_bar_;
+  QPushButton* fit_cancel_button_;
+  QTimer* fit_progress_timer_;
+
+  // The running peak fit. The fitter works on copies of the tabulated spectra
+  // (fit_spectra_), so the originals (fit_original_spectra_) can still be
+  // edited. fit_results_ is set by the fit thread before it sets
+  // fit_finished_, and is only read after that.
+  std::shared_ptr<PeakFitter> peak_fitter_;
+  std::thread fit_thread_;
+  std::atomic<bool> fit_finished_;
+  std::vector<std::shared_ptr<Spectrum>> fit_original_spectra_;
+  std::vector<std::shared_ptr<Spectrum>> fit_spectra_;
+  std::vector<PeakFitResult> fit_results_;
+
+  // Joins the finished fit thread, resets the fit controls, reports the
+  // fitting errors, and replaces the original spectra with the fitted ones if
+  // the user confirms it.
+  void FinishFit();
+
   // Creates a new spectrum and adds it to the row set.
   void InsertNewSpectrum(const QString& name);
 
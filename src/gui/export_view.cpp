@@ -1,13 +1,21 @@
 #include "gui/export_view.h"
 
+#include <QComboBox>
 #include <QFileDialog>
+#include <QHBoxLayout>
 #include <QLabel>
+#include <QLineEdit>
 #include <QMessageBox>
+#include <QProgressBar>
 #include <QPushButton>
 #include <QString>
+#include <QTimer>
 #include <QVBoxLayout>
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include "hsi/hsi_exporter.h"
@@ -22,7 +30,35 @@ static const QString kQtExportViewStyle = "qt_stylesheets/export_view.qss";
 
 static const QString kInformationString =
     "Export the HSI data as a binary ENVI image.";
+static const QString kInterleaveFormatInputLabel = "Interleave:";
+static const QString kInterleaveFormatInputToolTip(
+    "The order in which the bands of each pixel are stored in the file.");
+static const QString kInterleaveBSQString = "BSQ (band sequential)";
+static const QString kInterleaveBILString = "BIL (band interleaved by line)";
+static const QString kInterleaveBIPString = "BIP (band interleaved by pixel)";
+static const QString kDataTypeInputLabel = "Data Type:";
+static const QString kDataTypeInputToolTip(
+    "The data type of each sample. Integer types store the spectrum values "
+    "multiplied by the scale factor.");
+static const QString kDataTypeUInt8String = "8-bit unsigned integer";
+static const QString kDataTypeInt16String = "16-bit signed integer";
+static const QString kDataTypeUInt16String = "16-bit unsigned integer";
+static const QString kDataTypeFloat32String = "32-bit float";
+static const QString kDataTypeFloat64String = "64-bit float";
+static const QString kScaleFactorInputLabel = "Scale Factor:";
+static const QString kScaleFactorInputToolTip(
+    "Each spectrum value (between 0 and 1) is multiplied by this factor. "
+    "Leave empty to use the maximum value of integer types, or 1 for floats.");
+static const QString kScaleFactorInputPlaceholder = "Automatic";
+static const QString kByteOrderInputLabel = "Byte Order:";
+static const QString kByteOrderInputToolTip(
+    "The byte order of each sample. Use big endian for tools that require it.");
+static const QString kByteOrderLittleEndianString = "Little endian";
+static const QString kByteOrderBigEndianString = "Big endian";
 static const QString kExportButtonString = "Export HSI";
+static const QString kCancelButtonString = "Cancel";
+static const QString kExportProgressString =
+    "%1 MB/s, about %2 seconds remaining.";
 static const QString kSaveFileDialogTitle = "Save HSI File";
 static const QString kSaveFileErrorDialogTitle = "File Save Error";
 static const QString kSaveFileSuccessDialogTitle = "File Saved";
@@ -30,13 +66,25 @@ static const QString kSaveFileSuccessDialogMessage =
     "Data was successfully saved to file \"" +
     util::kTextSubPlaceholder + "\".";
 
+// How often (in milliseconds) the progress of a running export is updated.
+constexpr int kProgressUpdateInterval = 200;
+
+// The progress bar's range. Progress is displayed in tenths of a percent.
+constexpr int kProgressBarMaximum = 1000;
+
+constexpr double kBytesPerMegabyte = 1024.0 * 1024.0;
+
 }  // namespace
 
 ExportView::ExportView(
     std::shared_ptr<int> num_bands,
     std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra,
     std::shared_ptr<ImageLayout> image_layout)
-    : num_bands_(num_bands), spectra_(spectra), image_layout_(image_layout) {
+    : num_bands_(num_bands),
+      spectra_(spectra),
+      image_layout_(image_layout),
+      export_finished_(false),
+      export_succeeded_(false) {
 
   setStyleSheet(util::GetStylesheetRelativePath(kQtExportViewStyle));
 
@@ -48,10 +96,90 @@ ExportView::ExportView(
   layout->addWidget(info_label);
   layout->setAlignment(info_label, Qt::AlignCenter);
 
-  QPushButton* export_button = new QPushButton(kExportButtonString);
-  layout->addWidget(export_button);
-  layout->setAlignment(export_button, Qt::AlignCenter);
-  connect(export_button, SIGNAL(released()), this, SLOT(ExportButtonPressed()));
+  // Add the interleave format selector. The item data is the format enum.
+  interleave_format_input_ = new QComboBox();
+  interleave_format_input_->setToolTip(kInterleaveFormatInputToolTip);
+  interleave_format_input_->addItem(kInterleaveBSQString, HSI_INTERLEAVE_BSQ);
+  interleave_format_input_->addItem(kInterleaveBILString, HSI_INTERLEAVE_BIL);
+  interleave_format_input_->addItem(kInterleaveBIPString, HSI_INTERLEAVE_BIP);
+  QHBoxLayout* interleave_format_input_layout = new QHBoxLayout();
+  interleave_format_input_layout->addStretch();  // Pad left to center widgets.
+  interleave_format_input_layout->addWidget(
+      new QLabel(kInterleaveFormatInputLabel));
+  interleave_format_input_layout->addWidget(interleave_format_input_);
+  interleave_format_input_layout->addStretch();  // Pad right to center widgets.
+  layout->addLayout(interleave_format_input_layout);
+
+  // Add the data type selector and scale factor input. The item data is the
+  // data type enum.
+  data_type_input_ = new QComboBox();
+  data_type_input_->setToolTip(kDataTypeInputToolTip);
+  data_type_input_->addItem(kDataTypeUInt8String, HSI_DATA_TYPE_UINT8);
+  data_type_input_->addItem(kDataTypeInt16String, HSI_DATA_TYPE_INT16);
+  data_type_input_->addItem(kDataTypeUInt16String, HSI_DATA_TYPE_UINT16);
+  data_type_input_->addItem(kDataTypeFloat32String, HSI_DATA_TYPE_FLOAT32);
+  data_type_input_->addItem(kDataTypeFloat64String, HSI_DATA_TYPE_FLOAT64);
+  data_type_input_->setCurrentIndex(
+      data_type_input_->findData(HSI_DATA_TYPE_FLOAT32));
+  scale_factor_input_ = new QLineEdit();
+  scale_factor_input_->setToolTip(kScaleFactorInputToolTip);
+  scale_factor_input_->setPlaceholderText(kScaleFactorInputPlaceholder);
+  QHBoxLayout* data_type_input_layout = new QHBoxLayout();
+  data_type_input_layout->addStretch();  // Pad left to center widgets.
+  data_type_input_layout->addWidget(new QLabel(kDataTypeInputLabel));
+  data_type_input_layout->addWidget(data_type_input_);
+  data_type_input_layout->addWidget(new QLabel(kScaleFactorInputLabel));
+  data_type_input_layout->addWidget(scale_factor_input_);
+  data_type_input_layout->addStretch();  // Pad right to center widgets.
+  layout->addLayout(data_type_input_layout);
+
+  // Add the byte order selector. The item data is the byte order enum.
+  byte_order_input_ = new QComboBox();
+  byte_order_input_->setToolTip(kByteOrderInputToolTip);
+  byte_order_input_->addItem(
+      kByteOrderLittleEndianString, HSI_BYTE_ORDER_LITTLE_ENDIAN);
+  byte_order_input_->addItem(
+      kByteOrderBigEndianString, HSI_BYTE_ORDER_BIG_ENDIAN);
+  QHBoxLayout* byte_order_input_layout = new QHBoxLayout();
+  byte_order_input_layout->addStretch();  // Pad left to center widgets.
+  byte_order_input_layout->addWidget(new QLabel(kByteOrderInputLabel));
+  byte_order_input_layout->addWidget(byte_order_input_);
+  byte_order_input_layout->addStretch();  // Pad right to center widgets.
+  layout->addLayout(byte_order_input_layout);
+
+  export_button_ = new QPushButton(kExportButtonString);
+  layout->addWidget(export_button_);
+  layout->setAlignment(export_button_, Qt::AlignCenter);
+  connect(
+      export_button_, SIGNAL(released()), this, SLOT(ExportButtonPressed()));
+
+  // The progress display and cancel button are only shown during an export.
+  progress_bar_ = new QProgressBar();
+  progress_bar_->setRange(0, kProgressBarMaximum);
+  progress_bar_->setVisible(false);
+  layout->addWidget(progress_bar_);
+  progress_label_ = new QLabel();
+  progress_label_->setVisible(false);
+  layout->addWidget(progress_label_);
+  layout->setAlignment(progress_label_, Qt::AlignCenter);
+  cancel_button_ = new QPushButton(kCancelButtonString);
+  cancel_button_->setVisible(false);
+  layout->addWidget(cancel_button_);
+  layout->setAlignment(cancel_button_, Qt::AlignCenter);
+  connect(
+      cancel_button_, SIGNAL(released()), this, SLOT(CancelButtonPressed()));
+
+  progress_timer_ = new QTimer(this);
+  progress_timer_->setInterval(kProgressUpdateInterval);
+  connect(
+      progress_timer_, SIGNAL(timeout()), this, SLOT(UpdateExportProgress()));
+}
+
+ExportView::~ExportView() {
+  if (export_thread_.joinable()) {
+    exporter_->Cancel();
+    export_thread_.join();
+  }
 }
 
 void ExportView::ExportButtonPressed() {
@@ -60,20 +188,97 @@ void ExportView::ExportButtonPressed() {
       kSaveFileDialogTitle,          // Dialog save caption.
       util::GetRootCodeDirectory(),  // Default directory.
       "All Files (*)");              // File filter
-  if (!file_name.isEmpty()) {
-    const HSIDataExporter exporter(spectra_, image_layout_, *num_bands_);
-    if (!exporter.SaveFile(file_name)) {
-      QMessageBox::critical(
-          this,
-          kSaveFileErrorDialogTitle,
-          exporter.GetErrorMessage());
-    } else {
-      const QString saved_message = util::ReplaceTextSubPlaceholder(
-          kSaveFileSuccessDialogMessage, file_name);
-      QMessageBox::information(
-          this, kSaveFileSuccessDialogTitle, saved_message);
-    }
+  if (file_name.isEmpty() || export_thread_.joinable()) {
+    return;
+  }
+  // The exporter copies the spectra and rendered layout here, on the GUI
+  // thread. The export thread only ever touches that copy.
+  exporter_ = std::shared_ptr<HSIDataExporter>(
+      new HSIDataExporter(spectra_, image_layout_, *num_bands_));
+  exporter_->SetInterleaveFormat(static_cast<HSIInterleaveFormat>(
+      interleave_format_input_->currentData().toInt()));
+  exporter_->SetDataType(static_cast<HSIDataType>(
+      data_type_input_->currentData().toInt()));
+  // An empty or invalid scale factor converts to 0 (automatic).
+  exporter_->SetScaleFactor(scale_factor_input_->text().toDouble());
+  exporter_->SetByteOrder(static_cast<HSIByteOrder>(
+      byte_order_input_->currentData().toInt()));
+
+  export_file_name_ = file_name;
+  export_finished_ = false;
+  export_succeeded_ = false;
+  export_start_time_ = std::chrono::steady_clock::now();
+  std::shared_ptr<HSIDataExporter> exporter = exporter_;
+  export_thread_ = std::thread([this, exporter, file_name]() {
+    export_succeeded_ = exporter->SaveFile(file_name);
+    export_finished_ = true;
+  });
+
+  export_button_->setEnabled(false);
+  progress_bar_->setValue(0);
+  progress_bar_->setVisible(true);
+  progress_label_->setText("");
+  progress_label_->setVisible(true);
+  cancel_button_->setEnabled(true);
+  cancel_button_->setVisible(true);
+  progress_timer_->start();
+}
+
+void ExportView::CancelButtonPressed() {
+  if (exporter_ != nullptr) {
+    exporter_->Cancel();
+    cancel_button_->setEnabled(false);
+  }
+}
+
+void ExportView::UpdateExportProgress() {
+  if (exporter_ == nullptr) {
+    return;
+  }
+  if (export_finished_) {
+    FinishExport();
+    return;
+  }
+  const int64_t num_bytes_written = exporter_->GetNumBytesWritten();
+  const int64_t total_num_bytes = exporter_->GetTotalNumBytes();
+  if (total_num_bytes <= 0) {
+    return;  // The export is still generating the spectra.
+  }
+  progress_bar_->setValue(static_cast<int>(
+      (kProgressBarMaximum * num_bytes_written) / total_num_bytes));
+  const std::chrono::duration<double> elapsed_time =
+      std::chrono::steady_clock::now() - export_start_time_;
+  const double elapsed_seconds = elapsed_time.count();
+  if (num_bytes_written <= 0 || elapsed_seconds <= 0.0) {
+    return;
+  }
+  const double bytes_per_second = num_bytes_written / elapsed_seconds;
+  const double seconds_remaining =
+      (total_num_bytes - num_bytes_written) / bytes_per_second;
+  progress_label_->setText(kExportProgressString
+      .arg(bytes_per_second / kBytesPerMegabyte, 0, 'f', 1)
+      .arg(static_cast<int>(seconds_remaining + 0.5)));
+}
+
+void ExportView::FinishExport() {
+  progress_timer_->stop();
+  export_thread_.join();
+  export_button_->setEnabled(true);
+  progress_bar_->setVisible(false);
+  progress_label_->setVisible(false);
+  cancel_button_->setVisible(false);
+  if (!export_succeeded_) {
+    QMessageBox::critical(
+        this,
+        kSaveFileErrorDialogTitle,
+        exporter_->GetErrorMessage());
+  } else {
+    const QString saved_message = util::ReplaceTextSubPlaceholder(
+        kSaveFileSuccessDialogMessage, export_file_name_);
+    QMessageBox::information(
+        this, kSaveFileSuccessDialogTitle, saved_message);
   }
+  exporter_.reset();
 }
 
 }  // namespace hsi_data_generator
@@ -2,15 +2,29 @@
 // image. These additional modifications will allow the user to blur, add
 // noise, and do other distortions to the data to make it a more challenging
 // evaluation data set.
+//
+// Exports run on a background thread, so the rest of the GUI stays usable
+// (and the spectra and layout can be edited) while a large file is written.
 
 #ifndef SRC_GUI_EXPORT_VIEW_H_
 #define SRC_GUI_EXPORT_VIEW_H_
 
+#include <QComboBox>
+#include <QLabel>
+#include <QLineEdit>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QString>
+#include <QTimer>
 #include <QWidget>
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <thread>
 #include <vector>
 
+#include "hsi/hsi_exporter.h"
 #include "hsi/image_layout.h"
 #include "hsi/spectrum.h"
 
@@ -25,13 +39,55 @@ class ExportView : public QWidget {
       std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra,
       std::shared_ptr<ImageLayout> image_layout);
 
+  // Cancels any running export and waits for its thread to stop.
+  ~ExportView() override;
+
  private slots:  // NOLINT
   void ExportButtonPressed();
+  void CancelButtonPressed();
+
+  // Called periodically while an export is running to update the progress
+  // display, and to finish the export once the thread is done.
+  void UpdateExportProgress();
 
  private:
   std::shared_ptr<int> num_bands_;
   std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra_;
   std::shared_ptr<ImageLayout> image_layout_;
+
+  // Selects the interleave format (BSQ, BIL, or BIP) of the exported file.
+  QComboBox* interleave_format_input_ = nullptr;
+
+  // Selects the data type of each exported sample, and the factor that the
+  // spectrum values are scaled by. An empty scale factor picks the scale
+  // automatically from the data type.
+  QComboBox* data_type_input_ = nullptr;
+  QLineEdit* scale_factor_input_ = nullptr;
+
+  // Selects the byte order (little or big endian) of the exported samples.
+  QComboBox* byte_order_input_ = nullptr;
+
+  // The buttons to start and cancel an export, and the display of the running
+  // export's progress (speed and estimated time remaining).
+  QPushButton* export_button_ = nullptr;
+  QPushButton* cancel_button_ = nullptr;
+  QProgressBar* progress_bar_ = nullptr;
+  QLabel* progress_label_ = nullptr;
+  QTimer* progress_timer_ = nullptr;
+
+  // The running export. The exporter works on its own snapshot of the data.
+  // export_succeeded_ is set by the export thread before it sets
+  // export_finished_, and is only read after that.
+  std::shared_ptr<HSIDataExporter> exporter_;
+  std::thread export_thread_;
+  std::atomic<bool> export_finished_;
+  bool export_succeeded_;
+  QString export_file_name_;
+  std::chrono::steady_clock::time_point export_start_time_;
+
+  // Joins the finished export thread, resets the export controls, and tells
+  // the user whether the export succeeded.
+  void FinishExport();
 };
 
 }  // namespace hsi_data_generator
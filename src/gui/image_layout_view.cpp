@@ -405,7 +405,7 @@ void ImageLayoutView::ClearButtonPressed() {
 
 void ImageLayoutView::ZoomOutButtonPressed() {
   image_layout_->ZoomOutToRoot();
-  image_layout_->Render();
+  image_layout_->RenderChanges();
   image_layout_widget_->Render();
 }
 
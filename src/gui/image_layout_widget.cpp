@@ -1,11 +1,13 @@
 #include "gui/image_layout_widget.h"
 
 #include <QColor>
+#include <QImage>
 #include <QMouseEvent>
 #include <QPainter>
 #include <QPen>
 #include <QPoint>
 #include <QRect>
+#include <QRgb>
 #include <QString>
 #include <QtDebug>
 #include <QtGlobal>
@@ -15,6 +17,7 @@
 #include <memory>
 #include <vector>
 
+#include "hsi/class_map.h"
 #include "hsi/image_layout.h"
 #include "hsi/spectrum.h"
 #include "util/util.h"
@@ -33,6 +36,39 @@ static const QColor kDragRectangleColor2 = Qt::white;
 constexpr int kDragDashSpacing = 4;
 constexpr int kDragRectangleWidth = 1;
 
+// Colors each pixel of the image by its class in the given class map, which
+// must have the image's size. If the class does not match the number of colors
+// given, or the index is invalid, the pixel gets the background color. Each
+// run is filled with a single color, and repeated rows are copied.
+void DrawClassMap(
+    const ClassMap& class_map,
+    const std::vector<QRgb>& class_colors,
+    const QRgb background_color,
+    QImage* image) {
+
+  const int num_colors = class_colors.size();
+  const int image_width = image->width();
+  for (int y = 0; y < image->height(); ++y) {
+    QRgb* row_pixels = reinterpret_cast<QRgb*>(image->scanLine(y));
+    if (class_map.IsRepeatedRow(y)) {
+      const QRgb* previous_row_pixels =
+          reinterpret_cast<const QRgb*>(image->constScanLine(y - 1));
+      std::copy(
+          previous_row_pixels, previous_row_pixels + image_width, row_pixels);
+      continue;
+    }
+    const ClassRun* row_runs = class_map.GetRowRuns(y);
+    int start_x = 0;
+    for (int i = 0; i < class_map.GetRowNumRuns(y); ++i) {
+      const int class_index = row_runs[i].class_index;
+      const QRgb color = (class_index >= 0 && class_index < num_colors) ?
+          class_colors[class_index] : background_color;
+      std::fill(row_pixels + start_x, row_pixels + row_runs[i].end_x, color);
+      start_x = row_runs[i].end_x;
+    }
+  }
+}
+
 }  // namespace
 
 ImageLayoutWidget::ImageLayoutWidget(std::shared_ptr<ImageLayout> image_layout)
@@ -70,32 +106,36 @@ void ImageLayoutWidget::Render(const bool root_render) {
   if (image_class_colors_.size() == 0) {
     return;
   }
-  const int layout_width = image_layout_->GetWidth();
-  const int layout_height = image_layout_->GetHeight();
-  const std::vector<int>& image_class_map =
+  const int layout_width =
+      root_render ?
+      image_layout_->GetWidthRoot() :
+      image_layout_->GetWidth();
+  const int layout_height =
+      root_render ?
+      image_layout_->GetHeightRoot() :
+      image_layout_->GetHeight();
+  const ClassMap& image_class_map =
       root_render ?
       image_layout_->GetClassMapRoot() :
       image_layout_->GetClassMap();
   layout_visualization_image_ =
       QImage(layout_width, layout_height, QImage::Format_RGB32);
-  for (int x = 0; x < layout_width; ++x) {
-    for (int y = 0; y < layout_height; ++y) {
-      const int class_index =
-          root_render ?
-          image_layout_->GetClassAtPixelRoot(x, y) :
-          image_layout_->GetClassAtPixel(x, y);
-      QColor color;
-      if (class_index >= 0 && class_index < image_class_colors_.size()) {
-        color = image_class_colors_[class_index];
-      } else {
-        // If the class does not match the number of colors given, or the index
-        // is invalid, just set it to the default color.
-        color = kDefaultBackgroundColor;
-        // TODO: Special color/design for sub-layout index?
-      }
-      layout_visualization_image_.setPixelColor(x, y, color);
-    }
+  const QRgb background_color = kDefaultBackgroundColor.rgb();
+  if (image_class_map.GetNumPixels() != layout_width * layout_height) {
+    // The layout has not been rendered at its current size.
+    layout_visualization_image_.fill(background_color);
+    update();
+    return;
+  }
+  std::vector<QRgb> class_colors;
+  for (const QColor& color : image_class_colors_) {
+    class_colors.push_back(color.rgb());
   }
+  DrawClassMap(
+      image_class_map,
+      class_colors,
+      background_color,
+      &layout_visualization_image_);
   update();
 }
 
@@ -200,7 +240,7 @@ void ImageLayoutWidget::mouseReleaseEvent(QMouseEvent* event) {
           component_height,
           user_selected_class_index_);
     }
-    image_layout_->Render();
+    image_layout_->RenderChanges();
     Render();
   } else {
     // If mouse was just clicked, check if any sub-layout was moused over, and
@@ -212,7 +252,7 @@ void ImageLayoutWidget::mouseReleaseEvent(QMouseEvent* event) {
         static_cast<double>(mouse_down_point_.y()) /
         static_cast<double>(height());
     if (image_layout_->ZoomInToSubLayout(click_x, click_y)) {
-      image_layout_->Render();
+      image_layout_->RenderChanges();
       Render();
     }
   }
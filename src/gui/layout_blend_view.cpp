@@ -46,7 +46,7 @@ LayoutBlendView::LayoutBlendView(
 }
 
 void LayoutBlendView::showEvent(QShowEvent* event) {
-  image_layout_->Render();
+  image_layout_->RenderChanges();
   UpdateLayoutVisualization(*spectra_, image_layout_widget_);
 }
 
@@ -0,0 +1,98 @@
+#include "hsi/class_map.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace hsi_data_generator {
+
+ClassMap::ClassMap(const int width, const int height, const int class_index)
+    : width_(width) {
+
+  const ClassRun run = {width, class_index};
+  for (int y = 0; y < height; ++y) {
+    AddRow(&run, (width > 0) ? 1 : 0);
+  }
+}
+
+void ClassMap::Reset(const int width) {
+  width_ = width;
+  runs_.clear();
+  row_runs_.clear();
+}
+
+void ClassMap::AddRow(const ClassRun* runs, const int num_runs) {
+  if (!row_runs_.empty() && row_runs_.back().num_runs == num_runs) {
+    const ClassRun* last_runs = GetRowRuns(row_runs_.size() - 1);
+    bool is_repeated = true;
+    for (int i = 0; i < num_runs && is_repeated; ++i) {
+      is_repeated = (runs[i].end_x == last_runs[i].end_x &&
+                     runs[i].class_index == last_runs[i].class_index);
+    }
+    if (is_repeated) {
+      RepeatLastRow();
+      return;
+    }
+  }
+  RowRuns row;
+  row.first_run = runs_.size();
+  row.num_runs = num_runs;
+  runs_.insert(runs_.end(), runs, runs + num_runs);
+  row_runs_.push_back(row);
+}
+
+void ClassMap::RepeatLastRow() {
+  row_runs_.push_back(row_runs_.back());
+}
+
+void ClassMap::AppendRows(const ClassMap& other) {
+  AppendRows(other, 0, other.GetHeight());
+}
+
+void ClassMap::AppendRows(
+    const ClassMap& other, const int first_row, const int end_row) {
+
+  for (int y = first_row; y < end_row; ++y) {
+    if (y > first_row && other.IsRepeatedRow(y)) {
+      RepeatLastRow();
+    } else {
+      AddRow(other.GetRowRuns(y), other.GetRowNumRuns(y));
+    }
+  }
+}
+
+void ClassMap::ReplaceRows(const int first_row, const ClassMap& rows) {
+  ClassMap updated_map;
+  updated_map.Reset(width_);
+  updated_map.AppendRows(*this, 0, first_row);
+  updated_map.AppendRows(rows);
+  updated_map.AppendRows(*this, first_row + rows.GetHeight(), GetHeight());
+  *this = std::move(updated_map);
+}
+
+int ClassMap::GetClass(const int x_col, const int y_row) const {
+  const ClassRun* row_runs = GetRowRuns(y_row);
+  const ClassRun* run = std::upper_bound(
+      row_runs,
+      row_runs + GetRowNumRuns(y_row),
+      x_col,
+      [](const int x, const ClassRun& run) { return x < run.end_x; });
+  return run->class_index;
+}
+
+bool ClassMap::GetClassRange(
+    int* min_class_index, int* max_class_index) const {
+
+  if (runs_.empty()) {
+    return false;
+  }
+  *min_class_index = runs_.front().class_index;
+  *max_class_index = runs_.front().class_index;
+  for (const ClassRun& run : runs_) {
+    *min_class_index = std::min(*min_class_index, run.class_index);
+    *max_class_index = std::max(*max_class_index, run.class_index);
+  }
+  return true;
+}
+
+}  // namespace hsi_data_generator
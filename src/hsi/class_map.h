@@ -0,0 +1,121 @@
+// The ClassMap holds the spectral class index of every pixel of a rendered
+// image layout (see ImageLayout). Layouts are made of rectangles, so each row
+// of pixels is stored as a list of runs of the same class, and consecutive
+// rows that are identical share their runs. The map takes memory in proportion
+// to the number of distinct runs rather than the number of pixels: a layout of
+// stripes or rectangles at the largest image size fits in kilobytes.
+//
+// Code that needs every pixel (e.g. the exporter) should fill whole runs at a
+// time, and copy the previous row's output for rows that repeat it (see
+// IsRepeatedRow()).
+//
+// The map used to store a class index per pixel, in the smallest integer type
+// that fit the layout's classes. With runs, the class indices are a small
+// fraction of the map (next to the run ends and the per-row table), so they
+// are stored as plain ints and no code needs to branch on their type.
+
+#ifndef SRC_HSI_CLASS_MAP_H_
+#define SRC_HSI_CLASS_MAP_H_
+
+#include <vector>
+
+namespace hsi_data_generator {
+
+// A horizontal run of pixels of a single class. The run ends at end_x
+// (exclusive), and starts where the previous run in its row ends (or at column
+// 0 for the first run).
+struct ClassRun {
+  int end_x;
+  int class_index;
+};
+
+class ClassMap {
+ public:
+  // Creates an empty map.
+  ClassMap() : width_(0) {}
+
+  // Creates a map of the given size where every pixel has the given class.
+  ClassMap(const int width, const int height, const int class_index);
+
+  // Removes all rows, and sets the width of the rows that will be added.
+  void Reset(const int width);
+
+  // Adds a row below the existing ones. The runs must cover the whole width,
+  // and adjacent runs should have different classes. If the row is identical
+  // to the last row, it shares the last row's runs.
+  void AddRow(const ClassRun* runs, const int num_runs);
+
+  // Adds a row that is identical to the last row. There must be a last row.
+  void RepeatLastRow();
+
+  // Adds all rows of the given map, which must have the same width, below the
+  // existing ones.
+  void AppendRows(const ClassMap& other);
+
+  // Same as above, but only adds the rows between first_row (inclusive) and
+  // end_row (exclusive) of the given map.
+  void AppendRows(
+      const ClassMap& other, const int first_row, const int end_row);
+
+  // Replaces the rows starting at first_row with all rows of the given map,
+  // which must have the same width and fit inside this map. The other rows are
+  // copied run by run, so this takes time in proportion to the number of
+  // stored runs, not pixels.
+  void ReplaceRows(const int first_row, const ClassMap& rows);
+
+  int GetWidth() const {
+    return width_;
+  }
+
+  int GetHeight() const {
+    return row_runs_.size();
+  }
+
+  int GetNumPixels() const {
+    return GetWidth() * GetHeight();
+  }
+
+  // Returns the runs of the given row, from left to right. Rows that share
+  // their runs return the same pointer.
+  const ClassRun* GetRowRuns(const int y_row) const {
+    return runs_.data() + row_runs_[y_row].first_run;
+  }
+
+  int GetRowNumRuns(const int y_row) const {
+    return row_runs_[y_row].num_runs;
+  }
+
+  // Returns true if the given row shares its runs with the row above it.
+  bool IsRepeatedRow(const int y_row) const {
+    return y_row > 0 &&
+        row_runs_[y_row].first_run == row_runs_[y_row - 1].first_run;
+  }
+
+  // Returns the class of the pixel at the given coordinate. This searches the
+  // row's runs, so fill whole runs in loops over many pixels instead.
+  int GetClass(const int x_col, const int y_row) const;
+
+  // Returns the number of stored runs. Shared runs are only counted once.
+  int GetNumStoredRuns() const {
+    return runs_.size();
+  }
+
+  // Returns the smallest and largest class in the map, or false if the map is
+  // empty.
+  bool GetClassRange(int* min_class_index, int* max_class_index) const;
+
+ private:
+  // The first run of a row (an index into runs_) and its number of runs.
+  struct RowRuns {
+    int first_run;
+    int num_runs;
+  };
+
+  int width_;
+  std::vector<ClassRun> runs_;
+  std::vector<RowRuns> row_runs_;
+};
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_CLASS_MAP_H_
@@ -3,9 +3,32 @@
 #include <QString>
 #include <QtDebug>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "hsi/class_map.h"
+#include "hsi/spectral_bands.h"
+#include "hsi/spectral_resampler.h"
+#include "hsi/spectrum_table.h"
+#include "util/aligned_allocator.h"
+#include "util/parallel_for.h"
 #include "util/util.h"
 
 namespace hsi_data_generator {
@@ -34,71 +57,708 @@ static const QString kInvalidImageSizeErrorMessage =
 static const QString kFileNotOpenErrorMessage =
     "Could not open file \"" + util::kTextSubPlaceholder + "\" for writing.";
 
+static const QString kFileWriteErrorMessage =
+    "Could not write data to file \"" + util::kTextSubPlaceholder + "\".";
+
 static const QString kInvalidSpectrumClassErrorMessage =
     "Invalid spectrum class: must be between 0 and " +
     util::kTextSubPlaceholder + ".";
 
+static const QString kLayoutNotRenderedErrorMessage =
+    "The image layout has not been rendered at its current size.";
+
+static const QString kSensorWavelengthRangeErrorMessage =
+    "All sensors must share the same wavelength range.";
+
+static const QString kExportCanceledErrorMessage = "The export was canceled.";
+
+// The number of significant digits of each value in header lists (e.g. the
+// band wavelengths).
+constexpr int kHeaderListPrecision = 10;
+
+// The number of samples that each chunk (a block of image rows) is sized to
+// hold. This bounds the size of the buffer that each export thread fills.
+constexpr int64_t kTargetChunkNumSamples = 4 * 1024 * 1024;
+
+// Everything needed to generate any part of the exported data cube. The cube
+// is split into chunks that are each a contiguous section of the data file:
+// a block of rows of a single band plane for BSQ, and a block of image rows
+// (with all bands) for BIL and BIP. Chunks are independent of each other, so
+// they can be filled and written in any order.
+//
+// The spectra are stored already converted to the output SampleType, so that
+// filling a chunk only copies samples: each run of the class map is a single
+// fill of one value (or one spectrum for BIP), and rows that repeat the row
+// above them are copies of the previous output row.
+template <typename SampleType>
+struct ExportCube {
+  int num_rows;
+  int num_cols;
+  int num_bands;
+  int num_spectra;
+  HSIInterleaveFormat interleave_format;
+
+  // The class runs of each image row.
+  const ClassMap* class_map;
+
+  // The generated spectra. For BSQ and BIL this table is band-major (the value
+  // of class c at band b is at index b * num_spectra + c). For BIP it is
+  // class-major (index c * num_bands + b) so that each spectrum is contiguous.
+  util::AlignedVector<SampleType> spectrum_table;
+
+  // The number of image rows in each chunk, and the resulting number of row
+  // blocks needed to cover the image.
+  int rows_per_chunk;
+  int num_row_blocks;
+};
+
+// Converts a generated (normalized) spectrum value into an output sample.
+// Values are multiplied by the scale factor, and integer types are rounded
+// and clamped to their valid range.
+template <typename SampleType>
+SampleType ConvertSample(const double value, const double scale_factor) {
+  const double scaled_value = std::round(value * scale_factor);
+  const double min_value = std::numeric_limits<SampleType>::min();
+  const double max_value = std::numeric_limits<SampleType>::max();
+  return static_cast<SampleType>(
+      std::min(std::max(scaled_value, min_value), max_value));
+}
+
+template <>
+float ConvertSample<float>(const double value, const double scale_factor) {
+  return static_cast<float>(value * scale_factor);
+}
+
+template <>
+double ConvertSample<double>(const double value, const double scale_factor) {
+  return value * scale_factor;
+}
+
+// Reverses the byte order of each of the given samples in place. Each sample
+// is kSampleSize bytes long.
+//
+// When SSSE3 is enabled at compile time, 16 bytes are swapped at once with a
+// single byte shuffle. The remaining samples are swapped one at a time.
+template <int kSampleSize>
+void SwapByteOrder(uint8_t* data, const int64_t num_samples) {
+  int64_t sample = 0;
+#ifdef __SSSE3__
+  constexpr int kNumVectorSamples = 16 / kSampleSize;
+  uint8_t shuffle_indices[16];
+  for (int i = 0; i < 16; ++i) {
+    const int sample_start = (i / kSampleSize) * kSampleSize;
+    shuffle_indices[i] = sample_start + (kSampleSize - 1 - i % kSampleSize);
+  }
+  const __m128i shuffle_mask =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle_indices));
+  for (; sample + kNumVectorSamples <= num_samples;
+       sample += kNumVectorSamples) {
+    __m128i* vector = reinterpret_cast<__m128i*>(&data[sample * kSampleSize]);
+    _mm_storeu_si128(
+        vector, _mm_shuffle_epi8(_mm_loadu_si128(vector), shuffle_mask));
+  }
+#endif
+  for (; sample < num_samples; ++sample) {
+    uint8_t* sample_bytes = &data[sample * kSampleSize];
+    std::reverse(sample_bytes, sample_bytes + kSampleSize);
+  }
+}
+
+// Single-byte samples have no byte order.
+template <>
+void SwapByteOrder<1>(uint8_t* data, const int64_t num_samples) {}
+
+// Converts the generated spectra into output samples, packed into a single
+// lookup table in the layout used by the given interleave format (see
+// ExportCube::spectrum_table).
+template <typename SampleType>
+util::AlignedVector<SampleType> BuildSpectrumTable(
+    const SpectrumTable<double>& generated_spectra,
+    const HSIInterleaveFormat interleave_format,
+    const double scale_factor) {
+
+  const int num_spectra = generated_spectra.GetNumSpectra();
+  const int num_bands = generated_spectra.GetNumBands();
+  const util::AlignedVector<double>& band_table = generated_spectra.GetValues();
+  util::AlignedVector<SampleType> spectrum_table(band_table.size());
+  if (interleave_format != HSI_INTERLEAVE_BIP) {
+    for (size_t i = 0; i < band_table.size(); ++i) {
+      spectrum_table[i] =
+          ConvertSample<SampleType>(band_table[i], scale_factor);
+    }
+    return spectrum_table;
+  }
+  for (int band = 0; band < num_bands; ++band) {
+    const double* band_values = generated_spectra.GetBandValues(band);
+    for (int class_index = 0; class_index < num_spectra; ++class_index) {
+      spectrum_table[class_index * num_bands + band] =
+          ConvertSample<SampleType>(band_values[class_index], scale_factor);
+    }
+  }
+  return spectrum_table;
+}
+
+// Returns true if every class index in the given class map has a matching
+// spectrum. This is checked once up front so that the export loops below do
+// not need to range check each run.
+bool IsClassMapValid(const ClassMap& class_map, const int num_spectra) {
+  int min_class_index = 0;
+  int max_class_index = 0;
+  if (!class_map.GetClassRange(&min_class_index, &max_class_index)) {
+    return true;
+  }
+  return min_class_index >= 0 && max_class_index < num_spectra;
+}
+
+template <typename SampleType>
+int GetNumChunks(const ExportCube<SampleType>& cube) {
+  if (cube.interleave_format == HSI_INTERLEAVE_BSQ) {
+    return cube.num_bands * cube.num_row_blocks;
+  }
+  return cube.num_row_blocks;
+}
+
+// Returns the number of samples that a single row holds in a chunk.
+template <typename SampleType>
+int64_t GetRowNumSamples(const ExportCube<SampleType>& cube) {
+  if (cube.interleave_format == HSI_INTERLEAVE_BSQ) {
+    return cube.num_cols;
+  }
+  return static_cast<int64_t>(cube.num_cols) * cube.num_bands;
+}
+
+// Returns the largest number of samples that any single chunk holds.
+template <typename SampleType>
+int64_t GetMaxChunkNumSamples(
+    const ExportCube<SampleType>& cube) {
+  return cube.rows_per_chunk * GetRowNumSamples(cube);
+}
+
+// Fills a single line of output samples from the runs of the given row, with
+// the value of each run's class in the given table. Each run is a single fill,
+// which the compiler vectorizes into wide stores.
+template <typename SampleType>
+void FillRunLine(
+    const ExportCube<SampleType>& cube,
+    const int row,
+    const SampleType* values,
+    SampleType* output) {
+
+  const ClassRun* row_runs = cube.class_map->GetRowRuns(row);
+  const int num_runs = cube.class_map->GetRowNumRuns(row);
+  int start_x = 0;
+  for (int i = 0; i < num_runs; ++i) {
+    std::fill(
+        output + start_x, output + row_runs[i].end_x,
+        values[row_runs[i].class_index]);
+    start_x = row_runs[i].end_x;
+  }
+}
+
+// Returns true if the given row's output in a chunk can be copied from the
+// previous row in the same chunk.
+template <typename SampleType>
+bool CanCopyPreviousRow(
+    const ExportCube<SampleType>& cube, const int first_row, const int row) {
+  return row > first_row && cube.class_map->IsRepeatedRow(row);
+}
+
+// Fills a BSQ chunk: a block of rows of the given band's image plane.
+template <typename SampleType>
+void FillBSQChunk(
+    const ExportCube<SampleType>& cube,
+    const int band,
+    const int first_row,
+    const int end_row,
+    SampleType* output) {
+
+  const SampleType* band_values =
+      &cube.spectrum_table[band * cube.num_spectra];
+  for (int row = first_row; row < end_row; ++row) {
+    SampleType* row_output = &output[(row - first_row) * cube.num_cols];
+    if (CanCopyPreviousRow(cube, first_row, row)) {
+      std::copy(row_output - cube.num_cols, row_output, row_output);
+    } else {
+      FillRunLine(cube, row, band_values, row_output);
+    }
+  }
+}
+
+// Fills a BIL chunk. Each row is stored as one line of columns per band.
+template <typename SampleType>
+void FillBILChunk(
+    const ExportCube<SampleType>& cube,
+    const int first_row,
+    const int end_row,
+    SampleType* output) {
+
+  const int line_size = cube.num_cols * cube.num_bands;
+  for (int row = first_row; row < end_row; ++row) {
+    SampleType* row_output = &output[(row - first_row) * line_size];
+    if (CanCopyPreviousRow(cube, first_row, row)) {
+      std::copy(row_output - line_size, row_output, row_output);
+      continue;
+    }
+    for (int band = 0; band < cube.num_bands; ++band) {
+      FillRunLine(
+          cube, row, &cube.spectrum_table[band * cube.num_spectra],
+          &row_output[band * cube.num_cols]);
+    }
+  }
+}
+
+// Fills a BIP chunk. Each pixel is stored as its full spectrum, so each run is
+// its class's spectrum repeated once per pixel.
+template <typename SampleType>
+void FillBIPChunk(
+    const ExportCube<SampleType>& cube,
+    const int first_row,
+    const int end_row,
+    SampleType* output) {
+
+  const int line_size = cube.num_cols * cube.num_bands;
+  for (int row = first_row; row < end_row; ++row) {
+    SampleType* row_output = &output[(row - first_row) * line_size];
+    if (CanCopyPreviousRow(cube, first_row, row)) {
+      std::copy(row_output - line_size, row_output, row_output);
+      continue;
+    }
+    const ClassRun* row_runs = cube.class_map->GetRowRuns(row);
+    const int num_runs = cube.class_map->GetRowNumRuns(row);
+    int start_x = 0;
+    for (int i = 0; i < num_runs; ++i) {
+      const SampleType* class_values =
+          &cube.spectrum_table[row_runs[i].class_index * cube.num_bands];
+      SampleType* pixel_output = &row_output[start_x * cube.num_bands];
+      for (int col = start_x; col < row_runs[i].end_x; ++col) {
+        std::copy(class_values, class_values + cube.num_bands, pixel_output);
+        pixel_output += cube.num_bands;
+      }
+      start_x = row_runs[i].end_x;
+    }
+  }
+}
+
+// Fills the output buffer with the data of the given chunk. Returns the number
+// of samples that were written into the buffer, and sets the chunk's offset
+// (in samples) from the start of the data file.
+//
+// The interleave format is a template parameter, so each writer kernel is
+// compiled for a single sample type and interleave format.
+template <typename SampleType, HSIInterleaveFormat kInterleaveFormat>
+int64_t FillChunk(
+    const ExportCube<SampleType>& cube,
+    const int chunk_index,
+    SampleType* output,
+    int64_t* file_offset) {
+
+  const int row_block = chunk_index % cube.num_row_blocks;
+  const int first_row = row_block * cube.rows_per_chunk;
+  const int end_row = std::min(first_row + cube.rows_per_chunk, cube.num_rows);
+  const int64_t row_num_samples = GetRowNumSamples(cube);
+  if (kInterleaveFormat == HSI_INTERLEAVE_BSQ) {
+    const int band = chunk_index / cube.num_row_blocks;
+    FillBSQChunk(cube, band, first_row, end_row, output);
+    *file_offset =
+        (static_cast<int64_t>(band) * cube.num_rows + first_row) *
+        row_num_samples;
+  } else {
+    if (kInterleaveFormat == HSI_INTERLEAVE_BIL) {
+      FillBILChunk(cube, first_row, end_row, output);
+    } else {
+      FillBIPChunk(cube, first_row, end_row, output);
+    }
+    *file_offset = first_row * row_num_samples;
+  }
+  return (end_row - first_row) * row_num_samples;
+}
+
+// Writes the given data to the file at the given byte offset. The write is
+// positional, so any number of threads can write to the same file at once.
+// Returns true on success.
+bool WriteAtOffset(
+    const int file_descriptor,
+    const char* data,
+    int64_t num_bytes,
+    int64_t offset) {
+
+  while (num_bytes > 0) {
+    const ssize_t num_written =
+        pwrite(file_descriptor, data, num_bytes, offset);
+    if (num_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += num_written;
+    num_bytes -= num_written;
+    offset += num_written;
+  }
+  return true;
+}
+
+// The open data file, and the state shared with the threads writing to it.
+struct DataFileTarget {
+  int file_descriptor;
+  int num_threads;
+
+  // No new chunks are started once this flag is set.
+  const std::atomic<bool>* cancel_requested;
+
+  // Incremented as each chunk is written to the file.
+  std::atomic<int64_t>* num_bytes_written;
+};
+
+// Fills and writes every chunk of the cube to the given open file. The chunks
+// are distributed over a pool of threads. Each thread fills a chunk into its
+// own reusable buffer and writes it directly to the chunk's position in the
+// file, so the output is identical to a serial export.
+//
+// Returns true on success, or false if a write failed or the export was
+// canceled.
+template <typename SampleType, HSIInterleaveFormat kInterleaveFormat>
+bool WriteDataCube(
+    const ExportCube<SampleType>& cube,
+    const DataFileTarget& target) {
+
+  std::vector<std::vector<SampleType>> chunk_buffers(target.num_threads);
+  const int64_t max_chunk_num_samples = GetMaxChunkNumSamples(cube);
+  return util::ParallelFor(
+      GetNumChunks(cube),
+      target.num_threads,
+      [&](const int chunk_index, const int thread_index) {
+        if (*target.cancel_requested) {
+          return false;
+        }
+        std::vector<SampleType>& chunk_buffer = chunk_buffers[thread_index];
+        chunk_buffer.resize(max_chunk_num_samples);
+        int64_t file_offset = 0;
+        const int64_t num_samples =
+            FillChunk<SampleType, kInterleaveFormat>(
+                cube, chunk_index, chunk_buffer.data(), &file_offset);
+        const int64_t num_bytes = num_samples * sizeof(SampleType);
+        if (!WriteAtOffset(
+                target.file_descriptor,
+                reinterpret_cast<const char*>(chunk_buffer.data()),
+                num_bytes,
+                file_offset * sizeof(SampleType))) {
+          return false;
+        }
+        *target.num_bytes_written += num_bytes;
+        return true;
+      });
+}
+
+// Prepares the cube for the given SampleType and writes it to the given open
+// file with the writer kernel for its interleave format. This is the only
+// place where the data type and interleave format are branched on.
+//
+// Returns true on success.
+template <typename SampleType>
+bool WriteDataFile(
+    const SpectrumTable<double>& generated_spectra,
+    const ClassMap& class_map,
+    const int num_rows,
+    const int num_cols,
+    const int num_bands,
+    const HSIInterleaveFormat interleave_format,
+    const double scale_factor,
+    const bool swap_byte_order,
+    const DataFileTarget& target) {
+
+  // Spectra are converted once and packed into a lookup table, so each chunk
+  // of the file is a series of fills from the class map's runs.
+  const int num_spectra = generated_spectra.GetNumSpectra();
+  ExportCube<SampleType> cube;
+  cube.num_rows = num_rows;
+  cube.num_cols = num_cols;
+  cube.num_bands = num_bands;
+  cube.num_spectra = num_spectra;
+  cube.interleave_format = interleave_format;
+  cube.class_map = &class_map;
+  cube.spectrum_table = BuildSpectrumTable<SampleType>(
+      generated_spectra, interleave_format, scale_factor);
+  // Every sample in the file is a copy of a table entry, so swapping the
+  // table once puts the whole file in the requested byte order.
+  if (swap_byte_order) {
+    SwapByteOrder<sizeof(SampleType)>(
+        reinterpret_cast<uint8_t*>(cube.spectrum_table.data()),
+        cube.spectrum_table.size());
+  }
+  cube.rows_per_chunk = std::max(
+      1, static_cast<int>(kTargetChunkNumSamples / GetRowNumSamples(cube)));
+  cube.num_row_blocks =
+      (num_rows + cube.rows_per_chunk - 1) / cube.rows_per_chunk;
+
+  switch (interleave_format) {
+  case HSI_INTERLEAVE_BIL:
+    return WriteDataCube<SampleType, HSI_INTERLEAVE_BIL>(cube, target);
+  case HSI_INTERLEAVE_BIP:
+    return WriteDataCube<SampleType, HSI_INTERLEAVE_BIP>(cube, target);
+  case HSI_INTERLEAVE_BSQ:
+  default:
+    return WriteDataCube<SampleType, HSI_INTERLEAVE_BSQ>(cube, target);
+  }
+}
+
+// Returns the ENVI header name of the given interleave format.
+QString GetInterleaveHeaderName(const HSIInterleaveFormat interleave_format) {
+  switch (interleave_format) {
+  case HSI_INTERLEAVE_BIL:
+    return "bil";
+  case HSI_INTERLEAVE_BIP:
+    return "bip";
+  case HSI_INTERLEAVE_BSQ:
+  default:
+    return "bsq";
+  }
+}
+
+// Returns the ENVI "byte order" code of the given byte order.
+int GetByteOrderHeaderCode(const HSIByteOrder byte_order) {
+  return (byte_order == HSI_BYTE_ORDER_BIG_ENDIAN) ? 1 : 0;
+}
+
+// Returns the ENVI "data type" code of the given data type.
+int GetDataTypeHeaderCode(const HSIDataType data_type) {
+  switch (data_type) {
+  case HSI_DATA_TYPE_UINT8:
+    return 1;
+  case HSI_DATA_TYPE_INT16:
+    return 2;
+  case HSI_DATA_TYPE_UINT16:
+    return 12;
+  case HSI_DATA_TYPE_FLOAT64:
+    return 5;
+  case HSI_DATA_TYPE_FLOAT32:
+  default:
+    return 4;
+  }
+}
+
+// Writes a list of values to the header, e.g. "wavelength = {400, 410}".
+void WriteHeaderList(
+    const std::string& field_name,
+    const std::vector<double>& values,
+    std::ofstream* header_file) {
+
+  const std::streamsize precision = header_file->precision();
+  header_file->precision(kHeaderListPrecision);
+  *header_file << field_name << " = {";
+  const int num_values = values.size();
+  for (int i = 0; i < num_values; ++i) {
+    if (i > 0) {
+      *header_file << ", ";
+    }
+    *header_file << values[i];
+  }
+  *header_file << "}\n";
+  header_file->precision(precision);
+}
+
 }  // namespace
 
+HSIDataExporter::HSIDataExporter(
+    const std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra,
+    const std::shared_ptr<ImageLayout> image_layout,
+    const int num_bands)
+    : num_bands_(num_bands),
+      image_width_(image_layout->GetWidthRoot()),
+      image_height_(image_layout->GetHeightRoot()),
+      class_map_(image_layout->GetClassMapRoot()),
+      interleave_format_(HSI_INTERLEAVE_BSQ),
+      data_type_(HSI_DATA_TYPE_FLOAT32),
+      scale_factor_(0.0),
+      byte_order_(HSI_BYTE_ORDER_LITTLE_ENDIAN),
+      num_threads_(0),
+      num_master_bands_(0),
+      cancel_requested_(false),
+      num_bytes_written_(0),
+      total_num_bytes_(0) {
+
+  // Copy each spectrum so that later edits do not affect this export.
+  for (const std::shared_ptr<Spectrum>& spectrum : *spectra) {
+    spectra_.push_back(std::shared_ptr<Spectrum>(new Spectrum(*spectrum)));
+  }
+}
+
 bool HSIDataExporter::SaveFile(const QString& file_name) const {
+  const int num_bands = GetNumBands();
+  if (!IsExportValid(num_bands)) {
+    return false;
+  }
+  const int num_threads = GetNumExportThreads();
+  num_bytes_written_ = 0;
+  total_num_bytes_ = GetCubeNumBytes(num_bands);
+  const SpectrumTable<double> generated_spectra =
+      spectral_bands_.IsEmpty() ?
+      SpectrumTable<double>(spectra_, num_bands, num_threads) :
+      SpectrumTable<double>(spectra_, spectral_bands_, num_threads);
+  return WriteCube(file_name, generated_spectra, spectral_bands_, num_threads);
+}
+
+bool HSIDataExporter::SaveSensorFiles(
+    const std::vector<SensorExport>& sensors) const {
+
+  if (num_master_bands_ > util::kMaxNumberOfBands) {
+    error_message_ = kInvalidNumberOfBandsErrorMessage;
+    return false;
+  }
+  std::vector<SpectralBands> sensor_bands;
+  int64_t total_num_bytes = 0;
+  for (const SensorExport& sensor : sensors) {
+    if (!IsExportValid(sensor.bands.GetNumBands())) {
+      return false;
+    }
+    if (sensor.bands.GetMinWavelength() !=
+            sensors.front().bands.GetMinWavelength() ||
+        sensor.bands.GetMaxWavelength() !=
+            sensors.front().bands.GetMaxWavelength()) {
+      error_message_ = kSensorWavelengthRangeErrorMessage;
+      return false;
+    }
+    sensor_bands.push_back(sensor.bands);
+    total_num_bytes += GetCubeNumBytes(sensor.bands.GetNumBands());
+  }
+  const int num_threads = GetNumExportThreads();
+  num_bytes_written_ = 0;
+  total_num_bytes_ = total_num_bytes;
+  // The spectra are generated only once, on the master grid. They are
+  // normalized after resampling, by their maximum in each sensor's bands, the
+  // same way that SaveFile() normalizes the spectra integrated over the bands.
+  const int num_master_bands = (num_master_bands_ > 0) ?
+      num_master_bands_ : GetNumMasterBands(sensor_bands, spectra_);
+  const SpectralBands master_bands =
+      GetMasterBands(sensor_bands, num_master_bands);
+  const SpectrumTable<double> master_spectra(
+      spectra_, master_bands, num_threads, false);
+  for (const SensorExport& sensor : sensors) {
+    const SpectralResampler resampler(sensor.bands, master_bands);
+    SpectrumTable<double> sensor_spectra =
+        resampler.Resample(master_spectra, num_threads);
+    sensor_spectra.Normalize();
+    if (!WriteCube(sensor.file_name, sensor_spectra, sensor.bands,
+                   num_threads)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HSIDataExporter::IsExportValid(const int num_bands) const {
   // Determine variables and check for validity:
-  const int num_spectra = spectra_->size();
+  const int num_spectra = spectra_.size();
   if (num_spectra < 1) {
     error_message_ = kNotEnoughSpectraErrorMessage;
     return false;
   }
-  std::vector<std::vector<double>> generated_spectra;
-  for (int i = 0; i < num_spectra; ++i) {
-    generated_spectra.push_back(spectra_->at(i)->GenerateSpectrum(num_bands_));
-  }
-  if (num_bands_ < util::kMinNumberOfBands ||
-      num_bands_ > util::kMaxNumberOfBands) {
+  if (num_bands < util::kMinNumberOfBands ||
+      num_bands > util::kMaxNumberOfBands) {
     error_message_ = kInvalidNumberOfBandsErrorMessage;
     return false;
   }
-  const int num_rows = image_layout_->GetHeight();
+  const int num_rows = image_height_;
   if (num_rows < util::kMinImageDimensionSize ||
       num_rows > util::kMaxImageDimensionSize) {
     error_message_ = kInvalidImageSizeErrorMessage;
     return false;
   }
-  const int num_cols = image_layout_->GetWidth();
+  const int num_cols = image_width_;
   if (num_cols < util::kMinImageDimensionSize ||
       num_cols > util::kMaxImageDimensionSize) {
     error_message_ = kInvalidImageSizeErrorMessage;
     return false;
   }
-  const int data_size = sizeof(float);  // TODO: Define type elsewhere?
-  // TODO: Endian format?
-  // TODO: Interleave format (BQS, BIL, BIP)?
+  const int num_pixels = num_rows * num_cols;
+  if (class_map_.GetNumPixels() != num_pixels) {
+    error_message_ = kLayoutNotRenderedErrorMessage;
+    return false;
+  }
+  if (!IsClassMapValid(class_map_, num_spectra)) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kInvalidSpectrumClassErrorMessage, QString::number(num_spectra - 1));
+    return false;
+  }
+  return true;
+}
+
+int HSIDataExporter::GetNumExportThreads() const {
+  return (num_threads_ < 1) ? util::GetDefaultNumThreads() : num_threads_;
+}
+
+int64_t HSIDataExporter::GetCubeNumBytes(const int num_bands) const {
+  return static_cast<int64_t>(image_width_) * image_height_ * num_bands *
+      GetDataTypeSize();
+}
+
+bool HSIDataExporter::WriteCube(
+    const QString& file_name,
+    const SpectrumTable<double>& generated_spectra,
+    const SpectralBands& spectral_bands,
+    const int num_threads) const {
+
+  const int num_rows = image_height_;
+  const int num_cols = image_width_;
+  const int num_bands = generated_spectra.GetNumBands();
+  const double scale_factor = GetScaleFactor();
+  const bool swap_byte_order =
+      util::IsHostBigEndian() != (byte_order_ == HSI_BYTE_ORDER_BIG_ENDIAN);
 
   // Write the file:
-  std::ofstream data_file(file_name.toStdString());
-  if (!data_file.is_open()) {
+  const int data_file =
+      open(file_name.toStdString().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (data_file < 0) {
     error_message_ = util::ReplaceTextSubPlaceholder(
         kFileNotOpenErrorMessage, file_name);
     return false;
   }
-  // BSQ (band sequential) format:
-  for (int band = 0; band < num_bands_; ++band) {
-    for (int row = 0; row < num_rows; ++row) {
-      for (int col = 0; col < num_cols; ++col) {
-        const int class_index = image_layout_->GetClassAtPixel(col, row);
-        if (class_index < 0 || class_index >= num_spectra) {
-          error_message_ = util::ReplaceTextSubPlaceholder(
-              kInvalidSpectrumClassErrorMessage,
-              QString::number(num_spectra - 1));
-          data_file.close();
-          return false;
-        }
-        const double data_value = generated_spectra[class_index][band];
-        const float export_value = static_cast<float>(data_value);
-        data_file.write(
-            reinterpret_cast<const char*>(&export_value), data_size);
-      }
-    }
+  DataFileTarget target;
+  target.file_descriptor = data_file;
+  target.num_threads = num_threads;
+  target.cancel_requested = &cancel_requested_;
+  target.num_bytes_written = &num_bytes_written_;
+  bool succeeded = false;
+  switch (data_type_) {
+  case HSI_DATA_TYPE_UINT8:
+    succeeded = WriteDataFile<uint8_t>(
+        generated_spectra, class_map_, num_rows, num_cols, num_bands,
+        interleave_format_, scale_factor, swap_byte_order, target);
+    break;
+  case HSI_DATA_TYPE_INT16:
+    succeeded = WriteDataFile<int16_t>(
+        generated_spectra, class_map_, num_rows, num_cols, num_bands,
+        interleave_format_, scale_factor, swap_byte_order, target);
+    break;
+  case HSI_DATA_TYPE_UINT16:
+    succeeded = WriteDataFile<uint16_t>(
+        generated_spectra, class_map_, num_rows, num_cols, num_bands,
+        interleave_format_, scale_factor, swap_byte_order, target);
+    break;
+  case HSI_DATA_TYPE_FLOAT64:
+    succeeded = WriteDataFile<double>(
+        generated_spectra, class_map_, num_rows, num_cols, num_bands,
+        interleave_format_, scale_factor, swap_byte_order, target);
+    break;
+  case HSI_DATA_TYPE_FLOAT32:
+  default:
+    succeeded = WriteDataFile<float>(
+        generated_spectra, class_map_, num_rows, num_cols, num_bands,
+        interleave_format_, scale_factor, swap_byte_order, target);
+    break;
+  }
+  const bool closed = (close(data_file) == 0);
+  if (cancel_requested_) {
+    // Don't leave a partial data file behind.
+    std::remove(file_name.toStdString().c_str());
+    error_message_ = kExportCanceledErrorMessage;
+    return false;
+  }
+  if (!closed || !succeeded) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kFileWriteErrorMessage, file_name);
+    return false;
   }
-  data_file.close();
 
   // Now write the header file:
   const QString header_file_name = file_name + kHeaderFileExtension;
@@ -108,19 +768,73 @@ bool HSIDataExporter::SaveFile(const QString& file_name) const {
         kFileNotOpenErrorMessage, header_file_name);
     return false;
   }
-  // TODO: Adjust these header values as needed.
-  header_file << "interleave      = bsq\n";
-  header_file << "data type       = float\n";
-  header_file << "byte order      = 0\n";
+  // ENVI readers (e.g. GDAL) only accept headers that start with this line.
+  header_file << "ENVI\n";
+  header_file << "interleave      = "
+              << GetInterleaveHeaderName(interleave_format_).toStdString()
+              << "\n";
+  header_file << "data type       = "
+              << GetDataTypeHeaderCode(data_type_) << "\n";
+  header_file << "byte order      = "
+              << GetByteOrderHeaderCode(byte_order_) << "\n";
   header_file << "header offset   = 0\n";
-  header_file << "samples         = " << num_rows << "\n";
-  header_file << "lines           = " << num_cols << "\n";
-  header_file << "bands           = " << num_bands_ << "\n";
+  header_file << "samples         = " << num_cols << "\n";
+  header_file << "lines           = " << num_rows << "\n";
+  header_file << "bands           = " << num_bands << "\n";
+  if (scale_factor != 1.0) {
+    header_file << "reflectance scale factor = " << scale_factor << "\n";
+  }
+  if (!spectral_bands.IsEmpty()) {
+    WriteHeaderList(
+        "wavelength", spectral_bands.GetCenterWavelengths(), &header_file);
+    WriteHeaderList("fwhm", spectral_bands.GetFWHMs(), &header_file);
+  }
   header_file.close();
 
   return true;
 }
 
+int HSIDataExporter::GetNumBands() const {
+  if (spectral_bands_.IsEmpty()) {
+    return num_bands_;
+  }
+  return spectral_bands_.GetNumBands();
+}
+
+int HSIDataExporter::GetDataTypeSize() const {
+  switch (data_type_) {
+  case HSI_DATA_TYPE_UINT8:
+    return sizeof(uint8_t);
+  case HSI_DATA_TYPE_INT16:
+    return sizeof(int16_t);
+  case HSI_DATA_TYPE_UINT16:
+    return sizeof(uint16_t);
+  case HSI_DATA_TYPE_FLOAT64:
+    return sizeof(double);
+  case HSI_DATA_TYPE_FLOAT32:
+  default:
+    return sizeof(float);
+  }
+}
+
+double HSIDataExporter::GetScaleFactor() const {
+  if (scale_factor_ > 0.0) {
+    return scale_factor_;
+  }
+  switch (data_type_) {
+  case HSI_DATA_TYPE_UINT8:
+    return std::numeric_limits<uint8_t>::max();
+  case HSI_DATA_TYPE_INT16:
+    return std::numeric_limits<int16_t>::max();
+  case HSI_DATA_TYPE_UINT16:
+    return std::numeric_limits<uint16_t>::max();
+  case HSI_DATA_TYPE_FLOAT32:
+  case HSI_DATA_TYPE_FLOAT64:
+  default:
+    return 1.0;
+  }
+}
+
 QString HSIDataExporter::GetErrorMessage() const {
   if (error_message_.isEmpty()) {
     return kGenericErrorMessage;
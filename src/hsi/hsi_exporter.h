@@ -2,27 +2,110 @@
 // image data cube to a binary ENVI file. It combines the individual spectra
 // and the image layout to generate the large output data file. It can also
 // handle adding noise and other "final touches" to the generated data.
+//
+// The exporter copies the spectra and the rendered layout when it is created,
+// so the export can run on a background thread while they are being edited.
 
 #ifndef SRC_HSI_HSI_EXPORTER_H_
 #define SRC_HSI_HSI_EXPORTER_H_
 
 #include <QString>
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
+#include "hsi/class_map.h"
 #include "hsi/image_layout.h"
+#include "hsi/spectral_bands.h"
 #include "hsi/spectrum.h"
+#include "hsi/spectrum_table.h"
 
 namespace hsi_data_generator {
 
+// The order in which the samples of the data cube are stored in the file.
+enum HSIInterleaveFormat {
+  HSI_INTERLEAVE_BSQ,  // Band sequential: one full image plane per band.
+  HSI_INTERLEAVE_BIL,  // Band interleaved by line: each row holds all bands.
+  HSI_INTERLEAVE_BIP   // Band interleaved by pixel: each pixel's spectrum.
+};
+
+// The data type of each sample in the exported file.
+enum HSIDataType {
+  HSI_DATA_TYPE_UINT8,    // ENVI data type 1.
+  HSI_DATA_TYPE_INT16,    // ENVI data type 2.
+  HSI_DATA_TYPE_UINT16,   // ENVI data type 12.
+  HSI_DATA_TYPE_FLOAT32,  // ENVI data type 4.
+  HSI_DATA_TYPE_FLOAT64   // ENVI data type 5.
+};
+
+// The byte order of each multi-byte sample in the exported file.
+enum HSIByteOrder {
+  HSI_BYTE_ORDER_LITTLE_ENDIAN,  // ENVI byte order 0.
+  HSI_BYTE_ORDER_BIG_ENDIAN      // ENVI byte order 1.
+};
+
+// A sensor exported by HSIDataExporter::SaveSensorFiles(): its bands, and the
+// data file that its cube is saved to.
+struct SensorExport {
+  SpectralBands bands;
+  QString file_name;
+};
+
 class HSIDataExporter {
  public:
+  // Takes a snapshot of the given spectra and of the image layout's current
+  // class map (the layout must already be rendered). The whole layout is
+  // exported, even if it is zoomed in to a sub-layout. Nothing is shared with
+  // the given objects after construction.
   HSIDataExporter(
       const std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra,
       const std::shared_ptr<ImageLayout> image_layout,
-      const int num_bands)
-      : spectra_(spectra), image_layout_(image_layout), num_bands_(num_bands) {}
+      const int num_bands);
+
+  // Sets the interleave format of the exported file. BSQ is the default.
+  void SetInterleaveFormat(const HSIInterleaveFormat interleave_format) {
+    interleave_format_ = interleave_format;
+  }
+
+  // Sets the data type of each exported sample. 32-bit float is the default.
+  void SetDataType(const HSIDataType data_type) {
+    data_type_ = data_type;
+  }
+
+  // Sets the factor that every (normalized) spectrum value is multiplied by
+  // before it is stored. Integer types are also rounded and clamped to their
+  // range. A value of 0 or less (the default) picks the scale automatically:
+  // the maximum value of integer types, and 1 for floating point types.
+  //
+  // If the scale is not 1, it is stored in the header as the "reflectance
+  // scale factor".
+  void SetScaleFactor(const double scale_factor) {
+    scale_factor_ = scale_factor;
+  }
+
+  // Sets the byte order of the exported samples. Little endian is the
+  // default.
+  void SetByteOrder(const HSIByteOrder byte_order) {
+    byte_order_ = byte_order;
+  }
+
+  // Sets the sensor bands that the spectra are measured by (see
+  // Spectrum::IntegrateSpectrum()). If the bands are not empty, they replace
+  // the number of bands given to the constructor, and their center
+  // wavelengths and FWHMs are stored in the header. By default, there are no
+  // sensor bands and the spectra are point sampled.
+  void SetSpectralBands(const SpectralBands& spectral_bands) {
+    spectral_bands_ = spectral_bands;
+  }
+
+  // Sets the number of threads used to generate and write the data. A value
+  // less than 1 (the default) uses all available cores. The output file is
+  // the same regardless of the number of threads.
+  void SetNumThreads(const int num_threads) {
+    num_threads_ = num_threads;
+  }
 
   // Saves the file to the given file path. This will be a binary ENVI file.
   // An additional header file will also be saved, which will have the same
@@ -31,17 +114,119 @@ class HSIDataExporter {
   // Returns true on success.
   bool SaveFile(const QString& file_name) const;
 
+  // Saves one file (and header) per sensor, all from the same layout
+  // snapshot. Instead of integrating every spectrum for every sensor, the
+  // spectra are generated once at the master resolution (see
+  // SetNumMasterBands()) and then resampled to each sensor's bands. The
+  // sensors should share a wavelength range (see
+  // SpectralBands::SetWavelengthRange()), so that they all see the same
+  // spectra.
+  //
+  // The progress (see GetNumBytesWritten()) covers all of the files. Returns
+  // true if every file was saved. On failure, the files of earlier sensors
+  // are kept.
+  bool SaveSensorFiles(const std::vector<SensorExport>& sensors) const;
+
+  // Sets the number of bands that SaveSensorFiles() generates the spectra at
+  // before resampling them. It should be high enough to resolve the narrowest
+  // peaks and sensor bands. A value of 0 (the default) picks the number
+  // automatically (see GetNumMasterBands()).
+  void SetNumMasterBands(const int num_master_bands) {
+    num_master_bands_ = num_master_bands;
+  }
+
+  // Stops a running SaveFile() or SaveSensorFiles() call, which will return
+  // false once the chunks that are currently being written (at most one band
+  // plane each) finish. The partially written data file is removed. This can
+  // be called from any thread.
+  void Cancel();
+
+  // Returns the number of data file bytes written so far by SaveFile() (or
+  // SaveSensorFiles()), and the total number of bytes that it will write.
+  // These can be called from any thread to report the progress of a running
+  // export.
+  int64_t GetNumBytesWritten() const {
+    return num_bytes_written_;
+  }
+
+  int64_t GetTotalNumBytes() const {
+    return total_num_bytes_;
+  }
+
   // Returns any error message caused by SaveFile(). If no errors were logged,
   // returns a generic error string.
   QString GetErrorMessage() const;
 
  private:
-  const std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra_;
-  const std::shared_ptr<ImageLayout> image_layout_;
+  // Returns the number of exported bands: the number of sensor bands if they
+  // are set, or the number given to the constructor otherwise.
+  int GetNumBands() const;
+
+  // Checks that a cube with the given number of bands can be exported. If
+  // not, the error message is set and false is returned.
+  bool IsExportValid(const int num_bands) const;
+
+  // Returns the number of threads to export with (see SetNumThreads()).
+  int GetNumExportThreads() const;
+
+  // Returns the size in bytes of a data file with the given number of bands.
+  int64_t GetCubeNumBytes(const int num_bands) const;
+
+  // Writes the data file and header of a single cube, with the spectra in the
+  // given table. The spectral bands' wavelengths are stored in the header, if
+  // there are any. Returns true on success.
+  bool WriteCube(
+      const QString& file_name,
+      const SpectrumTable<double>& generated_spectra,
+      const SpectralBands& spectral_bands,
+      const int num_threads) const;
+
+  // Returns the size in bytes of a single sample of the current data type.
+  int GetDataTypeSize() const;
+
+  // Returns the scale factor used for the current data type (see
+  // SetScaleFactor()).
+  double GetScaleFactor() const;
+
+  // The snapshot of the spectra, which are copies owned by this exporter.
+  std::vector<std::shared_ptr<Spectrum>> spectra_;
 
-  // The number of bands that will be exported in the HSI image.
+  // The number of bands that will be exported in the HSI image, unless sensor
+  // bands are set.
   const int num_bands_;
 
+  // The sensor bands (see SetSpectralBands()).
+  SpectralBands spectral_bands_;
+
+  // The snapshot of the rendered image layout: its size and the class index
+  // of each pixel.
+  const int image_width_;
+  const int image_height_;
+  const ClassMap class_map_;
+
+  // The interleave format used to order the exported data.
+  HSIInterleaveFormat interleave_format_;
+
+  // The data type and scale of the exported samples.
+  HSIDataType data_type_;
+  double scale_factor_;
+
+  // The byte order of the exported samples.
+  HSIByteOrder byte_order_;
+
+  // The number of export threads (see SetNumThreads()).
+  int num_threads_;
+
+  // The resolution of the master spectra (see SetNumMasterBands()).
+  int num_master_bands_;
+
+  // Set by Cancel() to stop a running export.
+  std::atomic<bool> cancel_requested_;
+
+  // The progress of the running export (see GetNumBytesWritten()).
+  mutable std::atomic<int64_t> num_bytes_written_;
+  mutable std::atomic<int64_t> total_num_bytes_;
+
   // This error message is logged if the SaveFile operation fails.
   mutable QString error_message_;
 };
@@ -7,17 +7,31 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <utility>
 #include <vector>
 
+#include "hsi/class_map.h"
+#include "util/parallel_for.h"
+
 namespace hsi_data_generator {
 namespace {
 
-// The default class "index" for un-specified pixels or pixels which contain a
-// sub-layout.
+// The default class "index" for un-specified pixels.
 constexpr int kDefaultSpectralClassIndex = 0;
-constexpr int kSubLayoutClassIndex = -1;
+
+// The number of rows that each render task fills. Large layouts are split into
+// blocks of rows so that a single layout is also rendered in parallel.
+constexpr int kRenderRowBlockSize = 256;
+
+// The spatial index grid has about one cell per component, up to this many
+// cells per side.
+constexpr int kMaxSpatialIndexGridSize = 256;
+
+// Components are added to every index cell within this (relative) distance of
+// their shape, so that rounding never leaves out a cell they cover.
+constexpr double kSpatialIndexMargin = 1e-9;
 
 // This is the default stripe width for generating the stripe and grid layouts.
 // The actual assigned stripe width can be smaller if the given number of
@@ -60,35 +74,334 @@ double GetAppropriateShapeSize(
   return shape_size;
 }
 
-// Given a component shape defining a region of the layout and an index, this
-// function will fill that region (in the given spectral class map) with the
-// given index. This is used to fill in primitives or sub-layout values.
-void FillLayoutRenderRegion(
+// The region of pixels that a layout component covers when its layout is
+// rendered at the given size. Each component covers the pixels from its start
+// (inclusive) to its end (exclusive). The region can extend past the edges of
+// the layout.
+struct PixelRegion {
+  int start_x;
+  int start_y;
+  int end_x;
+  int end_y;
+};
+
+PixelRegion GetPixelRegion(
     const LayoutComponentShape& component_shape,
     const int layout_width,
-    const int layout_height,
-    const int fill_index,
-    std::vector<int>* spectral_class_map) {
+    const int layout_height) {
 
-  const int start_x = static_cast<int>(
+  PixelRegion region;
+  region.start_x = static_cast<int>(
       component_shape.left_x * static_cast<double>(layout_width));
-  const int end_x = start_x + static_cast<int>(
-      component_shape.width * static_cast<double>(layout_height));
-  const int start_y = static_cast<int>(
+  region.end_x = region.start_x + static_cast<int>(
+      component_shape.width * static_cast<double>(layout_width));
+  region.start_y = static_cast<int>(
       component_shape.top_y * static_cast<double>(layout_height));
-  const int end_y = start_y + static_cast<int>(
+  region.end_y = region.start_y + static_cast<int>(
       component_shape.height * static_cast<double>(layout_height));
-  const int start_x_index = std::max(start_x, 0);
-  const int end_x_index = std::min(end_x, layout_width - 1);
-  const int start_y_index = std::max(start_y, 0);
-  const int end_y_index = std::min(end_y, layout_height - 1);
-  for (int x = start_x_index; x < end_x_index; ++x) {
-    for (int y = start_y_index; y < end_y_index; ++y) {
-      (*spectral_class_map)[GetIndexFromXY(x, y, layout_width)] = fill_index;
+  return region;
+}
+
+// Returns the cell of a spatial index grid with the given number of cells per
+// side that contains the given relative coordinate, clamped to the grid.
+int GetSpatialIndexCell(const double position, const int grid_size) {
+  const double grid_position = std::min(
+      std::max(position * grid_size, 0.0), static_cast<double>(grid_size - 1));
+  return static_cast<int>(grid_position);
+}
+
+// Returns the first and last (inclusive) cells of a spatial index grid with
+// the given number of cells per side that the relative range between start
+// and end overlaps, clamped to the grid.
+void GetSpatialIndexCellRange(
+    const double start,
+    const double end,
+    const int grid_size,
+    int* first_cell,
+    int* last_cell) {
+
+  *first_cell = GetSpatialIndexCell(start - kSpatialIndexMargin, grid_size);
+  *last_cell = GetSpatialIndexCell(end + kSpatialIndexMargin, grid_size);
+}
+
+// A primitive or sub-layout clipped to the layout, as it is drawn onto each
+// row that it covers. Components are drawn in their paint order: primitives in
+// the order they were added, and then sub-layouts on top of them in the order
+// they were added.
+struct RowComponent {
+  // The covered pixels, clipped to the layout.
+  int start_x;
+  int end_x;
+  int start_y;
+  int end_y;
+
+  int paint_order;
+
+  // The class of a primitive.
+  int class_index;
+
+  // The rendered class map of a sub-layout, or null for a primitive, and the
+  // (unclipped) position of the sub-layout's first pixel in the layout.
+  const ClassMap* sub_layout_class_map;
+  int sub_layout_left_x;
+  int sub_layout_top_y;
+};
+
+// Returns the component that draws the given pixel region, or false if the
+// region does not cover any pixels of the layout.
+bool GetRowComponent(
+    const PixelRegion& region,
+    const int layout_width,
+    const int layout_height,
+    const int paint_order,
+    RowComponent* component) {
+
+  component->start_x = std::max(region.start_x, 0);
+  component->end_x = std::min(region.end_x, layout_width);
+  component->start_y = std::max(region.start_y, 0);
+  component->end_y = std::min(region.end_y, layout_height);
+  component->paint_order = paint_order;
+  component->class_index = kDefaultSpectralClassIndex;
+  component->sub_layout_class_map = nullptr;
+  component->sub_layout_left_x = region.start_x;
+  component->sub_layout_top_y = region.start_y;
+  return component->start_x < component->end_x &&
+         component->start_y < component->end_y;
+}
+
+// Adds a run that ends at end_x to the row, or extends the last run if it has
+// the same class.
+void AddClassRun(
+    const int end_x, const int class_index, std::vector<ClassRun>* row_runs) {
+
+  if (!row_runs->empty() && row_runs->back().class_index == class_index) {
+    row_runs->back().end_x = end_x;
+  } else {
+    row_runs->push_back({end_x, class_index});
+  }
+}
+
+// Adds the runs of a component between start_x and end_x to the row.
+void AddComponentRuns(
+    const RowComponent& component,
+    const int y_row,
+    const int start_x,
+    const int end_x,
+    std::vector<ClassRun>* row_runs) {
+
+  if (component.sub_layout_class_map == nullptr) {
+    AddClassRun(end_x, component.class_index, row_runs);
+    return;
+  }
+  // Copy the sub-layout's runs, shifted to its position in the layout.
+  const ClassMap& sub_layout_class_map = *component.sub_layout_class_map;
+  const int sub_layout_row = y_row - component.sub_layout_top_y;
+  const ClassRun* runs = sub_layout_class_map.GetRowRuns(sub_layout_row);
+  const ClassRun* end_run =
+      runs + sub_layout_class_map.GetRowNumRuns(sub_layout_row);
+  const int left_x = component.sub_layout_left_x;
+  const ClassRun* run = std::upper_bound(
+      runs, end_run, start_x - left_x,
+      [](const int x, const ClassRun& run) { return x < run.end_x; });
+  for (; run != end_run && run->end_x + left_x < end_x; ++run) {
+    AddClassRun(run->end_x + left_x, run->class_index, row_runs);
+  }
+  if (run != end_run) {
+    AddClassRun(end_x, run->class_index, row_runs);
+  }
+}
+
+// Renders the rows between first_row (inclusive) and end_row (exclusive) of a
+// layout with the given components into the (empty) class map.
+//
+// Rows only change where a component starts or ends, or where a sub-layout's
+// rows change, so all other rows repeat the row above them. Each new row is
+// swept from left to right over the component edges: each part of the row
+// gets the runs of the covering component with the highest paint order, or
+// the default class if no component covers it.
+void RenderClassMapRows(
+    const std::vector<RowComponent>& components,
+    const int layout_width,
+    const int first_row,
+    const int end_row,
+    ClassMap* class_map) {
+
+  // Components that cover any of the rows, in the order they start.
+  std::vector<const RowComponent*> pending_components;
+  for (const RowComponent& component : components) {
+    if (component.start_y < end_row && component.end_y > first_row) {
+      pending_components.push_back(&component);
+    }
+  }
+  std::stable_sort(
+      pending_components.begin(),
+      pending_components.end(),
+      [](const RowComponent* a, const RowComponent* b) {
+        return a->start_y < b->start_y;
+      });
+
+  // The components that cover the current row, sorted by where they start
+  // and by where they end, which are the order of the sweep's events.
+  std::vector<const RowComponent*> active_components;
+  std::vector<const RowComponent*> active_components_by_end;
+  std::vector<const ClassRun*> sub_layout_rows;
+  std::vector<ClassRun> row_runs;
+  // The paint orders of the components that cover the sweep position, as a
+  // heap. Components that ended are removed from the heap lazily.
+  std::vector<char> is_component_covering(components.size(), false);
+  std::vector<int> covering_paint_orders;
+  const auto ends_before_row = [](const int y) {
+    return [y](const RowComponent* component) {
+      return component->end_y <= y;
+    };
+  };
+
+  class_map->Reset(layout_width);
+  const int num_pending_components = pending_components.size();
+  int next_pending_component = 0;
+  for (int y = first_row; y < end_row; ++y) {
+    bool row_changed = (y == first_row);
+    const size_t num_active_components = active_components.size();
+    active_components.erase(
+        std::remove_if(
+            active_components.begin(),
+            active_components.end(),
+            ends_before_row(y)),
+        active_components.end());
+    active_components_by_end.erase(
+        std::remove_if(
+            active_components_by_end.begin(),
+            active_components_by_end.end(),
+            ends_before_row(y)),
+        active_components_by_end.end());
+    row_changed |= (active_components.size() != num_active_components);
+    while (next_pending_component < num_pending_components &&
+           pending_components[next_pending_component]->start_y <= y) {
+      const RowComponent* component =
+          pending_components[next_pending_component];
+      active_components.insert(
+          std::upper_bound(
+              active_components.begin(),
+              active_components.end(),
+              component,
+              [](const RowComponent* a, const RowComponent* b) {
+                return a->start_x < b->start_x;
+              }),
+          component);
+      active_components_by_end.insert(
+          std::upper_bound(
+              active_components_by_end.begin(),
+              active_components_by_end.end(),
+              component,
+              [](const RowComponent* a, const RowComponent* b) {
+                return a->end_x < b->end_x;
+              }),
+          component);
+      ++next_pending_component;
+      row_changed = true;
+    }
+    // Shared sub-layout rows have the same runs pointer.
+    int sub_layout_index = 0;
+    for (const RowComponent* component : active_components) {
+      if (component->sub_layout_class_map == nullptr) {
+        continue;
+      }
+      const ClassRun* sub_layout_row =
+          component->sub_layout_class_map->GetRowRuns(
+              y - component->sub_layout_top_y);
+      if (row_changed ||
+          sub_layout_index >= static_cast<int>(sub_layout_rows.size())) {
+        row_changed = true;
+        sub_layout_rows.resize(sub_layout_index + 1);
+      } else if (sub_layout_rows[sub_layout_index] != sub_layout_row) {
+        row_changed = true;
+      }
+      sub_layout_rows[sub_layout_index] = sub_layout_row;
+      ++sub_layout_index;
     }
+    if (!row_changed) {
+      class_map->RepeatLastRow();
+      continue;
+    }
+
+    // Sweep over the component edges, merging the starts and ends.
+    row_runs.clear();
+    covering_paint_orders.clear();
+    int run_start_x = 0;
+    int next_start = 0;
+    int next_end = 0;
+    const int num_components = active_components.size();
+    while (next_end < num_components) {
+      const bool is_start = next_start < num_components &&
+          active_components[next_start]->start_x <=
+              active_components_by_end[next_end]->end_x;
+      const RowComponent* component = is_start ?
+          active_components[next_start++] :
+          active_components_by_end[next_end++];
+      const int x = is_start ? component->start_x : component->end_x;
+      if (x > run_start_x) {
+        while (!covering_paint_orders.empty() &&
+               !is_component_covering[covering_paint_orders.front()]) {
+          std::pop_heap(
+              covering_paint_orders.begin(), covering_paint_orders.end());
+          covering_paint_orders.pop_back();
+        }
+        if (covering_paint_orders.empty()) {
+          AddClassRun(x, kDefaultSpectralClassIndex, &row_runs);
+        } else {
+          AddComponentRuns(
+              components[covering_paint_orders.front()],
+              y, run_start_x, x, &row_runs);
+        }
+        run_start_x = x;
+      }
+      is_component_covering[component->paint_order] = is_start;
+      if (is_start) {
+        covering_paint_orders.push_back(component->paint_order);
+        std::push_heap(
+            covering_paint_orders.begin(), covering_paint_orders.end());
+      }
+    }
+    if (run_start_x < layout_width) {
+      AddClassRun(layout_width, kDefaultSpectralClassIndex, &row_runs);
+    }
+    class_map->AddRow(row_runs.data(), row_runs.size());
   }
 }
 
+// Returns the components of a layout with the given primitives and
+// sub-layouts, rendered at the given size, in paint order. The sub-layouts'
+// class maps must already be rendered at their current size.
+std::vector<RowComponent> GetLayoutRowComponents(
+    const std::vector<std::pair<LayoutComponentShape, int>>& layout_primitives,
+    const std::vector<std::pair<LayoutComponentShape, ImageLayout>>&
+        sub_layouts,
+    const int layout_width,
+    const int layout_height) {
+
+  std::vector<RowComponent> components;
+  RowComponent component;
+  for (const auto& shape_and_class : layout_primitives) {
+    if (GetRowComponent(
+            GetPixelRegion(shape_and_class.first, layout_width, layout_height),
+            layout_width, layout_height, components.size(), &component)) {
+      component.class_index = shape_and_class.second;
+      components.push_back(component);
+    }
+  }
+  for (const auto& shape_and_sub_layout : sub_layouts) {
+    if (GetRowComponent(
+            GetPixelRegion(
+                shape_and_sub_layout.first, layout_width, layout_height),
+            layout_width, layout_height, components.size(), &component)) {
+      component.sub_layout_class_map =
+          &shape_and_sub_layout.second.GetClassMapRoot();
+      components.push_back(component);
+    }
+  }
+  return components;
+}
+
 }  // namespace
 
 ImageLayout::ImageLayout(const int image_width, const int image_height)
@@ -97,11 +410,8 @@ ImageLayout::ImageLayout(const int image_width, const int image_height)
       displayed_sub_layout_(nullptr) {
 
   // All pixels will be mapped to 0 (the default class index) initially.
-  spectral_class_map_.resize(GetNumPixels());
-  std::fill(
-      spectral_class_map_.begin(),
-      spectral_class_map_.end(),
-      kDefaultSpectralClassIndex);
+  spectral_class_map_ =
+      ClassMap(image_width, image_height, kDefaultSpectralClassIndex);
 }
 
 void ImageLayout::AddSubLayout(
@@ -114,12 +424,16 @@ void ImageLayout::AddSubLayout(
     displayed_sub_layout_->AddSubLayout(left_x, top_y, width, height);
   } else {
     const LayoutComponentShape component_shape(left_x, top_y, width, height);
-    const int sub_layout_width =
-        static_cast<int>(width * static_cast<double>(GetWidth()));
-    const int sub_layout_height =
-        static_cast<int>(height * static_cast<double>(GetHeight()));
-    ImageLayout sub_layout(sub_layout_width, sub_layout_height);
+    const PixelRegion region =
+        GetPixelRegion(component_shape, image_width_, image_height_);
+    ImageLayout sub_layout(
+        std::max(region.end_x - region.start_x, 0),
+        std::max(region.end_y - region.start_y, 0));
     sub_layouts_.push_back(std::make_pair(component_shape, sub_layout));
+    ClearSpatialIndex();
+    // The new sub-layout is empty, so it covers its region with the default
+    // class.
+    MarkRowsChanged(region.start_y, region.end_y);
   }
 }
 
@@ -137,6 +451,10 @@ void ImageLayout::AddLayoutPrimitive(
     const LayoutComponentShape component_shape(left_x, top_y, width, height);
     layout_primitives_.push_back(
         std::make_pair(component_shape, spectral_class));
+    ClearSpatialIndex();
+    const PixelRegion region =
+        GetPixelRegion(component_shape, image_width_, image_height_);
+    MarkRowsChanged(region.start_y, region.end_y);
   }
 }
 
@@ -321,10 +639,12 @@ void ImageLayout::ResetLayout() {
   } else {
     sub_layouts_.clear();
     layout_primitives_.clear();
-    std::fill(
-        spectral_class_map_.begin(),
-        spectral_class_map_.end(),
-        kDefaultSpectralClassIndex);
+    ClearSpatialIndex();
+    spectral_class_map_ =
+        ClassMap(image_width_, image_height_, kDefaultSpectralClassIndex);
+    // Every row changed, which must also be re-rendered in the parent layout
+    // if this is a sub-layout.
+    MarkRowsChanged(0, image_height_);
   }
 }
 
@@ -332,18 +652,12 @@ bool ImageLayout::ZoomInToSubLayout(const double x, const double y) {
   if (displayed_sub_layout_ != nullptr) {
     return displayed_sub_layout_->ZoomInToSubLayout(x, y);
   }
-  for (int i = 0; i < sub_layouts_.size(); ++i) {
-    const LayoutComponentShape& component_shape = sub_layouts_[i].first;
-    const double start_x = component_shape.left_x;
-    const double end_x = start_x + component_shape.width;
-    const double start_y = component_shape.top_y;
-    const double end_y = start_y + component_shape.height;
-    if (x >= start_x && x <= end_x && y >= start_y && y <= end_y) {
-      displayed_sub_layout_ = &sub_layouts_[i].second;
-      return true;
-    }
+  const int sub_layout_index = FindSubLayoutAtPoint(x, y);
+  if (sub_layout_index < 0) {
+    return false;
   }
-  return false;
+  displayed_sub_layout_ = &sub_layouts_[sub_layout_index].second;
+  return true;
 }
 
 void ImageLayout::ZoomOutToRoot() {
@@ -355,80 +669,88 @@ void ImageLayout::ZoomOutToRoot() {
 }
 
 void ImageLayout::Render() {
-  if (displayed_sub_layout_ != nullptr) {
-    displayed_sub_layout_->Render();
-  }
-  const int num_pixels = GetNumPixels();
-  spectral_class_map_.resize(num_pixels);
-  std::fill(
-      spectral_class_map_.begin(),
-      spectral_class_map_.end(),
-      kDefaultSpectralClassIndex);
-  for (const auto& shape_and_class : layout_primitives_) {
-    FillLayoutRenderRegion(
-        shape_and_class.first,
-        GetWidth(),
-        GetHeight(),
-        shape_and_class.second,
-        &spectral_class_map_);
-  }
-  for (const auto& shape_and_sub_layout : sub_layouts_) {
-    // TODO: (possibly) fill the region with the rendered sub-layout.
-    FillLayoutRenderRegion(
-        shape_and_sub_layout.first,
-        GetWidth(),
-        GetHeight(),
-        kSubLayoutClassIndex,
-        &spectral_class_map_);
-  }
-}
-
-/*
-// TODO: Temporary for reference, remove when done implementing full render.
-void ImageLayout::FullRender() {
-  const int num_pixels = GetNumPixels();
-  spectral_class_map_.resize(num_pixels);
-  std::fill(
-      spectral_class_map_.begin(),
-      spectral_class_map_.end(),
-      kDefaultSpectralClassIndex);
-  for (const auto& shape_and_class : layout_primitives_) {
-    FillLayoutRenderRegion(
-        shape_and_class.first,
-        GetWidth(),
-        GetHeight(),
-        shape_and_class.second,
-        &spectral_class_map_);
-  }
-  const int layout_width = GetWidth();
-  const int layout_height = GetHeight();
-  for (int i = 0; i < sub_layouts_.size(); ++i) {
-    const LayoutComponentShape& component_shape = sub_layouts_[i].first;
-    const int start_x = static_cast<int>(
-        component_shape.left_x * static_cast<double>(layout_width));
-    const int end_x = start_x + static_cast<int>(
-        component_shape.width * static_cast<double>(layout_height));
-    const int start_y = static_cast<int>(
-        component_shape.top_y * static_cast<double>(layout_height));
-    const int end_y = start_y + static_cast<int>(
-        component_shape.height * static_cast<double>(layout_height));
-    const int start_x_index = std::max(start_x, 0);
-    const int end_x_index = std::min(end_x, layout_width - 1);
-    const int start_y_index = std::max(start_y, 0);
-    const int end_y_index = std::min(end_y, layout_height - 1);
-
-    sub_layouts_[i].second.FullRender();
-    for (int x = start_x_index; x < end_x_index; ++x) {
-      for (int y = start_y_index; y < end_y_index; ++y) {
-        spectral_class_map_[GetMapIndex(x, y)] =
-            sub_layouts_[i].second.GetClassAtPixel(x - start_x_index, y - start_y_index);
+  // Size every layout in the hierarchy to its pixel region in its parent, and
+  // group the layouts by their depth in the hierarchy.
+  std::vector<std::vector<ImageLayout*>> layouts_by_depth;
+  layouts_by_depth.push_back({this});
+  while (true) {
+    std::vector<ImageLayout*> next_layouts;
+    for (ImageLayout* layout : layouts_by_depth.back()) {
+      for (auto& shape_and_sub_layout : layout->sub_layouts_) {
+        const PixelRegion region = GetPixelRegion(
+            shape_and_sub_layout.first,
+            layout->image_width_,
+            layout->image_height_);
+        ImageLayout* sub_layout = &shape_and_sub_layout.second;
+        sub_layout->image_width_ = std::max(region.end_x - region.start_x, 0);
+        sub_layout->image_height_ =
+            std::max(region.end_y - region.start_y, 0);
+        next_layouts.push_back(sub_layout);
       }
     }
+    if (next_layouts.empty()) {
+      break;
+    }
+    layouts_by_depth.push_back(next_layouts);
+  }
+
+  // Render the deepest layouts first, so that every sub-layout is complete
+  // before it is drawn into its parent. The layouts at the same depth are
+  // independent, so all of their row blocks are rendered in parallel, and
+  // then joined into each layout's class map.
+  for (int depth = layouts_by_depth.size() - 1; depth >= 0; --depth) {
+    const std::vector<ImageLayout*>& layouts = layouts_by_depth[depth];
+    const int num_layouts = layouts.size();
+    std::vector<std::vector<RowComponent>> layout_components(num_layouts);
+    std::vector<std::pair<int, int>> row_blocks;
+    for (int i = 0; i < num_layouts; ++i) {
+      const ImageLayout& layout = *layouts[i];
+      const int layout_height = layout.image_height_;
+      layout_components[i] = GetLayoutRowComponents(
+          layout.layout_primitives_,
+          layout.sub_layouts_,
+          layout.image_width_,
+          layout_height);
+      for (int first_row = 0; first_row < layout_height;
+           first_row += kRenderRowBlockSize) {
+        row_blocks.push_back(std::make_pair(i, first_row));
+      }
+    }
+    const int num_row_blocks = row_blocks.size();
+    std::vector<ClassMap> row_block_class_maps(num_row_blocks);
+    util::ParallelFor(
+        num_row_blocks,
+        0,
+        [&](const int task_index, const int thread_index) {
+          const int layout_index = row_blocks[task_index].first;
+          const int first_row = row_blocks[task_index].second;
+          const ImageLayout& layout = *layouts[layout_index];
+          RenderClassMapRows(
+              layout_components[layout_index],
+              layout.image_width_,
+              first_row,
+              std::min(first_row + kRenderRowBlockSize, layout.image_height_),
+              &row_block_class_maps[task_index]);
+          return true;
+        });
+    for (ImageLayout* layout : layouts) {
+      layout->spectral_class_map_.Reset(layout->image_width_);
+      layout->changed_first_row_ = 0;
+      layout->changed_end_row_ = 0;
+    }
+    for (int i = 0; i < num_row_blocks; ++i) {
+      layouts[row_blocks[i].first]->spectral_class_map_.AppendRows(
+          row_block_class_maps[i]);
+    }
   }
-}*/
+}
+
+void ImageLayout::RenderChanges() {
+  int first_row, end_row;
+  RenderChangedRows(&first_row, &end_row);
+}
 
 void ImageLayout::SetImageSize(const int width, const int height) {
-  // TODO: Set size of all sub-layouts as well?
   // TODO: Check width and height validity.
   image_width_ = width;
   image_height_ = height;
@@ -449,7 +771,15 @@ int ImageLayout::GetHeight() const {
   return image_height_;
 }
 
-const std::vector<int>& ImageLayout::GetClassMap() const {
+int ImageLayout::GetWidthRoot() const {
+  return image_width_;
+}
+
+int ImageLayout::GetHeightRoot() const {
+  return image_height_;
+}
+
+const ClassMap& ImageLayout::GetClassMap() const {
   if (displayed_sub_layout_ != nullptr) {
     return displayed_sub_layout_->GetClassMap();
   } else {
@@ -457,7 +787,7 @@ const std::vector<int>& ImageLayout::GetClassMap() const {
   }
 }
 
-const std::vector<int>& ImageLayout::GetClassMapRoot() const {
+const ClassMap& ImageLayout::GetClassMapRoot() const {
   return spectral_class_map_;
 }
 
@@ -470,9 +800,8 @@ int ImageLayout::GetClassAtPixel(const int x_col, const int y_row) const {
 }
 
 int ImageLayout::GetClassAtPixelRoot(const int x_col, const int y_row) const {
-  const int map_index = GetMapIndexRoot(x_col, y_row);
   // TODO: Some range checking?
-  return spectral_class_map_[map_index];
+  return spectral_class_map_.GetClass(x_col, y_row);
 }
 
 int ImageLayout::GetMapIndex(const int x_col, const int y_row) const {
@@ -484,7 +813,276 @@ int ImageLayout::GetMapIndex(const int x_col, const int y_row) const {
 }
 
 int ImageLayout::GetMapIndexRoot(const int x_col, const int y_row) const {
-  return GetIndexFromXY(x_col, y_row, GetWidth());
+  return GetIndexFromXY(x_col, y_row, image_width_);
+}
+
+void ImageLayout::BuildSpatialIndex() {
+  for (auto& shape_and_sub_layout : sub_layouts_) {
+    shape_and_sub_layout.second.BuildSpatialIndex();
+  }
+
+  const int num_components = GetNumComponents();
+  const int grid_size = std::max(1, std::min(
+      static_cast<int>(std::ceil(std::sqrt(num_components))),
+      kMaxSpatialIndexGridSize));
+  // Each component is listed in every cell that it overlaps. The cells are
+  // counted first, and then filled in paint order.
+  std::vector<int> cell_starts(grid_size * grid_size + 1, 0);
+  std::vector<int> cell_components;
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<int> cell_ends(cell_starts.begin(), cell_starts.end() - 1);
+    for (int component = 0; component < num_components; ++component) {
+      const LayoutComponentShape& shape = GetComponentShape(component);
+      if (shape.width <= 0.0 || shape.height <= 0.0) {
+        continue;
+      }
+      int first_col, last_col, first_row, last_row;
+      GetSpatialIndexCellRange(
+          shape.left_x, shape.left_x + shape.width, grid_size,
+          &first_col, &last_col);
+      GetSpatialIndexCellRange(
+          shape.top_y, shape.top_y + shape.height, grid_size,
+          &first_row, &last_row);
+      for (int row = first_row; row <= last_row; ++row) {
+        for (int col = first_col; col <= last_col; ++col) {
+          const int cell = row * grid_size + col;
+          if (pass == 0) {
+            ++cell_starts[cell + 1];
+          } else {
+            cell_components[cell_ends[cell]++] = component;
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (int cell = 0; cell < grid_size * grid_size; ++cell) {
+        cell_starts[cell + 1] += cell_starts[cell];
+      }
+      cell_components.resize(cell_starts.back());
+    }
+  }
+  spatial_index_.grid_size = grid_size;
+  spatial_index_.cell_starts = std::move(cell_starts);
+  spatial_index_.cell_components = std::move(cell_components);
+}
+
+int ImageLayout::ComputeClassAtPixelRoot(
+    const int x_col,
+    const int y_row,
+    const int layout_width,
+    const int layout_height) const {
+
+  // Descend into the covering sub-layouts, each at the size of its pixels in
+  // its parent (the same way that Render() sizes them), until a primitive or
+  // an uncovered pixel is found.
+  const ImageLayout* layout = this;
+  int x = x_col;
+  int y = y_row;
+  int width = layout_width;
+  int height = layout_height;
+  while (true) {
+    const int component = layout->FindComponentAtPixel(x, y, width, height);
+    if (component < 0) {
+      return kDefaultSpectralClassIndex;
+    }
+    const int num_primitives = layout->layout_primitives_.size();
+    if (component < num_primitives) {
+      return layout->layout_primitives_[component].second;
+    }
+    const PixelRegion region = GetPixelRegion(
+        layout->GetComponentShape(component), width, height);
+    x -= region.start_x;
+    y -= region.start_y;
+    width = region.end_x - region.start_x;
+    height = region.end_y - region.start_y;
+    layout = &layout->sub_layouts_[component - num_primitives].second;
+  }
+}
+
+const LayoutComponentShape& ImageLayout::GetComponentShape(
+    const int component) const {
+
+  const int num_primitives = layout_primitives_.size();
+  if (component < num_primitives) {
+    return layout_primitives_[component].first;
+  }
+  return sub_layouts_[component - num_primitives].first;
+}
+
+void ImageLayout::ClearSpatialIndex() {
+  spatial_index_ = SpatialIndex();
+}
+
+int ImageLayout::FindComponentAtPixel(
+    const int x_col,
+    const int y_row,
+    const int layout_width,
+    const int layout_height) const {
+
+  // Components can extend past the edges of the layout, but the pixels outside
+  // of it are never rendered (and are not in any cell of the index).
+  if (x_col < 0 || x_col >= layout_width ||
+      y_row < 0 || y_row >= layout_height) {
+    return -1;
+  }
+
+  const auto covers_pixel = [&](const int component) {
+    const PixelRegion region = GetPixelRegion(
+        GetComponentShape(component), layout_width, layout_height);
+    return x_col >= region.start_x && x_col < region.end_x &&
+           y_row >= region.start_y && y_row < region.end_y;
+  };
+
+  const int grid_size = spatial_index_.grid_size;
+  if (grid_size == 0) {
+    for (int component = GetNumComponents() - 1; component >= 0;
+         --component) {
+      if (covers_pixel(component)) {
+        return component;
+      }
+    }
+    return -1;
+  }
+
+  // A component's pixels are always within its relative shape, so only the
+  // cells that the pixel overlaps need to be checked. Within each cell, the
+  // components are checked from the top down, and only until they are below
+  // the top-most covering component found so far.
+  const int64_t first_col =
+      static_cast<int64_t>(x_col) * grid_size / layout_width;
+  const int64_t last_col =
+      (static_cast<int64_t>(x_col + 1) * grid_size - 1) / layout_width;
+  const int64_t first_row =
+      static_cast<int64_t>(y_row) * grid_size / layout_height;
+  const int64_t last_row =
+      (static_cast<int64_t>(y_row + 1) * grid_size - 1) / layout_height;
+  int top_component = -1;
+  for (int64_t row = first_row; row <= last_row; ++row) {
+    for (int64_t col = first_col; col <= last_col; ++col) {
+      const int cell = row * grid_size + col;
+      for (int i = spatial_index_.cell_starts[cell + 1] - 1;
+           i >= spatial_index_.cell_starts[cell] &&
+               spatial_index_.cell_components[i] > top_component;
+           --i) {
+        if (covers_pixel(spatial_index_.cell_components[i])) {
+          top_component = spatial_index_.cell_components[i];
+          break;
+        }
+      }
+    }
+  }
+  return top_component;
+}
+
+void ImageLayout::MarkRowsChanged(const int first_row, const int end_row) {
+  const int clipped_first_row = std::max(first_row, 0);
+  const int clipped_end_row = std::min(end_row, image_height_);
+  if (clipped_first_row >= clipped_end_row) {
+    return;
+  }
+  if (changed_first_row_ >= changed_end_row_) {
+    changed_first_row_ = clipped_first_row;
+    changed_end_row_ = clipped_end_row;
+  } else {
+    changed_first_row_ = std::min(changed_first_row_, clipped_first_row);
+    changed_end_row_ = std::max(changed_end_row_, clipped_end_row);
+  }
+}
+
+bool ImageLayout::RenderChangedRows(int* first_row, int* end_row) {
+  // A class map that does not match the layout's size was not rendered at
+  // this size, so all of it is out of date.
+  if (spectral_class_map_.GetWidth() != image_width_ ||
+      spectral_class_map_.GetHeight() != image_height_) {
+    spectral_class_map_ =
+        ClassMap(image_width_, image_height_, kDefaultSpectralClassIndex);
+    MarkRowsChanged(0, image_height_);
+  }
+
+  // Sub-layouts are drawn into this layout, so their changed rows are changed
+  // rows of this layout too.
+  for (auto& shape_and_sub_layout : sub_layouts_) {
+    int sub_layout_first_row, sub_layout_end_row;
+    if (shape_and_sub_layout.second.RenderChangedRows(
+            &sub_layout_first_row, &sub_layout_end_row)) {
+      const PixelRegion region = GetPixelRegion(
+          shape_and_sub_layout.first, image_width_, image_height_);
+      MarkRowsChanged(
+          region.start_y + sub_layout_first_row,
+          region.start_y + sub_layout_end_row);
+    }
+  }
+  if (changed_first_row_ >= changed_end_row_) {
+    return false;
+  }
+  *first_row = changed_first_row_;
+  *end_row = changed_end_row_;
+  changed_first_row_ = 0;
+  changed_end_row_ = 0;
+
+  // Only the components that cover the changed rows are drawn (see
+  // RenderClassMapRows()). Large changes are split into blocks of rows that
+  // are rendered in parallel.
+  const std::vector<RowComponent> components = GetLayoutRowComponents(
+      layout_primitives_, sub_layouts_, image_width_, image_height_);
+  const int num_row_blocks =
+      (*end_row - *first_row + kRenderRowBlockSize - 1) / kRenderRowBlockSize;
+  std::vector<ClassMap> row_block_class_maps(num_row_blocks);
+  util::ParallelFor(
+      num_row_blocks,
+      0,
+      [&](const int task_index, const int thread_index) {
+        const int block_first_row =
+            *first_row + task_index * kRenderRowBlockSize;
+        RenderClassMapRows(
+            components,
+            image_width_,
+            block_first_row,
+            std::min(block_first_row + kRenderRowBlockSize, *end_row),
+            &row_block_class_maps[task_index]);
+        return true;
+      });
+  ClassMap changed_rows;
+  changed_rows.Reset(image_width_);
+  for (const ClassMap& row_block_class_map : row_block_class_maps) {
+    changed_rows.AppendRows(row_block_class_map);
+  }
+  spectral_class_map_.ReplaceRows(*first_row, changed_rows);
+  return true;
+}
+
+int ImageLayout::FindSubLayoutAtPoint(const double x, const double y) const {
+  const auto contains_point = [x, y](const LayoutComponentShape& shape) {
+    return x >= shape.left_x && x <= shape.left_x + shape.width &&
+           y >= shape.top_y && y <= shape.top_y + shape.height;
+  };
+
+  const int grid_size = spatial_index_.grid_size;
+  if (grid_size == 0) {
+    for (int i = sub_layouts_.size() - 1; i >= 0; --i) {
+      if (contains_point(sub_layouts_[i].first)) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  // Every sub-layout that contains the point is listed in the point's cell.
+  // Points outside of the layout belong to the nearest edge cell, the same
+  // way that components outside of it are clamped to the edge cells.
+  const int num_primitives = layout_primitives_.size();
+  const int cell =
+      GetSpatialIndexCell(y, grid_size) * grid_size +
+      GetSpatialIndexCell(x, grid_size);
+  for (int i = spatial_index_.cell_starts[cell + 1] - 1;
+       i >= spatial_index_.cell_starts[cell] &&
+           spatial_index_.cell_components[i] >= num_primitives;
+       --i) {
+    const int component = spatial_index_.cell_components[i];
+    if (contains_point(GetComponentShape(component))) {
+      return component - num_primitives;
+    }
+  }
+  return -1;
 }
 
 }  // namespace hsi_data_generator
@@ -16,6 +16,8 @@
 #include <utility>
 #include <vector>
 
+#include "hsi/class_map.h"
+
 namespace hsi_data_generator {
 
 // A simple struct that keeps track of a rectangle's shape. This is used to
@@ -107,7 +109,8 @@ class ImageLayout {
   // only be used for editing and visualization.
   //
   // If the given coordinates do not intersect a sub-layout, nothing will
-  // happen and this method will return false.
+  // happen and this method will return false. If several sub-layouts overlap
+  // at the coordinates, the top-most one (the last one added) is zoomed in to.
   bool ZoomInToSubLayout(const double x, const double y);
 
   // Resets the displayed interactive layout to the top-level. That means if it
@@ -119,19 +122,31 @@ class ImageLayout {
   // to the appropriate spectral class value. This will generate assignments
   // for the spectral class map (see GetClassMap() and GetClassAtPixel()).
   //
-  // This will render the root layout in the sub-layout heirarchy at its set
-  // resolution, and all sub-layouts will be recursively rendered.
-  //
-  // TODO: Fix comments.
-  //The
-  // resulting spectral class mapping will be a complete representation of the
-  // final HSI.
+  // The whole sub-layout heirarchy is rendered, regardless of the zoom level:
+  // each sub-layout is rendered at the size of the pixels it covers in its
+  // parent layout, and then drawn into the parent's class map. The resulting
+  // spectral class mapping is a complete representation of the final HSI, and
+  // a zoomed-in sub-layout's class map is its part of it.
   //
-  // Otherwise, if a sub-layout is zoomed in, that will be rendered instead.
-  // Any sub-layouts below the rendered layout will be represented with a
-  // special non-index value.
+  // Primitives are drawn in the order they were added, and sub-layouts are
+  // drawn on top of them in the order they were added. Sub-layouts at the same
+  // depth of the heirarchy (and blocks of rows of large layouts) are rendered
+  // in parallel. The class maps are rendered directly as runs (see ClassMap),
+  // so only rows where the components change are rendered at all.
   void Render();
 
+  // Same as Render(), but only re-renders the rows that changed since the last
+  // render: the rows covered by components added since then, at every depth of
+  // the sub-layout heirarchy. Only the components that cover those rows are
+  // drawn, so no pixels outside of them are rendered. The edit still costs
+  // time in proportion to the rest of the layout, though much less than a full
+  // render: every component of each changed layout is checked to find the
+  // ones that cover the changed rows, and the changed rows are spliced into
+  // its class map by copying all of the map's row entries and runs (see
+  // ClassMap::ReplaceRows()). Resetting the layout or changing the image size
+  // re-renders it in full.
+  void RenderChanges();
+
   // Updates the image size. This causes the layout to be recomputed for the
   // new image dimensions.
   void SetImageSize(const int width, const int height);
@@ -142,17 +157,21 @@ class ImageLayout {
   // Returns the height in pixels (number of rows) in the image.
   int GetHeight() const;
 
+  // Same as GetWidth() and GetHeight(), but ignore zoom level.
+  int GetWidthRoot() const;
+  int GetHeightRoot() const;
+
   // Returns the total number of pixels in this image layout.
   int GetNumPixels() const {
     return GetWidth() * GetHeight();
   }
 
   // Used for referencing the layout externally.
-  const std::vector<int>& GetClassMap() const;
+  const ClassMap& GetClassMap() const;
 
   // Returns the class map at the root level of the sub-layout heirarchy,
   // regardless of current zoom-in level.
-  const std::vector<int>& GetClassMapRoot() const;
+  const ClassMap& GetClassMapRoot() const;
 
   // Returns the value at the given index.
   int GetClassAtPixel(const int x_col, const int y_row) const;
@@ -160,14 +179,77 @@ class ImageLayout {
   // Same as GetClassAtPixel(), but ignores zoom level.
   int GetClassAtPixelRoot(const int x_col, const int y_row) const;
 
-  // Returns the 1D index (into the vector returned by GetClassMap() from a
-  // given (X = col, Y = row) 2D image coordinate.
+  // Returns the 1D (row-major) index of a given (X = col, Y = row) 2D image
+  // coordinate.
   int GetMapIndex(const int x_col, const int y_row) const;
 
   // Same as GetMapIndex(), but ignores zoom level.
   int GetMapIndexRoot(const int x_col, const int y_row) const;
 
+  // Builds a spatial index over the primitives and sub-layouts of this layout
+  // and of every sub-layout in the heirarchy, ignoring zoom level. The index
+  // is a uniform grid in relative coordinates, so it does not depend on the
+  // image size. Editing a layout discards that layout's index (but not the
+  // indices of the others in the heirarchy), and it must be built again.
+  void BuildSpatialIndex();
+
+  // Returns the class of the given pixel as if the layout was rendered at the
+  // given size, ignoring zoom level. This only looks at the components that
+  // cover the pixel (at every depth of the sub-layout heirarchy), so it does
+  // not need the layout to be rendered, and works at sizes far too large to
+  // render. Without a spatial index (see BuildSpatialIndex()), every component
+  // of each layout is checked instead.
+  int ComputeClassAtPixelRoot(
+      const int x_col,
+      const int y_row,
+      const int layout_width,
+      const int layout_height) const;
+
  private:
+  // A uniform grid of cells that each list the components (see
+  // GetComponentShape()) that overlap the cell, in paint order. The cell at
+  // (col, row) lists the components from cell_starts[row * grid_size + col]
+  // (inclusive) to the next cell's start (exclusive). A grid size of 0 means
+  // that the index is not built.
+  struct SpatialIndex {
+    int grid_size = 0;
+    std::vector<int> cell_starts;
+    std::vector<int> cell_components;
+  };
+
+  // Components are numbered in paint order: the primitives in the order they
+  // were added, followed by the sub-layouts in the order they were added.
+  int GetNumComponents() const {
+    return layout_primitives_.size() + sub_layouts_.size();
+  }
+  const LayoutComponentShape& GetComponentShape(const int component) const;
+
+  // Discards the spatial index of this layout. Called whenever its
+  // components change.
+  void ClearSpatialIndex();
+
+  // Returns the top-most component that covers the given pixel when the
+  // layout is rendered at the given size, or -1 if no component covers it
+  // (which includes every pixel outside of the layout).
+  int FindComponentAtPixel(
+      const int x_col,
+      const int y_row,
+      const int layout_width,
+      const int layout_height) const;
+
+  // Adds the given rows (in this layout's pixels) to the rows that need to be
+  // re-rendered by RenderChanges().
+  void MarkRowsChanged(const int first_row, const int end_row);
+
+  // Re-renders the changed rows of every sub-layout and then of this layout
+  // (see RenderChanges()). Returns false if nothing changed, or sets the rows
+  // of this layout that were re-rendered.
+  bool RenderChangedRows(int* first_row, int* end_row);
+
+  // Returns the index (into sub_layouts_) of the top-most sub-layout that
+  // contains the given relative coordinates, or -1 if there is none.
+  int FindSubLayoutAtPoint(const double x, const double y) const;
+
   // The spatial dimensions (pixels) of the hyperspectral image when it is
   // rendered.
   int image_width_;
@@ -184,7 +266,16 @@ class ImageLayout {
   // This map identifies each pixel in the image as one of the spectral
   // classes. The class indices start at 0 to indicate the first spectrum
   // class.
-  std::vector<int> spectral_class_map_;
+  ClassMap spectral_class_map_;
+
+  // The rows of spectral_class_map_ that are out of date, from
+  // changed_first_row_ (inclusive) to changed_end_row_ (exclusive). There are
+  // none if the range is empty.
+  int changed_first_row_ = 0;
+  int changed_end_row_ = 0;
+
+  // The optional index over layout_primitives_ and sub_layouts_.
+  SpatialIndex spatial_index_;
 
   // If a sub-layout is zoomed-in on, a pointer to it will be stored here. If
   // this pointer is not null, all operations and renderring will defer to this
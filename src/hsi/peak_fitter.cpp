@@ -0,0 +1,423 @@
+#include "hsi/peak_fitter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "hsi/spectrum.h"
+#include "util/parallel_for.h"
+
+namespace hsi_data_generator {
+namespace {
+
+// Each peak has three fitted parameters: its position, and the logarithms of
+// its amplitude and standard deviation (which keeps both of them positive).
+constexpr int kNumPeakParameters = 3;
+constexpr int kPositionParameter = 0;
+constexpr int kLogAmplitudeParameter = 1;
+constexpr int kLogSigmaParameter = 2;
+
+// Peaks are evaluated within this many standard deviations of their center
+// while fitting. The truncated tails are below 1e-7 of the peak's amplitude.
+constexpr double kNumFitSigmas = 6.0;
+
+// The narrowest fitted peak's standard deviation, in bands. Narrower peaks
+// cannot be resolved at the fitting resolution.
+constexpr double kMinSigmaInBands = 0.5;
+
+// The lower bound of the fitted amplitudes' logarithm. Peaks this small have
+// no visible effect.
+constexpr double kMinLogAmplitude = -30.0;
+
+// Levenberg-Marquardt damping: the initial value, the factor it is scaled by
+// after each step, and the value at which the refinement gives up.
+constexpr double kInitialDamping = 1e-3;
+constexpr double kDampingFactor = 10.0;
+constexpr double kMaxDamping = 1e10;
+
+// The refinement stops when a step reduces the squared error by less than this
+// fraction.
+constexpr double kMinRelativeImprovement = 1e-4;
+
+// The number of spectra fitted by each parallel task.
+constexpr int kNumSpectraPerTask = 4;
+
+// Converts a full width at half maximum into the standard deviation of a
+// Gaussian.
+const double kFWHMToSigma = 1.0 / (2.0 * std::sqrt(2.0 * std::log(2.0)));
+
+// Clamps the peak parameters to the ranges accepted by Spectrum::AddPeak().
+void ClampPeakParameters(
+    const double min_log_sigma, std::vector<double>* parameters) {
+
+  const int num_parameters = parameters->size();
+  for (int i = 0; i < num_parameters; i += kNumPeakParameters) {
+    double* peak = parameters->data() + i;
+    peak[kPositionParameter] =
+        std::min(std::max(peak[kPositionParameter], 0.0), 1.0);
+    peak[kLogAmplitudeParameter] =
+        std::min(std::max(peak[kLogAmplitudeParameter], kMinLogAmplitude), 0.0);
+    peak[kLogSigmaParameter] =
+        std::min(std::max(peak[kLogSigmaParameter], min_log_sigma), 0.0);
+  }
+}
+
+// Returns the range of bands [first_band, end_band) that a peak is evaluated
+// over. The range is empty if the peak is outside of the spectrum.
+void GetFitSupport(
+    const double* peak,
+    const int num_bands,
+    int* first_band,
+    int* end_band) {
+
+  const double radius =
+      kNumFitSigmas * std::exp(peak[kLogSigmaParameter]) * num_bands;
+  const double center = peak[kPositionParameter] * num_bands;
+  *first_band = std::max(static_cast<int>(std::ceil(center - radius)), 0);
+  *end_band = std::min(
+      static_cast<int>(std::floor(center + radius)) + 1, num_bands);
+  *end_band = std::max(*end_band, *first_band);
+}
+
+// Sets the model to the sum of the peaks, and returns its squared error to
+// the values.
+double EvaluatePeaks(
+    const std::vector<double>& parameters,
+    const std::vector<double>& values,
+    std::vector<double>* model) {
+
+  const int num_bands = values.size();
+  model->assign(num_bands, 0.0);
+  const int num_parameters = parameters.size();
+  for (int i = 0; i < num_parameters; i += kNumPeakParameters) {
+    const double* peak = parameters.data() + i;
+    int first_band = 0;
+    int end_band = 0;
+    GetFitSupport(peak, num_bands, &first_band, &end_band);
+    const double amplitude = std::exp(peak[kLogAmplitudeParameter]);
+    const double sigma = std::exp(peak[kLogSigmaParameter]);
+    const double inverse_two_variance = 0.5 / (sigma * sigma);
+    for (int band = first_band; band < end_band; ++band) {
+      const double offset =
+          static_cast<double>(band) / num_bands - peak[kPositionParameter];
+      (*model)[band] +=
+          amplitude * std::exp(-offset * offset * inverse_two_variance);
+    }
+  }
+  double squared_error = 0.0;
+  for (int band = 0; band < num_bands; ++band) {
+    const double residual = values[band] - (*model)[band];
+    squared_error += residual * residual;
+  }
+  return squared_error;
+}
+
+// Solves the symmetric positive definite system A x = b in place with a
+// Cholesky decomposition. The matrix is stored row-major and is overwritten.
+// Returns false if the matrix is not positive definite.
+bool SolveCholesky(
+    const int size, std::vector<double>* matrix, std::vector<double>* b) {
+  std::vector<double>& a = *matrix;
+  for (int j = 0; j < size; ++j) {
+    double diagonal = a[j * size + j];
+    for (int k = 0; k < j; ++k) {
+      diagonal -= a[j * size + k] * a[j * size + k];
+    }
+    if (!(diagonal > 0.0)) {
+      return false;
+    }
+    const double l_jj = std::sqrt(diagonal);
+    a[j * size + j] = l_jj;
+    for (int i = j + 1; i < size; ++i) {
+      double value = a[i * size + j];
+      for (int k = 0; k < j; ++k) {
+        value -= a[i * size + k] * a[j * size + k];
+      }
+      a[i * size + j] = value / l_jj;
+    }
+  }
+  // Forward substitution (L y = b), then back substitution (L^T x = y).
+  for (int i = 0; i < size; ++i) {
+    double value = (*b)[i];
+    for (int k = 0; k < i; ++k) {
+      value -= a[i * size + k] * (*b)[k];
+    }
+    (*b)[i] = value / a[i * size + i];
+  }
+  for (int i = size - 1; i >= 0; --i) {
+    double value = (*b)[i];
+    for (int k = i + 1; k < size; ++k) {
+      value -= a[k * size + i] * (*b)[k];
+    }
+    (*b)[i] = value / a[i * size + i];
+  }
+  return true;
+}
+
+// Refines all of the peak parameters together with Levenberg-Marquardt least
+// squares, for at most the given number of iterations. Each peak only affects
+// the bands within its support, so the Jacobian is stored per peak and only
+// overlapping peaks are multiplied.
+void RefinePeaks(
+    const std::vector<double>& values,
+    const int max_num_iterations,
+    const double min_log_sigma,
+    std::vector<double>* parameters) {
+
+  const int num_bands = values.size();
+  const int num_peaks = parameters->size() / kNumPeakParameters;
+  const int num_parameters = parameters->size();
+  std::vector<double> model;
+  double squared_error = EvaluatePeaks(*parameters, values, &model);
+  double damping = kInitialDamping;
+
+  std::vector<int> first_bands(num_peaks);
+  std::vector<int> end_bands(num_peaks);
+  std::vector<std::vector<double>> jacobians(num_peaks);
+  std::vector<double> normal_matrix;
+  std::vector<double> gradient;
+  std::vector<double> damped_matrix;
+  std::vector<double> step;
+  std::vector<double> trial_parameters;
+  std::vector<double> trial_model;
+  for (int iteration = 0; iteration < max_num_iterations; ++iteration) {
+    // The derivatives of each peak's values over its support, interleaved by
+    // parameter.
+    for (int peak_index = 0; peak_index < num_peaks; ++peak_index) {
+      const double* peak =
+          parameters->data() + peak_index * kNumPeakParameters;
+      GetFitSupport(
+          peak, num_bands, &first_bands[peak_index], &end_bands[peak_index]);
+      const double amplitude = std::exp(peak[kLogAmplitudeParameter]);
+      const double inverse_variance =
+          std::exp(-2.0 * peak[kLogSigmaParameter]);
+      std::vector<double>& jacobian = jacobians[peak_index];
+      jacobian.resize(
+          (end_bands[peak_index] - first_bands[peak_index]) *
+          kNumPeakParameters);
+      double* derivatives = jacobian.data();
+      for (int band = first_bands[peak_index]; band < end_bands[peak_index];
+           ++band) {
+        const double offset =
+            static_cast<double>(band) / num_bands - peak[kPositionParameter];
+        const double scaled_offset = offset * offset * inverse_variance;
+        const double value = amplitude * std::exp(-0.5 * scaled_offset);
+        derivatives[kPositionParameter] = value * offset * inverse_variance;
+        derivatives[kLogAmplitudeParameter] = value;
+        derivatives[kLogSigmaParameter] = value * scaled_offset;
+        derivatives += kNumPeakParameters;
+      }
+    }
+
+    // The normal equations J^T J and J^T r, over the overlapping bands of
+    // each pair of peaks.
+    normal_matrix.assign(num_parameters * num_parameters, 0.0);
+    gradient.assign(num_parameters, 0.0);
+    for (int j = 0; j < num_peaks; ++j) {
+      const double* derivatives_j = jacobians[j].data();
+      for (int band = first_bands[j]; band < end_bands[j]; ++band) {
+        const double residual = values[band] - model[band];
+        const double* d = derivatives_j +
+            (band - first_bands[j]) * kNumPeakParameters;
+        for (int p = 0; p < kNumPeakParameters; ++p) {
+          gradient[j * kNumPeakParameters + p] += d[p] * residual;
+        }
+      }
+      for (int k = j; k < num_peaks; ++k) {
+        const int first_band = std::max(first_bands[j], first_bands[k]);
+        const int end_band = std::min(end_bands[j], end_bands[k]);
+        if (first_band >= end_band) {
+          continue;
+        }
+        const double* derivatives_k = jacobians[k].data();
+        double block[kNumPeakParameters][kNumPeakParameters] = {};
+        for (int band = first_band; band < end_band; ++band) {
+          const double* d_j = derivatives_j +
+              (band - first_bands[j]) * kNumPeakParameters;
+          const double* d_k = derivatives_k +
+              (band - first_bands[k]) * kNumPeakParameters;
+          for (int p = 0; p < kNumPeakParameters; ++p) {
+            for (int q = 0; q < kNumPeakParameters; ++q) {
+              block[p][q] += d_j[p] * d_k[q];
+            }
+          }
+        }
+        for (int p = 0; p < kNumPeakParameters; ++p) {
+          for (int q = 0; q < kNumPeakParameters; ++q) {
+            const int row = j * kNumPeakParameters + p;
+            const int column = k * kNumPeakParameters + q;
+            normal_matrix[row * num_parameters + column] = block[p][q];
+            normal_matrix[column * num_parameters + row] = block[p][q];
+          }
+        }
+      }
+    }
+
+    // Try damped steps until one reduces the error.
+    bool improved = false;
+    while (!improved && damping <= kMaxDamping) {
+      damped_matrix = normal_matrix;
+      for (int i = 0; i < num_parameters; ++i) {
+        // The small constant keeps parameters without any effect (e.g. peaks
+        // outside of the spectrum) from making the system singular.
+        damped_matrix[i * num_parameters + i] +=
+            damping * normal_matrix[i * num_parameters + i] + 1e-12;
+      }
+      step = gradient;
+      if (!SolveCholesky(num_parameters, &damped_matrix, &step)) {
+        damping *= kDampingFactor;
+        continue;
+      }
+      trial_parameters = *parameters;
+      for (int i = 0; i < num_parameters; ++i) {
+        trial_parameters[i] += step[i];
+      }
+      ClampPeakParameters(min_log_sigma, &trial_parameters);
+      const double trial_squared_error =
+          EvaluatePeaks(trial_parameters, values, &trial_model);
+      if (trial_squared_error < squared_error) {
+        improved = true;
+        const double improvement =
+            (squared_error - trial_squared_error) / squared_error;
+        parameters->swap(trial_parameters);
+        model.swap(trial_model);
+        squared_error = trial_squared_error;
+        damping /= kDampingFactor;
+        if (improvement < kMinRelativeImprovement) {
+          return;
+        }
+      } else {
+        damping *= kDampingFactor;
+      }
+    }
+    if (!improved) {
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<PeakDistribution> PeakFitter::FitPeaks(
+    const std::vector<double>& values) const {
+
+  const int num_bands = values.size();
+  std::vector<PeakDistribution> peaks;
+  if (num_bands == 0) {
+    return peaks;
+  }
+  const double min_log_sigma =
+      std::log(std::min(kMinSigmaInBands / num_bands, 1.0));
+  const double target_squared_error =
+      target_rms_error_ * target_rms_error_ * num_bands;
+
+  std::vector<double> parameters;
+  std::vector<double> model;
+  double squared_error = EvaluatePeaks(parameters, values, &model);
+  for (int num_peaks = 0;
+       num_peaks < max_num_peaks_ && squared_error > target_squared_error;
+       ++num_peaks) {
+    // Seed the next peak at the largest residual, with the width of the
+    // residual around it at half of its height.
+    int max_band = 0;
+    for (int band = 1; band < num_bands; ++band) {
+      if (values[band] - model[band] > values[max_band] - model[max_band]) {
+        max_band = band;
+      }
+    }
+    const double max_residual = values[max_band] - model[max_band];
+    if (max_residual <= 0.0) {
+      break;
+    }
+    const double half_max_residual = 0.5 * max_residual;
+    int left_band = max_band;
+    while (left_band > 0 &&
+           values[left_band - 1] - model[left_band - 1] > half_max_residual) {
+      --left_band;
+    }
+    int right_band = max_band;
+    while (right_band < num_bands - 1 &&
+           values[right_band + 1] - model[right_band + 1] >
+               half_max_residual) {
+      ++right_band;
+    }
+    const double fwhm =
+        static_cast<double>(right_band - left_band + 1) / num_bands;
+    const std::vector<double> previous_parameters = parameters;
+    parameters.push_back(static_cast<double>(max_band) / num_bands);
+    parameters.push_back(std::log(max_residual));
+    parameters.push_back(std::log(fwhm * kFWHMToSigma));
+    ClampPeakParameters(min_log_sigma, &parameters);
+
+    RefinePeaks(values, max_num_iterations_, min_log_sigma, &parameters);
+    const double new_squared_error = EvaluatePeaks(parameters, values, &model);
+    if (new_squared_error >= squared_error) {
+      // The new peak does not help, so neither will any others.
+      parameters = previous_parameters;
+      break;
+    }
+    squared_error = new_squared_error;
+  }
+
+  const int num_parameters = parameters.size();
+  for (int i = 0; i < num_parameters; i += kNumPeakParameters) {
+    PeakDistribution peak;
+    peak.position = parameters[i + kPositionParameter];
+    peak.amplitude = std::exp(parameters[i + kLogAmplitudeParameter]);
+    const double sigma = std::exp(parameters[i + kLogSigmaParameter]);
+    peak.width = sigma * sigma;
+    peaks.push_back(peak);
+  }
+  return peaks;
+}
+
+std::vector<PeakFitResult> PeakFitter::FitSpectra(
+    const std::vector<std::shared_ptr<Spectrum>>& spectra) const {
+
+  const int num_spectra = spectra.size();
+  std::vector<PeakFitResult> results(num_spectra);
+  const int num_tasks =
+      (num_spectra + kNumSpectraPerTask - 1) / kNumSpectraPerTask;
+  num_spectra_fitted_ = 0;
+  const bool fitted_all = util::ParallelFor(
+      num_tasks, num_threads_,
+      [&](const int task_index, const int thread_index) {
+        if (cancel_requested_) {
+          return false;
+        }
+        const int first_spectrum = task_index * kNumSpectraPerTask;
+        const int end_spectrum =
+            std::min(first_spectrum + kNumSpectraPerTask, num_spectra);
+        for (int i = first_spectrum; i < end_spectrum; ++i) {
+          const Spectrum& original = *spectra[i];
+          const std::vector<double> values =
+              original.GenerateSpectrum(num_bands_);
+          std::shared_ptr<Spectrum> fitted(
+              new Spectrum(original.GetName(), original.GetColor()));
+          for (const PeakDistribution& peak : FitPeaks(values)) {
+            fitted->AddPeak(peak.position, peak.amplitude, peak.width);
+          }
+          const std::vector<double>& fitted_values =
+              fitted->GenerateSpectrum(num_bands_);
+          double squared_error = 0.0;
+          double max_error = 0.0;
+          for (int band = 0; band < num_bands_; ++band) {
+            const double error = std::abs(values[band] - fitted_values[band]);
+            squared_error += error * error;
+            max_error = std::max(error, max_error);
+          }
+          results[i].spectrum = fitted;
+          results[i].rms_error = std::sqrt(squared_error / num_bands_);
+          results[i].max_error = max_error;
+          ++num_spectra_fitted_;
+        }
+        return true;
+      });
+  if (!fitted_all) {
+    return std::vector<PeakFitResult>();
+  }
+  return results;
+}
+
+}  // namespace hsi_data_generator
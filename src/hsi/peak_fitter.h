@@ -0,0 +1,116 @@
+// The PeakFitter converts spectra (typically measured spectra imported from a
+// spectral library, see SpectralLibraryLoader) into a small set of Gaussian
+// peaks. Peak-defined spectra can be generated at any resolution, and take a
+// fraction of the memory of tabulated values.
+//
+// Peaks are added greedily: each new peak is seeded at the largest remaining
+// residual, with a width estimated from the residual's half maximum, and then
+// all of the peaks are refined together with Levenberg-Marquardt least
+// squares. Peaks are added until the reconstruction error reaches the target
+// or the maximum number of peaks is used.
+
+#ifndef SRC_HSI_PEAK_FITTER_H_
+#define SRC_HSI_PEAK_FITTER_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "hsi/spectrum.h"
+
+namespace hsi_data_generator {
+
+// The result of fitting a single spectrum.
+struct PeakFitResult {
+  // The fitted spectrum, which has the name and color of the original one but
+  // only contains peaks.
+  std::shared_ptr<Spectrum> spectrum;
+
+  // The root mean square and maximum absolute difference between the
+  // original and fitted spectra, both generated at the fitting resolution.
+  double rms_error = 0.0;
+  double max_error = 0.0;
+};
+
+class PeakFitter {
+ public:
+  // Spectra are compared (and fitted) at the given number of bands.
+  explicit PeakFitter(const int num_bands)
+      : num_bands_(num_bands),
+        max_num_peaks_(16),
+        target_rms_error_(0.005),
+        max_num_iterations_(20),
+        num_threads_(0),
+        cancel_requested_(false),
+        num_spectra_fitted_(0) {}
+
+  // Sets the maximum number of peaks of each fitted spectrum. The default is
+  // 16.
+  void SetMaxNumPeaks(const int max_num_peaks) {
+    max_num_peaks_ = max_num_peaks;
+  }
+
+  // Sets the root mean square error at which no more peaks are added. The
+  // default is 0.005 (half a percent of the normalized range).
+  void SetTargetRMSError(const double target_rms_error) {
+    target_rms_error_ = target_rms_error;
+  }
+
+  // Sets the maximum number of Levenberg-Marquardt iterations that are run
+  // each time a peak is added. The default is 20.
+  void SetMaxNumIterations(const int max_num_iterations) {
+    max_num_iterations_ = max_num_iterations;
+  }
+
+  // Sets the number of threads used by FitSpectra(). A value less than 1 (the
+  // default) uses all available cores.
+  void SetNumThreads(const int num_threads) {
+    num_threads_ = num_threads;
+  }
+
+  // Fits peaks to the given spectrum values, which are sampled at the band
+  // positions (value i is at the normalized position i / values.size()).
+  // Returns the fitted peaks, which are all Gaussian.
+  std::vector<PeakDistribution> FitPeaks(
+      const std::vector<double>& values) const;
+
+  // Fits every one of the given spectra, in parallel. Each spectrum is
+  // generated at the fitting resolution and then fitted with FitPeaks(). The
+  // given spectra are not modified, but their generated values are cached, so
+  // they must not be used by another thread during the fit. Returns one result
+  // per spectrum, in the same order, or an empty list if the fit was canceled.
+  std::vector<PeakFitResult> FitSpectra(
+      const std::vector<std::shared_ptr<Spectrum>>& spectra) const;
+
+  // Stops a running FitSpectra() call, which will return an empty list once
+  // the spectra that are currently being fitted are done. This can be called
+  // from any thread.
+  void Cancel() {
+    cancel_requested_ = true;
+  }
+
+  // Returns the number of spectra fitted so far by FitSpectra(). This can be
+  // called from any thread to report the progress of a running fit.
+  int GetNumSpectraFitted() const {
+    return num_spectra_fitted_;
+  }
+
+ private:
+  // The number of bands that spectra are fitted at.
+  const int num_bands_;
+
+  int max_num_peaks_;
+  double target_rms_error_;
+  int max_num_iterations_;
+  int num_threads_;
+
+  // Set by Cancel() to stop a running fit.
+  std::atomic<bool> cancel_requested_;
+
+  // The progress of the running fit (see GetNumSpectraFitted()).
+  mutable std::atomic<int> num_spectra_fitted_;
+};
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_PEAK_FITTER_H_
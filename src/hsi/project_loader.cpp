@@ -4,9 +4,12 @@
 #include <QFile>
 #include <QIODevice>
 #include <QString>
+#include <QStringList>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
 
+#include <vector>
+
 #include "hsi/spectrum.h"
 #include "util/util.h"
 
@@ -22,10 +25,17 @@ static const QString kSpectrumTag = "spectrum";
 static const QString kSpectrumPeaksTag = "peaks";
 static const QString kSpectrumNameTag = "name";
 static const QString kSpectrumColorTag = "color";
+static const QString kSpectrumTabulatedValuesTag = "tabulated_values";
+static const QString kSpectralLinesTag = "spectral_lines";
+static const QString kSpectralLinesWidthTag = "width";
+static const QString kSpectralLinesPositionsTag = "positions";
+static const QString kSpectralLinesAmplitudesTag = "amplitudes";
 static const QString kPeakTag = "peak";
 static const QString kPeakPositionTag = "position";
 static const QString kPeakAmplitudeTag = "amplitude";
 static const QString kPeakWidthTag = "width";
+static const QString kPeakShapeTag = "shape";
+static const QString kPeakShapeParameterTag = "shape_parameter";
 static const QString kNumBandsTag = "num_bands";
 
 // Error messages:
@@ -36,6 +46,25 @@ static const QString kFileNotOpenWriteErrorMessage =
 static const QString kFileNotOpenReadErrorMessage =
     "Could not open file \"" + util::kTextSubPlaceholder + "\" for reading.";
 
+// Converts a list of values to and from the space-separated text that stores
+// them in the project file.
+QString JoinValues(const std::vector<double>& values) {
+  QStringList value_texts;
+  for (const double value : values) {
+    value_texts << QString::number(value);
+  }
+  return value_texts.join(" ");
+}
+
+std::vector<double> SplitValues(const QString& text) {
+  const QStringList value_texts = text.split(" ", QString::SkipEmptyParts);
+  std::vector<double> values;
+  for (const QString& value_text : value_texts) {
+    values.push_back(value_text.toDouble());
+  }
+  return values;
+}
+
 }  // namespace
 
 bool ProjectLoader::SaveProjectToFile(const QString& file_name) const {
@@ -64,9 +93,29 @@ bool ProjectLoader::SaveProjectToFile(const QString& file_name) const {
           kPeakAmplitudeTag, QString::number(peak.amplitude));
       // <width> </width>
       xml_writer.writeTextElement(kPeakWidthTag, QString::number(peak.width));
+      xml_writer.writeTextElement(kPeakShapeTag, GetPeakShapeName(peak.shape));
+      xml_writer.writeTextElement(
+          kPeakShapeParameterTag, QString::number(peak.shape_parameter));
       xml_writer.writeEndElement();  // </peak>
     }
     xml_writer.writeEndElement();  // </peaks>
+    // <tabulated_values> </tabulated_values>
+    if (!spectrum->GetTabulatedValues().empty()) {
+      xml_writer.writeTextElement(
+          kSpectrumTabulatedValuesTag,
+          JoinValues(spectrum->GetTabulatedValues()));
+    }
+    const SpectralLines& spectral_lines = spectrum->GetSpectralLines();
+    if (!spectral_lines.IsEmpty()) {
+      xml_writer.writeStartElement(kSpectralLinesTag);  // <spectral_lines>
+      xml_writer.writeTextElement(  // <width> </width>
+          kSpectralLinesWidthTag, QString::number(spectral_lines.width));
+      xml_writer.writeTextElement(  // <positions> </positions>
+          kSpectralLinesPositionsTag, JoinValues(spectral_lines.positions));
+      xml_writer.writeTextElement(  // <amplitudes> </amplitudes>
+          kSpectralLinesAmplitudesTag, JoinValues(spectral_lines.amplitudes));
+      xml_writer.writeEndElement();  // </spectral_lines>
+    }
     // <name> </name>
     xml_writer.writeTextElement(kSpectrumNameTag, spectrum->GetName());
     // <color> </color>
@@ -125,17 +174,55 @@ bool ProjectLoader::LoadProjectFromFile(const QString& file_name) {
                       const QString peak_width_text =  // <width>
                           xml_reader.readElementText();
                       peak.width = peak_width_text.toDouble();
+                    } else if (xml_reader.name() == kPeakShapeTag) {
+                      const QString peak_shape_text =  // <shape>
+                          xml_reader.readElementText();
+                      // Unknown shapes are loaded as Gaussian peaks.
+                      if (!GetPeakShapeFromName(peak_shape_text, &peak.shape)) {
+                        peak.shape = PEAK_SHAPE_GAUSSIAN;
+                      }
+                    } else if (xml_reader.name() == kPeakShapeParameterTag) {
+                      const QString peak_shape_parameter_text =
+                          xml_reader.readElementText();  // <shape_parameter>
+                      peak.shape_parameter =
+                          peak_shape_parameter_text.toDouble();
                     } else {
                       xml_reader.skipCurrentElement();  // Unknown tag.
                     }
                   }
                   // </peak>
-                  spectrum->AddPeak(peak.position, peak.amplitude, peak.width);
+                  spectrum->AddPeak(
+                      peak.position,
+                      peak.amplitude,
+                      peak.width,
+                      peak.shape,
+                      peak.shape_parameter);
                 } else {
                   xml_reader.skipCurrentElement();  // Unknown tag.
                 }
               }
               // </peaks>
+            } else if (xml_reader.name() == kSpectrumTabulatedValuesTag) {
+              spectrum->SetTabulatedValues(  // <tabulated_values>
+                  SplitValues(xml_reader.readElementText()));
+            } else if (xml_reader.name() == kSpectralLinesTag) {
+              SpectralLines spectral_lines;  // <spectral_lines>
+              while (xml_reader.readNextStartElement()) {
+                if (xml_reader.name() == kSpectralLinesWidthTag) {
+                  spectral_lines.width =  // <width>
+                      xml_reader.readElementText().toDouble();
+                } else if (xml_reader.name() == kSpectralLinesPositionsTag) {
+                  spectral_lines.positions =  // <positions>
+                      SplitValues(xml_reader.readElementText());
+                } else if (xml_reader.name() == kSpectralLinesAmplitudesTag) {
+                  spectral_lines.amplitudes =  // <amplitudes>
+                      SplitValues(xml_reader.readElementText());
+                } else {
+                  xml_reader.skipCurrentElement();  // Unknown tag.
+                }
+              }
+              // </spectral_lines>
+              spectrum->SetSpectralLines(spectral_lines);
             } else if (xml_reader.name() == kSpectrumNameTag) {  // <name>
               spectrum->SetName(xml_reader.readElementText());
             } else if (xml_reader.name() == kSpectrumColorTag) {  // <color>
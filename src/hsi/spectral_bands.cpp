@@ -0,0 +1,156 @@
+#include "hsi/spectral_bands.h"
+
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "util/util.h"
+
+namespace hsi_data_generator {
+namespace {
+
+// Lines in band files that start with this character are ignored.
+constexpr char kCommentCharacter = '#';
+
+// Converts a full width at half maximum into the standard deviation of a
+// Gaussian.
+const double kFWHMToSigma = 1.0 / (2.0 * std::sqrt(2.0 * std::log(2.0)));
+
+// Error messages:
+static const QString kGenericErrorMessage = "Invalid spectral bands.";
+
+static const QString kFileNotOpenErrorMessage =
+    "Could not open file \"" + util::kTextSubPlaceholder + "\" for reading.";
+
+static const QString kInvalidLineErrorMessage =
+    "Could not read the center wavelength and FWHM on line " +
+    util::kTextSubPlaceholder + ".";
+
+static const QString kInvalidBandErrorMessage =
+    "Invalid band: center wavelengths must be strictly increasing, and FWHMs "
+    "must not be negative.";
+
+static const QString kInvalidNumberOfBandsErrorMessage =
+    "Invalid number of spectral bands: must be between " +
+    QString::number(util::kMinNumberOfBands) + " and " +
+    QString::number(util::kMaxNumberOfBands) + ".";
+
+}  // namespace
+
+bool SpectralBands::AddBand(const double center_wavelength, const double fwhm) {
+  if (!util::IsFinite(center_wavelength) || !util::IsFinite(fwhm) ||
+      fwhm < 0.0 ||
+      (!center_wavelengths_.empty() &&
+       center_wavelength <= center_wavelengths_.back())) {
+    error_message_ = kInvalidBandErrorMessage;
+    return false;
+  }
+  if (center_wavelengths_.size() >= util::kMaxNumberOfBands) {
+    error_message_ = kInvalidNumberOfBandsErrorMessage;
+    return false;
+  }
+  center_wavelengths_.push_back(center_wavelength);
+  fwhms_.push_back(fwhm);
+  return true;
+}
+
+void SpectralBands::Clear() {
+  center_wavelengths_.clear();
+  fwhms_.clear();
+  min_wavelength_ = 0.0;
+  max_wavelength_ = 0.0;
+}
+
+bool SpectralBands::LoadFromFile(const QString& file_name) {
+  std::ifstream band_file(file_name.toStdString());
+  if (!band_file.is_open()) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kFileNotOpenErrorMessage, file_name);
+    return false;
+  }
+  center_wavelengths_.clear();
+  fwhms_.clear();
+  std::string line;
+  int line_number = 0;
+  while (std::getline(band_file, line)) {
+    ++line_number;
+    std::replace(line.begin(), line.end(), ',', ' ');
+    const size_t first_character = line.find_first_not_of(" \t\r");
+    if (first_character == std::string::npos ||
+        line[first_character] == kCommentCharacter) {
+      continue;
+    }
+    std::istringstream line_stream(line);
+    double center_wavelength = 0.0;
+    double fwhm = 0.0;
+    if (!(line_stream >> center_wavelength >> fwhm)) {
+      error_message_ = util::ReplaceTextSubPlaceholder(
+          kInvalidLineErrorMessage, QString::number(line_number));
+      return false;
+    }
+    if (!AddBand(center_wavelength, fwhm)) {
+      return false;
+    }
+  }
+  if (center_wavelengths_.size() < util::kMinNumberOfBands) {
+    error_message_ = kInvalidNumberOfBandsErrorMessage;
+    return false;
+  }
+  return true;
+}
+
+double SpectralBands::GetMinWavelength() const {
+  if (max_wavelength_ > min_wavelength_ || center_wavelengths_.empty()) {
+    return min_wavelength_;
+  }
+  return center_wavelengths_.front();
+}
+
+double SpectralBands::GetMaxWavelength() const {
+  if (max_wavelength_ > min_wavelength_ || center_wavelengths_.empty()) {
+    return max_wavelength_;
+  }
+  const int num_bands = center_wavelengths_.size();
+  if (num_bands == 1) {
+    // There is no band spacing, so the range is the band's own width (or a
+    // single unit if it has none).
+    return center_wavelengths_.front() + std::max(fwhms_.front(), 1.0);
+  }
+  const double band_spacing =
+      (center_wavelengths_.back() - center_wavelengths_.front()) /
+      static_cast<double>(num_bands - 1);
+  return center_wavelengths_.back() + band_spacing;
+}
+
+void SpectralBands::GetNormalizedBands(
+    std::vector<double>* positions,
+    std::vector<double>* response_variances) const {
+
+  const double min_wavelength = GetMinWavelength();
+  const double wavelength_scale =
+      1.0 / (GetMaxWavelength() - min_wavelength);
+  const int num_bands = center_wavelengths_.size();
+  positions->resize(num_bands);
+  response_variances->resize(num_bands);
+  for (int band = 0; band < num_bands; ++band) {
+    (*positions)[band] =
+        (center_wavelengths_[band] - min_wavelength) * wavelength_scale;
+    const double response_sigma =
+        fwhms_[band] * kFWHMToSigma * wavelength_scale;
+    (*response_variances)[band] = response_sigma * response_sigma;
+  }
+}
+
+QString SpectralBands::GetErrorMessage() const {
+  if (error_message_.isEmpty()) {
+    return kGenericErrorMessage;
+  }
+  return error_message_;
+}
+
+}  // namespace hsi_data_generator
@@ -0,0 +1,96 @@
+// The SpectralBands describe the bands of a real sensor: the center wavelength
+// and full width at half maximum (FWHM) of each band's spectral response
+// function (SRF), which is modeled as a Gaussian. Spectra can be generated as
+// measured by these bands (see Spectrum::IntegrateSpectrum()), instead of
+// being point sampled on a uniform grid.
+//
+// Spectrum peaks are defined on a normalized axis between 0 and 1, which is
+// mapped linearly onto a wavelength range (see SetWavelengthRange()).
+
+#ifndef SRC_HSI_SPECTRAL_BANDS_H_
+#define SRC_HSI_SPECTRAL_BANDS_H_
+
+#include <QString>
+
+#include <vector>
+
+namespace hsi_data_generator {
+
+class SpectralBands {
+ public:
+  SpectralBands() : min_wavelength_(0), max_wavelength_(0) {}
+
+  // Adds a band after the existing ones. Band centers must be strictly
+  // increasing, and a FWHM of 0 samples the spectrum at the band's center.
+  // Returns false (and adds nothing) if the band is invalid.
+  bool AddBand(const double center_wavelength, const double fwhm);
+
+  // Removes all of the bands and resets the wavelength range.
+  void Clear();
+
+  // Sets the wavelengths that the normalized spectrum positions 0 and 1 are
+  // mapped to. If the range is not set (or is empty), it starts at the first
+  // band's center and spans one average band spacing past the last center.
+  // That way, evenly spaced bands with no width are sampled at exactly the
+  // same positions as Spectrum::GenerateSpectrum() with the same number of
+  // bands.
+  void SetWavelengthRange(
+      const double min_wavelength, const double max_wavelength) {
+    min_wavelength_ = min_wavelength;
+    max_wavelength_ = max_wavelength;
+  }
+
+  // Loads the bands from a text file with one band per line: its center
+  // wavelength and FWHM, separated by whitespace or a comma. Empty lines and
+  // lines starting with '#' are ignored. Any existing bands are replaced, and
+  // the wavelength range is kept.
+  //
+  // Returns true on success.
+  bool LoadFromFile(const QString& file_name);
+
+  int GetNumBands() const {
+    return center_wavelengths_.size();
+  }
+
+  bool IsEmpty() const {
+    return center_wavelengths_.empty();
+  }
+
+  const std::vector<double>& GetCenterWavelengths() const {
+    return center_wavelengths_;
+  }
+
+  const std::vector<double>& GetFWHMs() const {
+    return fwhms_;
+  }
+
+  // Returns the wavelength range used to map spectrum positions (see
+  // SetWavelengthRange()).
+  double GetMinWavelength() const;
+  double GetMaxWavelength() const;
+
+  // Converts the bands onto the normalized spectrum axis: the position of each
+  // band's center, and the variance of its Gaussian response function.
+  void GetNormalizedBands(
+      std::vector<double>* positions,
+      std::vector<double>* response_variances) const;
+
+  // Returns any error message caused by AddBand() or LoadFromFile(). If no
+  // errors were logged, returns a generic error string.
+  QString GetErrorMessage() const;
+
+ private:
+  std::vector<double> center_wavelengths_;
+  std::vector<double> fwhms_;
+
+  // The user-defined wavelength range. Ignored if it is empty.
+  double min_wavelength_;
+  double max_wavelength_;
+
+  // This error message is logged if adding or loading bands fails.
+  QString error_message_;
+};
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_SPECTRAL_BANDS_H_
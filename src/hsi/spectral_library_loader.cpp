@@ -0,0 +1,808 @@
+#include "hsi/spectral_library_loader.h"
+
+#include <QFileInfo>
+#include <QString>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hsi/spectrum.h"
+#include "util/mapped_file.h"
+#include "util/parallel_for.h"
+#include "util/util.h"
+
+namespace hsi_data_generator {
+namespace {
+
+// Files with this extension are read as ENVI spectral libraries.
+static const QString kENVILibrarySuffix = "sli";
+
+// The extension of ENVI header files.
+static const QString kENVIHeaderSuffix = ".hdr";
+
+// The ENVI data type codes that can be imported.
+constexpr int kENVIDataTypeUInt8 = 1;
+constexpr int kENVIDataTypeInt16 = 2;
+constexpr int kENVIDataTypeInt32 = 3;
+constexpr int kENVIDataTypeFloat32 = 4;
+constexpr int kENVIDataTypeFloat64 = 5;
+constexpr int kENVIDataTypeUInt16 = 12;
+constexpr int kENVIDataTypeUInt32 = 13;
+
+// Each band is interpolated from this many consecutive samples (see
+// ResamplingPlan). Linear interpolation only uses two of them.
+constexpr int kNumInterpolationTaps = 4;
+
+// The number of spectra resampled by each parallel task.
+constexpr int kNumSpectraPerTask = 64;
+
+// Integers with more digits than this are rounded when parsing numbers, so
+// that the mantissa fits in 64 bits.
+constexpr int kMaxNumMantissaDigits = 19;
+
+// Powers of 10 that are exactly representable as doubles. Numbers with small
+// mantissas and exponents in this range are correctly rounded with a single
+// multiplication or division. Longer numbers may be off by one unit in the
+// last place, which is far below the precision of any measured spectrum.
+constexpr double kExactPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+constexpr int kMaxExactPowerOf10 = 22;
+constexpr uint64_t kMaxExactMantissa = uint64_t(1) << 53;
+
+// Error messages:
+static const QString kGenericErrorMessage =
+    "Could not import the spectral library.";
+
+static const QString kFileNotOpenErrorMessage =
+    "Could not open file \"" + util::kTextSubPlaceholder + "\" for reading.";
+
+static const QString kHeaderNotFoundErrorMessage =
+    "Could not find the ENVI header of spectral library \"" +
+    util::kTextSubPlaceholder + "\".";
+
+static const QString kEmptyHeaderErrorMessage =
+    "The ENVI header of spectral library \"" + util::kTextSubPlaceholder +
+    "\" is empty.";
+
+static const QString kInvalidHeaderErrorMessage =
+    "Invalid ENVI spectral library header: missing or invalid \"" +
+    util::kTextSubPlaceholder + "\".";
+
+static const QString kUnsupportedDataTypeErrorMessage =
+    "Unsupported ENVI data type: " + util::kTextSubPlaceholder + ".";
+
+static const QString kFileTooSmallErrorMessage =
+    "Spectral library \"" + util::kTextSubPlaceholder +
+    "\" is smaller than its header describes.";
+
+static const QString kInvalidLineErrorMessage =
+    "Inconsistent number of values on line " + util::kTextSubPlaceholder + ".";
+
+static const QString kNoSpectraErrorMessage =
+    "No spectra found in \"" + util::kTextSubPlaceholder + "\".";
+
+static const QString kInvalidWavelengthsErrorMessage =
+    "Spectral library wavelengths must be strictly increasing or strictly "
+    "decreasing.";
+
+static const QString kInvalidNumberOfBandsErrorMessage =
+    "Invalid number of bands: must be between " +
+    QString::number(util::kMinNumberOfBands) + " and " +
+    QString::number(util::kMaxNumberOfBands) + ".";
+
+// Returns true for the characters that separate the columns of ASCII tables.
+bool IsColumnSeparator(const char character) {
+  return character == ' ' || character == '\t' || character == ',' ||
+         character == ';' || character == '\r';
+}
+
+bool IsDigit(const char character) {
+  return character >= '0' && character <= '9';
+}
+
+// Parses a decimal number (with an optional sign, fraction, and exponent)
+// starting at the cursor, without reading past the end. On success, the
+// cursor is moved past the number. Returns false (and leaves the cursor) if
+// there is no number at the cursor.
+//
+// Unlike strtod(), this does not need a null-terminated string, so numbers
+// can be parsed directly from a memory-mapped file. It also ignores the
+// locale, which Qt applications set from the environment (so strtod() would
+// expect a decimal comma in some languages).
+bool ParseNumber(const char** cursor, const char* end, double* value) {
+  const char* position = *cursor;
+  bool is_negative = false;
+  if (position < end && (*position == '-' || *position == '+')) {
+    is_negative = (*position == '-');
+    ++position;
+  }
+  uint64_t mantissa = 0;
+  int num_mantissa_digits = 0;
+  int exponent = 0;
+  bool has_digits = false;
+  for (; position < end && IsDigit(*position); ++position) {
+    has_digits = true;
+    if (num_mantissa_digits < kMaxNumMantissaDigits) {
+      mantissa = mantissa * 10 + (*position - '0');
+      if (mantissa > 0) {
+        ++num_mantissa_digits;
+      }
+    } else {
+      ++exponent;
+    }
+  }
+  if (position < end && *position == '.') {
+    ++position;
+    for (; position < end && IsDigit(*position); ++position) {
+      has_digits = true;
+      if (num_mantissa_digits < kMaxNumMantissaDigits) {
+        mantissa = mantissa * 10 + (*position - '0');
+        --exponent;
+        if (mantissa > 0) {
+          ++num_mantissa_digits;
+        }
+      }
+    }
+  }
+  if (!has_digits) {
+    return false;
+  }
+  // The exponent is only consumed if it has digits.
+  if (position < end && (*position == 'e' || *position == 'E')) {
+    const char* exponent_position = position + 1;
+    bool is_exponent_negative = false;
+    if (exponent_position < end &&
+        (*exponent_position == '-' || *exponent_position == '+')) {
+      is_exponent_negative = (*exponent_position == '-');
+      ++exponent_position;
+    }
+    if (exponent_position < end && IsDigit(*exponent_position)) {
+      int explicit_exponent = 0;
+      for (; exponent_position < end && IsDigit(*exponent_position);
+           ++exponent_position) {
+        // Larger exponents overflow to infinity or 0 anyway.
+        if (explicit_exponent < 10000) {
+          explicit_exponent =
+              explicit_exponent * 10 + (*exponent_position - '0');
+        }
+      }
+      exponent += is_exponent_negative ? -explicit_exponent : explicit_exponent;
+      position = exponent_position;
+    }
+  }
+  double result = static_cast<double>(mantissa);
+  if (mantissa <= kMaxExactMantissa &&
+      std::abs(exponent) <= kMaxExactPowerOf10) {
+    if (exponent >= 0) {
+      result *= kExactPowersOf10[exponent];
+    } else {
+      result /= kExactPowersOf10[-exponent];
+    }
+  } else if (mantissa != 0) {
+    result *= std::pow(10.0, exponent);
+  }
+  *value = is_negative ? -result : result;
+  *cursor = position;
+  return true;
+}
+
+// Returns the string with leading and trailing whitespace removed.
+std::string TrimWhitespace(const std::string& text) {
+  const size_t first = text.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) {
+    return std::string();
+  }
+  const size_t last = text.find_last_not_of(" \t\r\n");
+  return text.substr(first, last - first + 1);
+}
+
+// Parses the "key = value" fields of an ENVI header. Keys are converted to
+// lower case. Values in braces (lists) can span multiple lines, and are
+// returned without the braces.
+std::map<std::string, std::string> ParseENVIHeader(const std::string& text) {
+  std::map<std::string, std::string> fields;
+  size_t line_start = 0;
+  while (line_start < text.size()) {
+    size_t line_end = text.find('\n', line_start);
+    if (line_end == std::string::npos) {
+      line_end = text.size();
+    }
+    const size_t equals = text.find('=', line_start);
+    if (equals == std::string::npos || equals > line_end) {
+      line_start = line_end + 1;
+      continue;
+    }
+    std::string key = TrimWhitespace(
+        text.substr(line_start, equals - line_start));
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    const size_t value_start = text.find_first_not_of(" \t", equals + 1);
+    if (value_start != std::string::npos && text[value_start] == '{') {
+      size_t value_end = text.find('}', value_start);
+      if (value_end == std::string::npos) {
+        value_end = text.size();
+      }
+      fields[key] = text.substr(value_start + 1, value_end - value_start - 1);
+      line_end = text.find('\n', value_end);
+      if (line_end == std::string::npos) {
+        line_end = text.size();
+      }
+    } else {
+      fields[key] = TrimWhitespace(
+          text.substr(equals + 1, line_end - equals - 1));
+    }
+    line_start = line_end + 1;
+  }
+  return fields;
+}
+
+// Splits a comma-separated ENVI header list into its trimmed items.
+std::vector<std::string> SplitENVIHeaderList(const std::string& list) {
+  std::vector<std::string> items;
+  size_t item_start = 0;
+  while (item_start <= list.size()) {
+    size_t item_end = list.find(',', item_start);
+    if (item_end == std::string::npos) {
+      item_end = list.size();
+    }
+    items.push_back(
+        TrimWhitespace(list.substr(item_start, item_end - item_start)));
+    item_start = item_end + 1;
+  }
+  if (items.size() == 1 && items.front().empty()) {
+    items.clear();
+  }
+  return items;
+}
+
+// Parses a whole header field as a single number. Returns false if the field
+// is missing or is not a number.
+bool ParseENVIHeaderNumber(
+    const std::map<std::string, std::string>& fields,
+    const std::string& key,
+    double* value) {
+
+  const auto field = fields.find(key);
+  if (field == fields.end()) {
+    return false;
+  }
+  const char* cursor = field->second.data();
+  const char* end = cursor + field->second.size();
+  return ParseNumber(&cursor, end, value) && cursor == end;
+}
+
+// Converts the given number of ENVI samples of type T to doubles, reversing
+// their byte order if needed.
+template <typename T>
+void ConvertENVISamples(
+    const char* data,
+    const int num_samples,
+    const bool swap_byte_order,
+    const double scale,
+    double* values) {
+
+  for (int i = 0; i < num_samples; ++i) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data + i * sizeof(T), sizeof(T));
+    if (swap_byte_order) {
+      std::reverse(bytes, bytes + sizeof(T));
+    }
+    T sample;
+    std::memcpy(&sample, bytes, sizeof(T));
+    values[i] = static_cast<double>(sample) * scale;
+  }
+}
+
+// Returns the size in bytes of a sample of the given ENVI data type, or 0 if
+// the type is not supported.
+int GetENVIDataTypeSize(const int data_type) {
+  switch (data_type) {
+  case kENVIDataTypeUInt8:
+    return 1;
+  case kENVIDataTypeInt16:
+  case kENVIDataTypeUInt16:
+    return 2;
+  case kENVIDataTypeInt32:
+  case kENVIDataTypeUInt32:
+  case kENVIDataTypeFloat32:
+    return 4;
+  case kENVIDataTypeFloat64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+// Converts the samples of the given (supported) ENVI data type to doubles.
+void ConvertENVISamples(
+    const int data_type,
+    const char* data,
+    const int num_samples,
+    const bool swap_byte_order,
+    const double scale,
+    double* values) {
+
+  switch (data_type) {
+  case kENVIDataTypeUInt8:
+    ConvertENVISamples<uint8_t>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  case kENVIDataTypeInt16:
+    ConvertENVISamples<int16_t>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  case kENVIDataTypeUInt16:
+    ConvertENVISamples<uint16_t>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  case kENVIDataTypeInt32:
+    ConvertENVISamples<int32_t>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  case kENVIDataTypeUInt32:
+    ConvertENVISamples<uint32_t>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  case kENVIDataTypeFloat32:
+    ConvertENVISamples<float>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  case kENVIDataTypeFloat64:
+    ConvertENVISamples<double>(
+        data, num_samples, swap_byte_order, scale, values);
+    break;
+  }
+}
+
+// Checks that the wavelengths are strictly monotonic. If they are decreasing,
+// they are reversed (and *is_reversed is set), so that they always increase.
+bool SortWavelengths(std::vector<double>* wavelengths, bool* is_reversed) {
+  *is_reversed = wavelengths->size() > 1 &&
+      (*wavelengths)[1] < (*wavelengths)[0];
+  if (*is_reversed) {
+    std::reverse(wavelengths->begin(), wavelengths->end());
+  }
+  const int num_wavelengths = wavelengths->size();
+  for (int i = 0; i < num_wavelengths; ++i) {
+    if (!util::IsFinite((*wavelengths)[i]) ||
+        (i > 0 && (*wavelengths)[i] <= (*wavelengths)[i - 1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// How every spectrum of a library is resampled. All of the spectra share the
+// same wavelengths, so the interpolation weights are only computed once. Band
+// b is the weighted sum of the kNumInterpolationTaps samples starting at
+// first_indices[b], with the weights at weights[b * kNumInterpolationTaps].
+struct ResamplingPlan {
+  std::vector<int> first_indices;
+  std::vector<double> weights;
+};
+
+// Builds the plan that interpolates samples at the given (increasing)
+// normalized positions at the positions of the given number of bands (see
+// Spectrum::SetTabulatedValues()). Bands outside of the samples get the value
+// of the first or last sample. The plan may read up to kNumInterpolationTaps
+// samples even if there are fewer, so the samples must be padded.
+ResamplingPlan GetResamplingPlan(
+    const std::vector<double>& sample_positions,
+    const int num_bands,
+    const SpectralResamplingMethod resampling_method) {
+
+  const int num_samples = sample_positions.size();
+  // The taps of each band start at most this index, so that they do not read
+  // past the (padded) samples.
+  const int max_first_index = std::max(num_samples - kNumInterpolationTaps, 0);
+  ResamplingPlan plan;
+  plan.first_indices.resize(num_bands);
+  plan.weights.assign(num_bands * kNumInterpolationTaps, 0.0);
+  int k = 0;
+  for (int band = 0; band < num_bands; ++band) {
+    const double position = static_cast<double>(band) / num_bands;
+    double* band_weights = plan.weights.data() + band * kNumInterpolationTaps;
+    if (num_samples == 1 || position <= sample_positions.front()) {
+      plan.first_indices[band] = 0;
+      band_weights[0] = 1.0;
+      continue;
+    }
+    if (position >= sample_positions.back()) {
+      plan.first_indices[band] = max_first_index;
+      band_weights[num_samples - 1 - max_first_index] = 1.0;
+      continue;
+    }
+    // Find the interval [k, k + 1] of samples around the band. Bands are in
+    // increasing order, so the search continues from the previous band.
+    while (sample_positions[k + 1] <= position) {
+      ++k;
+    }
+    const int first_index = std::min(std::max(k - 1, 0), max_first_index);
+    plan.first_indices[band] = first_index;
+    auto add_weight = [&](const int sample, const double weight) {
+      band_weights[sample - first_index] += weight;
+    };
+    const double spacing = sample_positions[k + 1] - sample_positions[k];
+    const double s = (position - sample_positions[k]) / spacing;
+    if (resampling_method == SPECTRAL_RESAMPLING_LINEAR) {
+      add_weight(k, 1.0 - s);
+      add_weight(k + 1, s);
+      continue;
+    }
+    // Cubic Hermite basis functions.
+    const double s2 = s * s;
+    const double s3 = s2 * s;
+    add_weight(k, 2.0 * s3 - 3.0 * s2 + 1.0);
+    add_weight(k + 1, -2.0 * s3 + 3.0 * s2);
+    // The slope at sample k is the central difference of its neighbors, or
+    // the one-sided difference at the first sample. Likewise for k + 1.
+    const int slope_start = std::max(k - 1, 0);
+    const double start_weight = (s3 - 2.0 * s2 + s) * spacing /
+        (sample_positions[k + 1] - sample_positions[slope_start]);
+    add_weight(k + 1, start_weight);
+    add_weight(slope_start, -start_weight);
+    const int slope_end = std::min(k + 2, num_samples - 1);
+    const double end_weight = (s3 - s2) * spacing /
+        (sample_positions[slope_end] - sample_positions[k]);
+    add_weight(slope_end, end_weight);
+    add_weight(k, -end_weight);
+  }
+  return plan;
+}
+
+// Applies the resampling plan to the (padded) samples of a spectrum.
+void ResampleSpectrum(
+    const ResamplingPlan& plan, const double* samples, double* values) {
+  const int num_bands = plan.first_indices.size();
+  for (int band = 0; band < num_bands; ++band) {
+    const double* band_samples = samples + plan.first_indices[band];
+    const double* weights = plan.weights.data() + band * kNumInterpolationTaps;
+    double value = 0.0;
+    for (int tap = 0; tap < kNumInterpolationTaps; ++tap) {
+      value += weights[tap] * band_samples[tap];
+    }
+    values[band] = value;
+  }
+}
+
+}  // namespace
+
+struct SpectralLibraryLoader::LibraryData {
+  // The sample wavelengths, in increasing order.
+  std::vector<double> wavelengths;
+
+  // The name of each spectrum.
+  std::vector<QString> names;
+
+  // Writes the samples of the given spectrum into the values, in order of
+  // increasing wavelength. This is called from multiple threads at once.
+  std::function<void(int spectrum_index, double* values)> read_spectrum;
+
+  // The data that read_spectrum reads from: the mapped library file, and the
+  // values of an ASCII table (one row per wavelength, in file order).
+  util::MappedFile file;
+  std::vector<double> table;
+};
+
+bool SpectralLibraryLoader::LoadLibraryFromFile(const QString& file_name) {
+  num_loaded_spectra_ = 0;
+  if (num_bands_ < util::kMinNumberOfBands ||
+      num_bands_ > util::kMaxNumberOfBands) {
+    error_message_ = kInvalidNumberOfBandsErrorMessage;
+    return false;
+  }
+  LibraryData library;
+  const bool is_envi_library =
+      QFileInfo(file_name).suffix().toLower() == kENVILibrarySuffix;
+  if (is_envi_library) {
+    if (!ReadENVILibrary(file_name, &library)) {
+      return false;
+    }
+  } else if (!ReadASCIILibrary(file_name, &library)) {
+    return false;
+  }
+  const int num_spectra = library.names.size();
+  if (num_spectra == 0) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kNoSpectraErrorMessage, file_name);
+    return false;
+  }
+
+  // Map the wavelengths onto the normalized axis in the same way as
+  // SpectralBands: the range spans one sample spacing past the last one.
+  const int num_samples = library.wavelengths.size();
+  std::vector<double> sample_positions(num_samples, 0.0);
+  if (num_samples > 1) {
+    const double first_wavelength = library.wavelengths.front();
+    const double position_scale =
+        (static_cast<double>(num_samples - 1) / num_samples) /
+        (library.wavelengths.back() - first_wavelength);
+    for (int i = 0; i < num_samples; ++i) {
+      sample_positions[i] =
+          (library.wavelengths[i] - first_wavelength) * position_scale;
+    }
+  }
+  const ResamplingPlan plan =
+      GetResamplingPlan(sample_positions, num_bands_, resampling_method_);
+
+  // Resample all of the spectra in parallel. Each thread converts the samples
+  // of one spectrum at a time into its own (padded) buffer.
+  const int num_threads = util::GetDefaultNumThreads();
+  std::vector<std::vector<double>> thread_samples(
+      num_threads,
+      std::vector<double>(std::max(num_samples, kNumInterpolationTaps), 0.0));
+  std::vector<std::vector<double>> resampled_spectra(num_spectra);
+  const int num_tasks =
+      (num_spectra + kNumSpectraPerTask - 1) / kNumSpectraPerTask;
+  util::ParallelFor(
+      num_tasks, num_threads,
+      [&](const int task_index, const int thread_index) {
+        double* samples = thread_samples[thread_index].data();
+        const int first_spectrum = task_index * kNumSpectraPerTask;
+        const int end_spectrum =
+            std::min(first_spectrum + kNumSpectraPerTask, num_spectra);
+        for (int i = first_spectrum; i < end_spectrum; ++i) {
+          library.read_spectrum(i, samples);
+          resampled_spectra[i].resize(num_bands_);
+          ResampleSpectrum(plan, samples, resampled_spectra[i].data());
+        }
+        return true;
+      });
+
+  // Spectra are created on this thread, since each picks a random color.
+  spectra_->reserve(spectra_->size() + num_spectra);
+  for (int i = 0; i < num_spectra; ++i) {
+    std::shared_ptr<Spectrum> spectrum(new Spectrum(library.names[i]));
+    spectrum->SetTabulatedValues(resampled_spectra[i]);
+    spectra_->push_back(spectrum);
+  }
+  num_loaded_spectra_ = num_spectra;
+  return true;
+}
+
+QString SpectralLibraryLoader::GetErrorMessage() const {
+  if (error_message_.isEmpty()) {
+    return kGenericErrorMessage;
+  }
+  return error_message_;
+}
+
+bool SpectralLibraryLoader::ReadENVILibrary(
+    const QString& file_name, LibraryData* library) {
+
+  // The header is either "<name>.hdr" or "<name>.sli.hdr".
+  const QFileInfo file_info(file_name);
+  util::MappedFile header_file;
+  if (!header_file.Open(file_info.path() + "/" +
+                        file_info.completeBaseName() + kENVIHeaderSuffix) &&
+      !header_file.Open(file_name + kENVIHeaderSuffix)) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kHeaderNotFoundErrorMessage, file_name);
+    return false;
+  }
+  // An empty file is mapped without any data.
+  if (header_file.GetSize() == 0) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kEmptyHeaderErrorMessage, file_name);
+    return false;
+  }
+  const std::map<std::string, std::string> fields = ParseENVIHeader(
+      std::string(header_file.GetData(), header_file.GetSize()));
+
+  // In a spectral library, each "line" is one spectrum and each "sample" is
+  // one wavelength.
+  double num_samples = 0.0;
+  double num_spectra = 0.0;
+  double data_type = 0.0;
+  double header_offset = 0.0;
+  double byte_order = 0.0;
+  double scale_factor = 1.0;
+  const char* invalid_field = nullptr;
+  if (!ParseENVIHeaderNumber(fields, "samples", &num_samples) ||
+      num_samples < 1.0 || num_samples > INT32_MAX) {
+    invalid_field = "samples";
+  } else if (!ParseENVIHeaderNumber(fields, "lines", &num_spectra) ||
+             num_spectra < 1.0 || num_spectra > INT32_MAX) {
+    invalid_field = "lines";
+  } else if (!ParseENVIHeaderNumber(fields, "data type", &data_type)) {
+    invalid_field = "data type";
+  } else if (fields.count("header offset") > 0 &&
+             (!ParseENVIHeaderNumber(
+                  fields, "header offset", &header_offset) ||
+              header_offset < 0.0)) {
+    invalid_field = "header offset";
+  } else if (fields.count("byte order") > 0 &&
+             !ParseENVIHeaderNumber(fields, "byte order", &byte_order)) {
+    invalid_field = "byte order";
+  } else if (fields.count("reflectance scale factor") > 0 &&
+             (!ParseENVIHeaderNumber(
+                  fields, "reflectance scale factor", &scale_factor) ||
+              scale_factor <= 0.0)) {
+    invalid_field = "reflectance scale factor";
+  }
+  if (invalid_field != nullptr) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kInvalidHeaderErrorMessage, invalid_field);
+    return false;
+  }
+  const int data_type_size = GetENVIDataTypeSize(static_cast<int>(data_type));
+  if (data_type_size == 0) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kUnsupportedDataTypeErrorMessage, QString::number(data_type));
+    return false;
+  }
+
+  // The wavelengths default to the sample indices.
+  const int num_wavelengths = static_cast<int>(num_samples);
+  library->wavelengths.resize(num_wavelengths);
+  const auto wavelength_field = fields.find("wavelength");
+  if (wavelength_field != fields.end()) {
+    const std::vector<std::string> wavelengths =
+        SplitENVIHeaderList(wavelength_field->second);
+    if (wavelengths.size() != library->wavelengths.size()) {
+      error_message_ = util::ReplaceTextSubPlaceholder(
+          kInvalidHeaderErrorMessage, "wavelength");
+      return false;
+    }
+    for (int i = 0; i < num_wavelengths; ++i) {
+      const char* cursor = wavelengths[i].data();
+      const char* end = cursor + wavelengths[i].size();
+      if (!ParseNumber(&cursor, end, &library->wavelengths[i])) {
+        error_message_ = util::ReplaceTextSubPlaceholder(
+            kInvalidHeaderErrorMessage, "wavelength");
+        return false;
+      }
+    }
+  } else {
+    for (int i = 0; i < num_wavelengths; ++i) {
+      library->wavelengths[i] = i;
+    }
+  }
+  bool is_reversed = false;
+  if (!SortWavelengths(&library->wavelengths, &is_reversed)) {
+    error_message_ = kInvalidWavelengthsErrorMessage;
+    return false;
+  }
+
+  // Spectra without a name are named after the file.
+  std::vector<std::string> names;
+  const auto names_field = fields.find("spectra names");
+  if (names_field != fields.end()) {
+    names = SplitENVIHeaderList(names_field->second);
+  }
+  const int num_library_spectra = static_cast<int>(num_spectra);
+  const int num_names = names.size();
+  library->names.resize(num_library_spectra);
+  for (int i = 0; i < num_library_spectra; ++i) {
+    if (i < num_names && !names[i].empty()) {
+      library->names[i] = QString::fromStdString(names[i]);
+    } else {
+      library->names[i] =
+          file_info.completeBaseName() + " " + QString::number(i + 1);
+    }
+  }
+
+  if (!library->file.Open(file_name)) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kFileNotOpenErrorMessage, file_name);
+    return false;
+  }
+  // The size that the header describes can overflow, so the file size is
+  // compared by subtracting the offset and dividing by the spectrum size.
+  const int64_t spectrum_num_bytes =
+      static_cast<int64_t>(num_samples) * data_type_size;
+  const int64_t file_size = library->file.GetSize();
+  if (header_offset > static_cast<double>(file_size) ||
+      (file_size - static_cast<int64_t>(header_offset)) / spectrum_num_bytes <
+          static_cast<int64_t>(num_spectra)) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kFileTooSmallErrorMessage, file_name);
+    return false;
+  }
+  const int64_t data_offset = static_cast<int64_t>(header_offset);
+  const char* data = library->file.GetData() + data_offset;
+  const int sample_data_type = static_cast<int>(data_type);
+  const int sample_count = static_cast<int>(num_samples);
+  const bool swap_byte_order = util::IsHostBigEndian() != (byte_order == 1.0);
+  const double scale = 1.0 / scale_factor;
+  library->read_spectrum = [=](const int spectrum_index, double* values) {
+    ConvertENVISamples(
+        sample_data_type, data + spectrum_index * spectrum_num_bytes,
+        sample_count, swap_byte_order, scale, values);
+    if (is_reversed) {
+      std::reverse(values, values + sample_count);
+    }
+  };
+  return true;
+}
+
+bool SpectralLibraryLoader::ReadASCIILibrary(
+    const QString& file_name, LibraryData* library) {
+
+  if (!library->file.Open(file_name)) {
+    error_message_ = util::ReplaceTextSubPlaceholder(
+        kFileNotOpenErrorMessage, file_name);
+    return false;
+  }
+  // Each row holds a wavelength followed by one value per spectrum. Rows are
+  // parsed straight from the mapped file.
+  const char* position = library->file.GetData();
+  const char* const file_end = position + library->file.GetSize();
+  int num_columns = 0;
+  int line_number = 0;
+  std::vector<double>& wavelengths = library->wavelengths;
+  std::vector<double>& table = library->table;
+  while (position < file_end) {
+    ++line_number;
+    const char* line_end = static_cast<const char*>(
+        std::memchr(position, '\n', file_end - position));
+    if (line_end == nullptr) {
+      line_end = file_end;
+    }
+    while (position < line_end && IsColumnSeparator(*position)) {
+      ++position;
+    }
+    // Lines that do not start with a number are headers or comments.
+    double wavelength = 0.0;
+    if (!ParseNumber(&position, line_end, &wavelength)) {
+      position = line_end + 1;
+      continue;
+    }
+    wavelengths.push_back(wavelength);
+    int line_num_columns = 0;
+    while (true) {
+      while (position < line_end && IsColumnSeparator(*position)) {
+        ++position;
+      }
+      double value = 0.0;
+      if (!ParseNumber(&position, line_end, &value)) {
+        break;
+      }
+      table.push_back(value);
+      ++line_num_columns;
+    }
+    if (num_columns == 0) {
+      num_columns = line_num_columns;
+    }
+    if (position != line_end || line_num_columns != num_columns ||
+        num_columns == 0) {
+      error_message_ = util::ReplaceTextSubPlaceholder(
+          kInvalidLineErrorMessage, QString::number(line_number));
+      return false;
+    }
+    position = line_end + 1;
+  }
+  bool is_reversed = false;
+  if (!SortWavelengths(&wavelengths, &is_reversed)) {
+    error_message_ = kInvalidWavelengthsErrorMessage;
+    return false;
+  }
+
+  // A single spectrum is named after the file, and each of several spectra
+  // after its column.
+  const QString base_name = QFileInfo(file_name).completeBaseName();
+  library->names.resize(num_columns);
+  for (int i = 0; i < num_columns; ++i) {
+    library->names[i] = (num_columns == 1)
+        ? base_name : base_name + " " + QString::number(i + 1);
+  }
+  const int num_rows = wavelengths.size();
+  const double* table_data = table.data();
+  library->read_spectrum = [=](const int spectrum_index, double* values) {
+    for (int row = 0; row < num_rows; ++row) {
+      const int file_row = is_reversed ? (num_rows - 1 - row) : row;
+      values[row] = table_data[file_row * num_columns + spectrum_index];
+    }
+  };
+  return true;
+}
+
+}  // namespace hsi_data_generator
@@ -0,0 +1,101 @@
+// The SpectralLibraryLoader imports measured spectra from spectral library
+// files. Each spectrum is resampled to the current number of bands and added
+// to the spectral dictionary as a tabulated spectrum (see
+// Spectrum::SetTabulatedValues()), alongside the peak-defined spectra.
+//
+// Two formats are supported:
+//  - ENVI spectral libraries (*.sli), with their header in "<name>.hdr" or
+//    "<name>.sli.hdr". Every spectrum of the library is imported.
+//  - ASCII tables, where the first column is the wavelength and each other
+//    column is a spectrum (so a two-column file holds a single spectrum).
+//    Columns can be separated by whitespace, commas, or semicolons, and lines
+//    that do not start with a number (e.g. headers) are skipped.
+//
+// The spectrum's wavelengths are mapped onto its normalized range in the same
+// way as SpectralBands: the first wavelength is at 0, and the range spans one
+// average sample spacing past the last wavelength.
+
+#ifndef SRC_HSI_SPECTRAL_LIBRARY_LOADER_H_
+#define SRC_HSI_SPECTRAL_LIBRARY_LOADER_H_
+
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+#include "hsi/spectrum.h"
+
+namespace hsi_data_generator {
+
+// How the imported spectra are interpolated at the band positions.
+enum SpectralResamplingMethod {
+  SPECTRAL_RESAMPLING_LINEAR,
+
+  // Cubic Hermite interpolation, with the slope at each sample estimated from
+  // its neighbors. This is smoother than linear interpolation, but can
+  // overshoot slightly near sharp features.
+  SPECTRAL_RESAMPLING_CUBIC
+};
+
+class SpectralLibraryLoader {
+ public:
+  // Imported spectra are appended to the given spectra, resampled to the
+  // given number of bands.
+  SpectralLibraryLoader(
+      std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra,
+      const int num_bands)
+      : spectra_(spectra),
+        num_bands_(num_bands),
+        resampling_method_(SPECTRAL_RESAMPLING_LINEAR),
+        num_loaded_spectra_(0) {}
+
+  // Sets the interpolation method. Linear interpolation is the default.
+  void SetResamplingMethod(const SpectralResamplingMethod resampling_method) {
+    resampling_method_ = resampling_method;
+  }
+
+  // Loads all of the spectra in the given library file. The format is chosen
+  // by the file's extension: "sli" files are ENVI spectral libraries, and
+  // anything else is read as an ASCII table. The file is memory-mapped, and
+  // the spectra are resampled on all cores.
+  //
+  // Returns true on success. Nothing is added to the spectra on failure.
+  bool LoadLibraryFromFile(const QString& file_name);
+
+  // Returns the number of spectra added by the last successful call to
+  // LoadLibraryFromFile().
+  int GetNumLoadedSpectra() const {
+    return num_loaded_spectra_;
+  }
+
+  // Returns any error message caused by LoadLibraryFromFile(). If no errors
+  // were logged, returns a generic error string.
+  QString GetErrorMessage() const;
+
+ private:
+  // The measured spectra of a library, before they are resampled (defined in
+  // the source file).
+  struct LibraryData;
+
+  // Parse the given file into the library data. Each returns false (and sets
+  // the error message) if the file could not be read.
+  bool ReadENVILibrary(const QString& file_name, LibraryData* library);
+  bool ReadASCIILibrary(const QString& file_name, LibraryData* library);
+
+  // The spectral dictionary that imported spectra are added to.
+  std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra_;
+
+  // The number of bands that imported spectra are resampled to.
+  const int num_bands_;
+
+  SpectralResamplingMethod resampling_method_;
+
+  int num_loaded_spectra_;
+
+  // This error message is logged if the import fails.
+  QString error_message_;
+};
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_SPECTRAL_LIBRARY_LOADER_H_
@@ -0,0 +1,204 @@
+#include "hsi/spectral_lines.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "hsi/spectrum_kernels.h"
+#include "util/fft.h"
+
+namespace hsi_data_generator {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Lines are evaluated within this many standard deviations of their center,
+// beyond which they are below 1e-12 of their amplitude.
+constexpr double kNumLineSigmas = 7.5;
+
+// The fine grid has at least this many points per standard deviation of the
+// lines' width.
+constexpr double kGridPointsPerSigma = 2.0;
+
+// Each line is first spread onto the fine grid as a Gaussian with this
+// standard deviation (in grid points), which is wide enough to be sampled
+// without aliasing. The FFT convolution then adds the rest of the width.
+constexpr double kSpreadSigmaInGridPoints = 2.0;
+
+// Lines that are spread with the recurrence in SpreadLine() cost about this
+// fraction of evaluating one exp() per point, and each point of the FFT costs
+// about this many exp() evaluations per level (of both transforms). These are
+// only used to choose the faster way of adding the lines.
+constexpr double kRelativeSpreadPointCost = 0.25;
+constexpr double kRelativeFFTPointCost = 1.0;
+
+// The largest fine grid. Wider lines need more points than this only when
+// there are very many bands, and those are added directly instead.
+constexpr int kMaxGridSize = 1 << 22;
+
+// Adds each line as a Gaussian peak over the bands within its support.
+void AddSpectralLinesDirectly(
+    const SpectralLines& lines, const int num_bands, double* values) {
+
+  std::vector<double> band_positions(num_bands);
+  for (int band = 0; band < num_bands; ++band) {
+    band_positions[band] = static_cast<double>(band) / num_bands;
+  }
+  const double radius = kNumLineSigmas * std::sqrt(lines.width);
+  const int num_lines = lines.positions.size();
+  for (int i = 0; i < num_lines; ++i) {
+    const double position = lines.positions[i];
+    const int first_band = std::max(
+        static_cast<int>(std::ceil((position - radius) * num_bands)), 0);
+    const int end_band = std::min(
+        static_cast<int>(std::floor((position + radius) * num_bands)) + 1,
+        num_bands);
+    if (first_band >= end_band) {
+      continue;
+    }
+    AddGaussianPeak(
+        position, lines.amplitudes[i], lines.width,
+        band_positions.data() + first_band, end_band - first_band,
+        values + first_band);
+  }
+}
+
+// Adds a Gaussian line with the given standard deviation (in grid points) to
+// the grid, centered at the given (fractional) grid index. Consecutive points
+// of a Gaussian differ by a ratio that itself changes by a constant factor, so
+// only three exp() calls are needed per line.
+void SpreadLine(
+    const double center,
+    const double amplitude,
+    const double sigma,
+    std::vector<std::complex<double>>* grid) {
+
+  const int grid_size = grid->size();
+  const double radius = kNumLineSigmas * sigma;
+  const int first_index =
+      std::max(static_cast<int>(std::ceil(center - radius)), 0);
+  const int end_index = std::min(
+      static_cast<int>(std::floor(center + radius)) + 1, grid_size);
+  if (first_index >= end_index) {
+    return;
+  }
+  const double inverse_two_variance = 0.5 / (sigma * sigma);
+  const double offset = first_index - center;
+  double value = amplitude * std::exp(-offset * offset * inverse_two_variance);
+  double ratio = std::exp(-(2.0 * offset + 1.0) * inverse_two_variance);
+  const double ratio_factor = std::exp(-2.0 * inverse_two_variance);
+  for (int index = first_index; index < end_index; ++index) {
+    (*grid)[index] += value;
+    value *= ratio;
+    ratio *= ratio_factor;
+  }
+}
+
+// The fine grid used to broaden the lines with an FFT: grid point n is at the
+// normalized position (n - padding) * spacing, and band i is grid point
+// padding + i * oversampling.
+struct LineGrid {
+  int oversampling;
+  int padding;
+  int size;
+  double spacing;
+};
+
+// Returns the fine grid for the lines' width, or false if it would be too
+// large. The padding keeps the FFT's circular convolution from wrapping lines
+// from one end of the spectrum to the other.
+bool GetLineGrid(
+    const double sigma, const int num_bands, LineGrid* grid) {
+
+  const double oversampling =
+      std::max(std::ceil(kGridPointsPerSigma / (sigma * num_bands)), 1.0);
+  const double padding =
+      std::ceil(kNumLineSigmas * sigma * num_bands * oversampling);
+  if (num_bands * oversampling + 2.0 * padding > kMaxGridSize) {
+    return false;
+  }
+  grid->oversampling = static_cast<int>(oversampling);
+  grid->padding = static_cast<int>(padding);
+  grid->size = util::GetFFTSize(
+      num_bands * grid->oversampling + 2 * grid->padding);
+  grid->spacing = 1.0 / (num_bands * oversampling);
+  return true;
+}
+
+// Spreads the lines onto the fine grid as narrow Gaussians, and then
+// convolves the grid with the Gaussian that broadens them to their full width.
+// Since the convolution of two Gaussians is a Gaussian whose variance is the
+// sum of theirs, this is exact up to the (negligible) aliasing of the narrow
+// Gaussians.
+void AddSpectralLinesWithFFT(
+    const SpectralLines& lines,
+    const int num_bands,
+    const LineGrid& line_grid,
+    double* values) {
+
+  const double sigma = std::sqrt(lines.width);
+  const double spread_sigma = kSpreadSigmaInGridPoints * line_grid.spacing;
+  std::vector<std::complex<double>> grid(line_grid.size);
+  const int num_lines = lines.positions.size();
+  for (int i = 0; i < num_lines; ++i) {
+    const double center =
+        lines.positions[i] / line_grid.spacing + line_grid.padding;
+    SpreadLine(center, lines.amplitudes[i], kSpreadSigmaInGridPoints, &grid);
+  }
+
+  // The remaining variance is added by multiplying each frequency with the
+  // Fourier transform of a Gaussian with an area of 1.
+  const double remaining_variance =
+      std::max(lines.width - spread_sigma * spread_sigma, 0.0);
+  util::FFT(false, &grid);
+  const double frequency_step =
+      2.0 * kPi / (line_grid.size * line_grid.spacing);
+  for (int k = 0; k < line_grid.size; ++k) {
+    const int signed_k = (k <= line_grid.size / 2) ? k : k - line_grid.size;
+    const double frequency = signed_k * frequency_step;
+    grid[k] *= std::exp(-0.5 * frequency * frequency * remaining_variance);
+  }
+  util::FFT(true, &grid);
+
+  // Convolving with an area of 1 keeps each line's area, so the amplitude is
+  // rescaled by the ratio of the widths. The inverse FFT is not normalized.
+  const double scale = (sigma / spread_sigma) / line_grid.size;
+  for (int band = 0; band < num_bands; ++band) {
+    values[band] +=
+        grid[line_grid.padding + band * line_grid.oversampling].real() * scale;
+  }
+}
+
+}  // namespace
+
+void AddSpectralLines(
+    const SpectralLines& lines, const int num_bands, double* values) {
+
+  const int num_lines = lines.positions.size();
+  if (num_lines == 0 || num_bands <= 0) {
+    return;
+  }
+  // Infinitely thin lines can only be added directly.
+  const double sigma = std::sqrt(std::max(lines.width, 0.0));
+  LineGrid line_grid;
+  if (sigma == 0.0 || !GetLineGrid(sigma, num_bands, &line_grid)) {
+    AddSpectralLinesDirectly(lines, num_bands, values);
+    return;
+  }
+  // Compare the estimated costs, in exp() evaluations.
+  const double direct_cost =
+      num_lines * (2.0 * kNumLineSigmas * sigma * num_bands + 1.0);
+  const double fft_cost =
+      num_lines * (3.0 + kRelativeSpreadPointCost * 2.0 * kNumLineSigmas *
+                             kSpreadSigmaInGridPoints) +
+      kRelativeFFTPointCost * 2.0 * line_grid.size *
+          std::log2(static_cast<double>(line_grid.size));
+  if (direct_cost <= fft_cost) {
+    AddSpectralLinesDirectly(lines, num_bands, values);
+  } else {
+    AddSpectralLinesWithFFT(lines, num_bands, line_grid, values);
+  }
+}
+
+}  // namespace hsi_data_generator
@@ -0,0 +1,43 @@
+// SpectralLines are a list of narrow lines that are all broadened by the same
+// Gaussian, such as the absorption lines of a gas. A spectrum can hold
+// thousands of lines (see Spectrum::SetSpectralLines()), which would be slow
+// to evaluate one peak at a time. Instead, the lines are placed on a fine grid
+// and broadened all at once with an FFT convolution, so the cost barely
+// depends on the number of lines.
+
+#ifndef SRC_HSI_SPECTRAL_LINES_H_
+#define SRC_HSI_SPECTRAL_LINES_H_
+
+#include <vector>
+
+namespace hsi_data_generator {
+
+struct SpectralLines {
+  SpectralLines() : width(0) {}
+
+  bool IsEmpty() const {
+    return positions.empty();
+  }
+
+  // The normalized position (between 0 and 1) and amplitude of each line.
+  // Both lists have the same size.
+  std::vector<double> positions;
+  std::vector<double> amplitudes;
+
+  // The variance of the Gaussian that every line is broadened by, in the same
+  // units as PeakDistribution::width. Each broadened line has its amplitude
+  // as its maximum. A width of 0 makes the lines infinitely thin.
+  double width;
+};
+
+// Adds the broadened lines, sampled at the positions of the given number of
+// bands (band i is at i / num_bands), to the values. The lines are either
+// added one at a time over the bands near them, or all at once on a fine grid
+// with an FFT convolution, whichever is estimated to be faster. Both give the
+// same values up to rounding errors.
+void AddSpectralLines(
+    const SpectralLines& lines, const int num_bands, double* values);
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_SPECTRAL_LINES_H_
@@ -0,0 +1,247 @@
+#include "hsi/spectral_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "hsi/spectral_bands.h"
+#include "hsi/spectrum.h"
+#include "hsi/spectrum_table.h"
+#include "util/parallel_for.h"
+#include "util/util.h"
+
+namespace hsi_data_generator {
+namespace {
+
+// Each band's response function is truncated at this many standard
+// deviations from its center.
+constexpr double kNumResponseSigmas = 6.0;
+
+// Converts a full width at half maximum into the standard deviation of a
+// Gaussian.
+const double kFWHMToSigma = 1.0 / (2.0 * std::sqrt(2.0 * std::log(2.0)));
+
+// The master bands are spaced so that the narrowest feature (a sensor band's
+// response function or a spectrum peak) gets this many samples per standard
+// deviation.
+constexpr int kNumMasterSamplesPerSigma = 4;
+
+// The size of the blocks that the resampling is split into. A block of
+// spectra keeps the master rows that neighboring sensor bands share in cache,
+// and the band blocks give every thread work even for small dictionaries.
+constexpr int kNumSpectraPerBlock = 512;
+constexpr int kNumBandsPerBlock = 32;
+
+// Finds the range of wavelengths covered by the response functions of all of
+// the given sensors' bands. Returns false if there are no bands.
+bool GetMasterWavelengthRange(
+    const std::vector<SpectralBands>& sensor_bands,
+    double* min_wavelength,
+    double* max_wavelength) {
+
+  *min_wavelength = std::numeric_limits<double>::max();
+  *max_wavelength = std::numeric_limits<double>::lowest();
+  for (const SpectralBands& bands : sensor_bands) {
+    for (int band = 0; band < bands.GetNumBands(); ++band) {
+      const double response_radius =
+          kNumResponseSigmas * kFWHMToSigma * bands.GetFWHMs()[band];
+      const double center_wavelength = bands.GetCenterWavelengths()[band];
+      *min_wavelength =
+          std::min(center_wavelength - response_radius, *min_wavelength);
+      *max_wavelength =
+          std::max(center_wavelength + response_radius, *max_wavelength);
+    }
+  }
+  return *min_wavelength <= *max_wavelength;
+}
+
+}  // namespace
+
+int GetNumMasterBands(
+    const std::vector<SpectralBands>& sensor_bands,
+    const std::vector<std::shared_ptr<Spectrum>>& spectra) {
+
+  double min_wavelength = 0.0;
+  double max_wavelength = 0.0;
+  if (!GetMasterWavelengthRange(
+          sensor_bands, &min_wavelength, &max_wavelength)) {
+    return util::kMinNumberOfBands;
+  }
+  // Bands and peaks with no width are not averaged over, so they don't need
+  // to be resolved.
+  double min_sigma = std::numeric_limits<double>::max();
+  for (const SpectralBands& bands : sensor_bands) {
+    for (const double fwhm : bands.GetFWHMs()) {
+      if (fwhm > 0.0) {
+        min_sigma = std::min(kFWHMToSigma * fwhm, min_sigma);
+      }
+    }
+  }
+  const double spectrum_span = sensor_bands.front().GetMaxWavelength() -
+      sensor_bands.front().GetMinWavelength();
+  for (const std::shared_ptr<Spectrum>& spectrum : spectra) {
+    for (const PeakDistribution& peak : spectrum->GetPeaks()) {
+      double peak_sigma = std::sqrt(std::max(peak.width, 0.0));
+      if (peak.shape == PEAK_SHAPE_ASYMMETRIC_GAUSSIAN) {
+        peak_sigma *= 1.0 - std::fabs(peak.shape_parameter);
+      }
+      if (peak_sigma > 0.0) {
+        min_sigma = std::min(peak_sigma * spectrum_span, min_sigma);
+      }
+    }
+    // Tabulated values are interpolated linearly between evenly spaced
+    // samples, so the master bands must resolve each of those segments.
+    const int num_tabulated_values = spectrum->GetTabulatedValues().size();
+    if (num_tabulated_values > 0) {
+      min_sigma = std::min(spectrum_span / num_tabulated_values, min_sigma);
+    }
+    const SpectralLines& lines = spectrum->GetSpectralLines();
+    if (!lines.IsEmpty() && lines.width > 0.0) {
+      min_sigma = std::min(std::sqrt(lines.width) * spectrum_span, min_sigma);
+    }
+  }
+  const double master_spacing = min_sigma / kNumMasterSamplesPerSigma;
+  const double num_master_bands =
+      std::ceil((max_wavelength - min_wavelength) / master_spacing) + 1.0;
+  return std::max(
+      util::kMinNumberOfBands,
+      static_cast<int>(std::min(
+          num_master_bands, static_cast<double>(util::kMaxNumberOfBands))));
+}
+
+SpectralBands GetMasterBands(
+    const std::vector<SpectralBands>& sensor_bands,
+    const int num_master_bands) {
+
+  SpectralBands master_bands;
+  double min_wavelength = 0.0;
+  double max_wavelength = 0.0;
+  if (!GetMasterWavelengthRange(
+          sensor_bands, &min_wavelength, &max_wavelength)) {
+    return master_bands;
+  }
+  master_bands.SetWavelengthRange(
+      sensor_bands.front().GetMinWavelength(),
+      sensor_bands.front().GetMaxWavelength());
+  const double master_spacing = (num_master_bands > 1) ?
+      (max_wavelength - min_wavelength) / (num_master_bands - 1) : 0.0;
+  for (int m = 0; m < num_master_bands; ++m) {
+    if (!master_bands.AddBand(min_wavelength + m * master_spacing, 0.0)) {
+      // All of the sensors' bands are at the same wavelength.
+      break;
+    }
+  }
+  return master_bands;
+}
+
+SpectralResampler::SpectralResampler(
+    const SpectralBands& bands, const SpectralBands& master_bands)
+    : num_master_bands_(master_bands.GetNumBands()) {
+
+  const std::vector<double>& master_wavelengths =
+      master_bands.GetCenterWavelengths();
+  const double master_start = master_wavelengths.front();
+  const double master_spacing = (num_master_bands_ > 1) ?
+      (master_wavelengths.back() - master_start) / (num_master_bands_ - 1) :
+      0.0;
+  const int last_master_band = num_master_bands_ - 1;
+  const int num_bands = bands.GetNumBands();
+  first_master_bands_.resize(num_bands);
+  weight_offsets_.push_back(0);
+  for (int band = 0; band < num_bands; ++band) {
+    const double wavelength = bands.GetCenterWavelengths()[band];
+    const double response_sigma = kFWHMToSigma * bands.GetFWHMs()[band];
+    const int num_weights = weights_.size();
+    if (master_spacing > 0.0 && response_sigma >= master_spacing) {
+      const double radius = kNumResponseSigmas * response_sigma;
+      const int start_master_band = std::max(0, static_cast<int>(
+          std::ceil((wavelength - radius - master_start) / master_spacing)));
+      const int end_master_band = std::min(last_master_band, static_cast<int>(
+          std::floor((wavelength + radius - master_start) / master_spacing)));
+      double total_weight = 0.0;
+      for (int m = start_master_band; m <= end_master_band; ++m) {
+        const double offset = master_wavelengths[m] - wavelength;
+        const double weight = std::exp(
+            -0.5 * offset * offset / (response_sigma * response_sigma));
+        weights_.push_back(weight);
+        total_weight += weight;
+      }
+      if (total_weight > 0.0) {
+        const int end_weight = weights_.size();
+        for (int i = num_weights; i < end_weight; ++i) {
+          weights_[i] /= total_weight;
+        }
+        first_master_bands_[band] = start_master_band;
+        weight_offsets_.push_back(weights_.size());
+        continue;
+      }
+      // The response function is entirely outside of the master grid, so the
+      // band falls back to the nearest sample below.
+      weights_.resize(num_weights);
+    }
+    if (num_master_bands_ < 2) {
+      first_master_bands_[band] = 0;
+      weights_.push_back(1.0);
+      weight_offsets_.push_back(weights_.size());
+      continue;
+    }
+    const double master_index = std::min(
+        std::max((wavelength - master_start) / master_spacing, 0.0),
+        static_cast<double>(last_master_band));
+    const int lower_master_band =
+        std::min(static_cast<int>(master_index), last_master_band - 1);
+    const double fraction = master_index - lower_master_band;
+    first_master_bands_[band] = lower_master_band;
+    weights_.push_back(1.0 - fraction);
+    weights_.push_back(fraction);
+    weight_offsets_.push_back(weights_.size());
+  }
+}
+
+SpectrumTable<double> SpectralResampler::Resample(
+    const SpectrumTable<double>& master_table,
+    const int num_threads) const {
+
+  const int num_spectra = master_table.GetNumSpectra();
+  const int num_bands = GetNumBands();
+  SpectrumTable<double> table(num_spectra, num_bands);
+  // Both tables are band-major, so each sensor band's row is a weighted sum
+  // of whole master rows, which vectorizes over the spectra.
+  const int num_spectrum_blocks =
+      (num_spectra + kNumSpectraPerBlock - 1) / kNumSpectraPerBlock;
+  const int num_band_blocks =
+      (num_bands + kNumBandsPerBlock - 1) / kNumBandsPerBlock;
+  util::ParallelFor(
+      num_spectrum_blocks * num_band_blocks,
+      num_threads,
+      [&](const int task_index, const int thread_index) {
+        const int start_spectrum =
+            (task_index % num_spectrum_blocks) * kNumSpectraPerBlock;
+        const int block_num_spectra =
+            std::min(kNumSpectraPerBlock, num_spectra - start_spectrum);
+        const int start_band =
+            (task_index / num_spectrum_blocks) * kNumBandsPerBlock;
+        const int end_band =
+            std::min(start_band + kNumBandsPerBlock, num_bands);
+        for (int band = start_band; band < end_band; ++band) {
+          double* values = table.GetMutableBandValues(band) + start_spectrum;
+          for (int i = weight_offsets_[band]; i < weight_offsets_[band + 1];
+               ++i) {
+            const double weight = weights_[i];
+            const int master_band =
+                first_master_bands_[band] + i - weight_offsets_[band];
+            const double* master_values =
+                master_table.GetBandValues(master_band) + start_spectrum;
+            for (int s = 0; s < block_num_spectra; ++s) {
+              values[s] += weight * master_values[s];
+            }
+          }
+        }
+        return true;
+      });
+  return table;
+}
+
+}  // namespace hsi_data_generator
@@ -0,0 +1,77 @@
+// The SpectralResampler converts spectra generated on a fine, evenly spaced
+// master grid into the bands of a sensor (see SpectralBands). This makes it
+// cheap to export the same spectral dictionary for many sensors: every
+// spectrum is generated once at the master resolution, and each sensor only
+// applies its own resampling matrix to the whole dictionary at once.
+
+#ifndef SRC_HSI_SPECTRAL_RESAMPLER_H_
+#define SRC_HSI_SPECTRAL_RESAMPLER_H_
+
+#include <memory>
+#include <vector>
+
+#include "hsi/spectral_bands.h"
+#include "hsi/spectrum.h"
+#include "hsi/spectrum_table.h"
+
+namespace hsi_data_generator {
+
+// Returns the number of master bands (see GetMasterBands()) that samples the
+// narrowest response function of the given sensors' bands, the narrowest peak
+// of the given spectra, and the spacing of their tabulated values finely
+// enough for resampling to be accurate. The result is limited to
+// util::kMaxNumberOfBands.
+int GetNumMasterBands(
+    const std::vector<SpectralBands>& sensor_bands,
+    const std::vector<std::shared_ptr<Spectrum>>& spectra);
+
+// Returns num_master_bands evenly spaced bands with no width (i.e. point
+// samples) that cover the response functions of all of the given sensors'
+// bands. The sensors must share a wavelength range, which the master bands
+// use as well, so that the master spectra are the same spectra that the
+// sensors see.
+SpectralBands GetMasterBands(
+    const std::vector<SpectralBands>& sensor_bands,
+    const int num_master_bands);
+
+class SpectralResampler {
+ public:
+  // Builds the resampling matrix from the given master bands (which must be
+  // evenly spaced point samples, see GetMasterBands()) to the given sensor
+  // bands. Each sensor band averages the master samples under its Gaussian
+  // response function. Bands that are narrower than the master sample spacing
+  // interpolate linearly between the nearest samples instead.
+  SpectralResampler(
+      const SpectralBands& bands, const SpectralBands& master_bands);
+
+  int GetNumBands() const {
+    return first_master_bands_.size();
+  }
+
+  int GetNumMasterBands() const {
+    return num_master_bands_;
+  }
+
+  // Resamples every spectrum of the given master table (which must have
+  // GetNumMasterBands() bands) into a table with the sensor's bands. The
+  // spectra are processed in blocks on up to num_threads threads (all cores
+  // if less than 1).
+  SpectrumTable<double> Resample(
+      const SpectrumTable<double>& master_table,
+      const int num_threads = 0) const;
+
+ private:
+  const int num_master_bands_;
+
+  // The resampling matrix is banded, so only the weights of a contiguous
+  // range of master bands are stored for each sensor band: band b's weights
+  // are weights_[weight_offsets_[b] ... weight_offsets_[b + 1] - 1], for the
+  // master bands starting at first_master_bands_[b].
+  std::vector<int> first_master_bands_;
+  std::vector<int> weight_offsets_;
+  std::vector<double> weights_;
+};
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_SPECTRAL_RESAMPLER_H_
@@ -4,12 +4,14 @@
 #include <QString>
 #include <QtDebug>
 
-#include <math.h>
-
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
 #include <vector>
 
+#include "hsi/spectrum_kernels.h"
+
 namespace hsi_data_generator {
 namespace {
 
@@ -18,6 +20,32 @@ static const QColor kDefaultSpectrumColor = Qt::black;
 
 constexpr int kNumColorValues = 255;
 
+// The number of peak changes that can be applied incrementally to the
+// accumulated spectrum before it is regenerated from scratch. This bounds the
+// rounding error that builds up from repeatedly subtracting and adding peaks.
+constexpr int kMaxNumIncrementalUpdates = 256;
+
+// The names of the peak shapes (see GetPeakShapeName()).
+static const QString kGaussianPeakShapeName = "gaussian";
+static const QString kLorentzianPeakShapeName = "lorentzian";
+static const QString kPseudoVoigtPeakShapeName = "pseudo_voigt";
+static const QString kAsymmetricGaussianPeakShapeName = "asymmetric_gaussian";
+
+// Lorentzian peaks (which have no closed form) are integrated against a band's
+// response function by sampling it out to this many of its standard deviations,
+// with samples spaced by a fraction of the narrower of the band's and the
+// peak's widths. The number of samples per band is capped, which only limits
+// the accuracy for peaks that are much narrower than the band.
+constexpr double kNumResponseSigmas = 6.0;
+constexpr int kNumResponseSamplesPerSigma = 4;
+constexpr int kMaxNumResponseSamples = 4096;
+
+// The largest valid asymmetry of an asymmetric Gaussian peak. Larger values
+// would make one side of the peak infinitely thin.
+constexpr double kMaxPeakAsymmetry = 0.95;
+
+constexpr double kPi = 3.14159265358979323846;
+
 QColor GetRandomColor() {
   const int rand_red = qrand() % kNumColorValues;
   const int rand_green = qrand() % kNumColorValues;
@@ -25,24 +53,672 @@ QColor GetRandomColor() {
   return QColor(rand_red, rand_green, rand_blue);
 }
 
-// Returns the value at the given point in the Gaussian distribution defined by
-// the given mean and variance.
-// See https://en.wikipedia.org/wiki/Normal_distribution for the equation.
-double GetNormalDistributionValue(
-    const double x, const double mean, const double variance) {
+// Fills the normalized x-position (between 0 and 1) of each band.
+void GetBandPositions(const int num_bands, std::vector<double>* positions) {
+  positions->resize(num_bands);
+  for (int band = 0; band < num_bands; ++band) {
+    (*positions)[band] =
+        static_cast<double>(band) / static_cast<double>(num_bands);
+  }
+}
+
+// Returns the tabulated values linearly interpolated at the given normalized
+// position. Positions beyond the first or last tabulated sample get the value
+// of that sample. The values must not be empty.
+double InterpolateTabulatedValue(
+    const std::vector<double>& tabulated_values, const double position) {
+
+  const int num_tabulated_values = tabulated_values.size();
+  const int last_index = num_tabulated_values - 1;
+  const double index = std::min(
+      std::max(position * num_tabulated_values, 0.0),
+      static_cast<double>(last_index));
+  const int lower_index = std::min(static_cast<int>(index), last_index);
+  const int upper_index = std::min(lower_index + 1, last_index);
+  const double fraction = index - lower_index;
+  return tabulated_values[lower_index] +
+      fraction * (tabulated_values[upper_index] -
+                  tabulated_values[lower_index]);
+}
+
+// Adds the tabulated values, linearly interpolated at each of the given
+// normalized positions, to the values (see InterpolateTabulatedValue()).
+void AddTabulatedValues(
+    const std::vector<double>& tabulated_values,
+    const std::vector<double>& positions,
+    double* values) {
+
+  if (tabulated_values.empty()) {
+    return;
+  }
+  const int num_positions = positions.size();
+  for (int i = 0; i < num_positions; ++i) {
+    values[i] += InterpolateTabulatedValue(tabulated_values, positions[i]);
+  }
+}
+
+// Returns the integral of a linear function over [start, end] against a
+// Gaussian response with the given center and standard deviation (which
+// integrates to 1 over all positions). The function has the given value at
+// start and the given slope.
+double IntegrateLinearSegmentResponse(
+    const double start,
+    const double end,
+    const double start_value,
+    const double slope,
+    const double center,
+    const double sigma) {
+
+  // In standard deviations from the center, the function is
+  // center_value + slope * sigma * z, and both terms integrate in closed form
+  // against the standard normal distribution.
+  const double start_z = (start - center) / sigma;
+  const double end_z = (end - center) / sigma;
+  const double center_value = start_value + slope * (center - start);
+  const double probability =
+      0.5 * (std::erfc(-end_z / std::sqrt(2.0)) -
+             std::erfc(-start_z / std::sqrt(2.0)));
+  const double first_moment =
+      (std::exp(-0.5 * start_z * start_z) - std::exp(-0.5 * end_z * end_z)) /
+      std::sqrt(2.0 * kPi);
+  return center_value * probability + slope * sigma * first_moment;
+}
+
+// Adds the tabulated values (interpolated as in AddTabulatedValues()) as they
+// are measured by bands with the given normalized positions and Gaussian
+// response variances. The interpolated values are piecewise linear, so each
+// segment is integrated against the response in closed form, out to
+// kNumResponseSigmas. Bands with no width sample the values at their center.
+void AddTabulatedValuesResponse(
+    const std::vector<double>& tabulated_values,
+    const std::vector<double>& positions,
+    const std::vector<double>& response_variances,
+    double* values) {
+
+  const int num_tabulated_values = tabulated_values.size();
+  if (num_tabulated_values == 0) {
+    return;
+  }
+  const int last_index = num_tabulated_values - 1;
+  const double last_position =
+      static_cast<double>(last_index) / num_tabulated_values;
+  // The response is truncated, so it is scaled to integrate to 1 over the
+  // truncated range.
+  const double response_scale =
+      1.0 / std::erf(kNumResponseSigmas / std::sqrt(2.0));
+  const int num_positions = positions.size();
+  for (int i = 0; i < num_positions; ++i) {
+    if (response_variances[i] <= 0.0) {
+      values[i] += InterpolateTabulatedValue(tabulated_values, positions[i]);
+      continue;
+    }
+    const double sigma = std::sqrt(response_variances[i]);
+    const double center = positions[i];
+    const double start = center - kNumResponseSigmas * sigma;
+    const double end = center + kNumResponseSigmas * sigma;
+    double response = 0.0;
+    // Before the first and after the last sample, the values are constant.
+    if (start < 0.0) {
+      response += IntegrateLinearSegmentResponse(
+          start, std::min(end, 0.0), tabulated_values.front(), 0.0, center,
+          sigma);
+    }
+    if (end > last_position) {
+      response += IntegrateLinearSegmentResponse(
+          std::max(start, last_position), end, tabulated_values.back(), 0.0,
+          center, sigma);
+    }
+    const int first_segment = static_cast<int>(std::max(
+        std::floor(start * num_tabulated_values), 0.0));
+    const int last_segment = static_cast<int>(std::min(
+        std::floor(end * num_tabulated_values),
+        static_cast<double>(last_index - 1)));
+    for (int segment = first_segment; segment <= last_segment; ++segment) {
+      const double segment_start =
+          static_cast<double>(segment) / num_tabulated_values;
+      const double segment_end =
+          static_cast<double>(segment + 1) / num_tabulated_values;
+      const double slope =
+          (tabulated_values[segment + 1] - tabulated_values[segment]) *
+          num_tabulated_values;
+      const double clipped_start = std::max(segment_start, start);
+      const double clipped_end = std::min(segment_end, end);
+      if (clipped_start < clipped_end) {
+        response += IntegrateLinearSegmentResponse(
+            clipped_start,
+            clipped_end,
+            tabulated_values[segment] +
+                slope * (clipped_start - segment_start),
+            slope,
+            center,
+            sigma);
+      }
+    }
+    values[i] += response * response_scale;
+  }
+}
 
-  const double part_1 = 1.0 / std::sqrt(2 * M_PI * variance);
+// The distances to the left and right of a peak's center beyond which it is
+// not evaluated (see Spectrum::SetPeakSupportCutoff()). Negative distances
+// mean that the peak can be skipped entirely.
+struct PeakSupport {
+  double left;
+  double right;
+};
 
-  const double x_mean = x - mean;
-  const double x_mean2 = x_mean * x_mean;
-  const double exponent = -x_mean2 / (2 * variance);
-  const double part_2 = std::exp(exponent);
+// Returns the support radius of a Gaussian with the given standard deviation
+// and amplitude. A negative radius means that the Gaussian is below the error
+// bound everywhere.
+double GetGaussianSupportRadius(
+    const double sigma,
+    const double amplitude,
+    const double max_num_sigmas,
+    const double max_error) {
 
-  return part_1 * part_2;
+  double radius = std::numeric_limits<double>::max();
+  if (max_error > 0.0) {
+    if (amplitude <= max_error) {
+      return -1.0;
+    }
+    radius = sigma * std::sqrt(2.0 * std::log(amplitude / max_error));
+  }
+  if (max_num_sigmas > 0.0) {
+    radius = std::min(radius, max_num_sigmas * sigma);
+  }
+  return radius;
+}
+
+// Same as GetGaussianSupportRadius(), for a Lorentzian with the given half
+// width. Its tails fall off much more slowly than a Gaussian's, so its
+// support is much wider for the same error bound. The sigma cutoff uses the
+// standard deviation of the Gaussian with the same width.
+double GetLorentzianSupportRadius(
+    const double half_width,
+    const double sigma,
+    const double amplitude,
+    const double max_num_sigmas,
+    const double max_error) {
+
+  double radius = std::numeric_limits<double>::max();
+  if (max_error > 0.0) {
+    if (amplitude <= max_error) {
+      return -1.0;
+    }
+    radius = half_width * std::sqrt(amplitude / max_error - 1.0);
+  }
+  if (max_num_sigmas > 0.0) {
+    radius = std::min(radius, max_num_sigmas * sigma);
+  }
+  return radius;
+}
+
+// Returns the standard deviation of the peak's Gaussian width.
+double GetPeakSigma(const PeakDistribution& peak) {
+  return std::sqrt(std::max(peak.width, 0.0));
+}
+
+// Returns the half width at half maximum of the peak, which is shared by all
+// of the peak shapes.
+double GetPeakHalfWidth(const PeakDistribution& peak) {
+  return GetPeakSigma(peak) * std::sqrt(2.0 * std::log(2.0));
+}
+
+// Clamps the given shape parameter into the valid range of the shape.
+double GetValidShapeParameter(
+    const PeakShape shape, const double shape_parameter) {
+
+  switch (shape) {
+  case PEAK_SHAPE_PSEUDO_VOIGT:
+    return std::min(std::max(shape_parameter, 0.0), 1.0);
+  case PEAK_SHAPE_ASYMMETRIC_GAUSSIAN:
+    return std::min(
+        std::max(shape_parameter, -kMaxPeakAsymmetry), kMaxPeakAsymmetry);
+  case PEAK_SHAPE_GAUSSIAN:
+  case PEAK_SHAPE_LORENTZIAN:
+  default:
+    return 0.0;
+  }
+}
+
+// Each peak shape provides a specialization of these two functions: one that
+// computes its support, and one that adds it (with the given amplitude) to
+// each value. Peaks are dispatched on their shape once (see
+// AddPeakOverSupport()), so the per-band loops never branch on the shape.
+template <PeakShape kPeakShape>
+PeakSupport GetPeakSupport(
+    const PeakDistribution& peak,
+    const double max_num_sigmas,
+    const double max_error);
+
+template <PeakShape kPeakShape>
+void AddShapedPeak(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const int num_values,
+    double* values);
+
+template <>
+PeakSupport GetPeakSupport<PEAK_SHAPE_GAUSSIAN>(
+    const PeakDistribution& peak,
+    const double max_num_sigmas,
+    const double max_error) {
+
+  const double radius = GetGaussianSupportRadius(
+      GetPeakSigma(peak), peak.amplitude, max_num_sigmas, max_error);
+  return {radius, radius};
+}
+
+template <>
+void AddShapedPeak<PEAK_SHAPE_GAUSSIAN>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  AddGaussianPeak(
+      peak.position, amplitude, peak.width, x_values, num_values, values);
+}
+
+template <>
+PeakSupport GetPeakSupport<PEAK_SHAPE_LORENTZIAN>(
+    const PeakDistribution& peak,
+    const double max_num_sigmas,
+    const double max_error) {
+
+  const double radius = GetLorentzianSupportRadius(
+      GetPeakHalfWidth(peak),
+      GetPeakSigma(peak),
+      peak.amplitude,
+      max_num_sigmas,
+      max_error);
+  return {radius, radius};
+}
+
+template <>
+void AddShapedPeak<PEAK_SHAPE_LORENTZIAN>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  AddLorentzianPeak(
+      peak.position,
+      amplitude,
+      GetPeakHalfWidth(peak),
+      x_values,
+      num_values,
+      values);
+}
+
+// The error bound is split evenly between the two components.
+template <>
+PeakSupport GetPeakSupport<PEAK_SHAPE_PSEUDO_VOIGT>(
+    const PeakDistribution& peak,
+    const double max_num_sigmas,
+    const double max_error) {
+
+  const double lorentzian_weight = peak.shape_parameter;
+  const double gaussian_radius = GetGaussianSupportRadius(
+      GetPeakSigma(peak),
+      (1.0 - lorentzian_weight) * peak.amplitude,
+      max_num_sigmas,
+      max_error / 2.0);
+  const double lorentzian_radius = GetLorentzianSupportRadius(
+      GetPeakHalfWidth(peak),
+      GetPeakSigma(peak),
+      lorentzian_weight * peak.amplitude,
+      max_num_sigmas,
+      max_error / 2.0);
+  const double radius = std::max(gaussian_radius, lorentzian_radius);
+  return {radius, radius};
+}
+
+template <>
+void AddShapedPeak<PEAK_SHAPE_PSEUDO_VOIGT>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  const double lorentzian_weight = peak.shape_parameter;
+  AddGaussianPeak(
+      peak.position,
+      (1.0 - lorentzian_weight) * amplitude,
+      peak.width,
+      x_values,
+      num_values,
+      values);
+  AddLorentzianPeak(
+      peak.position,
+      lorentzian_weight * amplitude,
+      GetPeakHalfWidth(peak),
+      x_values,
+      num_values,
+      values);
+}
+
+template <>
+PeakSupport GetPeakSupport<PEAK_SHAPE_ASYMMETRIC_GAUSSIAN>(
+    const PeakDistribution& peak,
+    const double max_num_sigmas,
+    const double max_error) {
+
+  const double asymmetry = peak.shape_parameter;
+  const double left_sigma = GetPeakSigma(peak) * (1.0 - asymmetry);
+  const double right_sigma = GetPeakSigma(peak) * (1.0 + asymmetry);
+  return {
+      GetGaussianSupportRadius(
+          left_sigma, peak.amplitude, max_num_sigmas, max_error),
+      GetGaussianSupportRadius(
+          right_sigma, peak.amplitude, max_num_sigmas, max_error)};
+}
+
+// The values left of the center get the narrower (or wider) Gaussian. The x
+// values are sorted, so the split is found with a binary search.
+template <>
+void AddShapedPeak<PEAK_SHAPE_ASYMMETRIC_GAUSSIAN>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  const double asymmetry = peak.shape_parameter;
+  const int num_left_values = std::lower_bound(
+      x_values, x_values + num_values, peak.position) - x_values;
+  const double left_scale = (1.0 - asymmetry) * (1.0 - asymmetry);
+  const double right_scale = (1.0 + asymmetry) * (1.0 + asymmetry);
+  AddGaussianPeak(
+      peak.position,
+      amplitude,
+      peak.width * left_scale,
+      x_values,
+      num_left_values,
+      values);
+  AddGaussianPeak(
+      peak.position,
+      amplitude,
+      peak.width * right_scale,
+      x_values + num_left_values,
+      num_values - num_left_values,
+      values + num_left_values);
+}
+
+// Adds (or subtracts, for a sign of -1) the given peak to the values, but
+// only over the bands within its support. The band positions must be
+// sorted.
+template <PeakShape kPeakShape>
+void AddPeakOverSupport(
+    const PeakDistribution& peak,
+    const double sign,
+    const double max_num_sigmas,
+    const double max_error,
+    const std::vector<double>& band_positions,
+    double* values) {
+
+  const PeakSupport support =
+      GetPeakSupport<kPeakShape>(peak, max_num_sigmas, max_error);
+  if (support.left < 0.0 || support.right < 0.0) {
+    return;
+  }
+  const int start_band = std::lower_bound(
+      band_positions.begin(),
+      band_positions.end(),
+      peak.position - support.left) - band_positions.begin();
+  const int end_band = std::upper_bound(
+      band_positions.begin() + start_band,
+      band_positions.end(),
+      peak.position + support.right) - band_positions.begin();
+  AddShapedPeak<kPeakShape>(
+      peak,
+      sign * peak.amplitude,
+      band_positions.data() + start_band,
+      end_band - start_band,
+      values + start_band);
+}
+
+// Returns the smallest standard deviation of any part of the peak, which
+// determines how finely it must be sampled.
+double GetPeakResolution(const PeakDistribution& peak) {
+  if (peak.shape == PEAK_SHAPE_ASYMMETRIC_GAUSSIAN) {
+    return GetPeakSigma(peak) * (1.0 - std::fabs(peak.shape_parameter));
+  }
+  return GetPeakSigma(peak);
+}
+
+// Adds the response of each band to the given peak (with the given
+// amplitude): the integral of the peak against the band's Gaussian response
+// function, which is centered at the band's x value with the given variance.
+// Bands with no variance sample the peak at their center.
+//
+// This version samples each band's response function and works for any peak
+// shape. Shapes with a closed form (all but the Lorentzian) specialize it.
+template <PeakShape kPeakShape>
+void AddShapedPeakResponse(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  const double peak_resolution = GetPeakResolution(peak);
+  std::vector<double> sample_positions;
+  std::vector<double> sample_weights;
+  std::vector<double> sample_values;
+  for (int i = 0; i < num_values; ++i) {
+    if (response_variances[i] <= 0.0) {
+      AddShapedPeak<kPeakShape>(peak, amplitude, x_values + i, 1, values + i);
+      continue;
+    }
+    const double response_sigma = std::sqrt(response_variances[i]);
+    double sample_spacing =
+        ((peak_resolution > 0.0) ?
+         std::min(response_sigma, peak_resolution) : response_sigma) /
+        kNumResponseSamplesPerSigma;
+    const double response_radius = kNumResponseSigmas * response_sigma;
+    const int num_half_samples = std::min(
+        std::ceil(response_radius / sample_spacing),
+        static_cast<double>(kMaxNumResponseSamples / 2));
+    sample_spacing = response_radius / num_half_samples;
+    const int num_samples = 2 * num_half_samples + 1;
+    sample_positions.resize(num_samples);
+    sample_weights.resize(num_samples);
+    sample_values.assign(num_samples, 0.0);
+    double total_weight = 0.0;
+    for (int j = 0; j < num_samples; ++j) {
+      const double offset = (j - num_half_samples) * sample_spacing;
+      sample_positions[j] = x_values[i] + offset;
+      sample_weights[j] =
+          std::exp(-0.5 * offset * offset / response_variances[i]);
+      total_weight += sample_weights[j];
+    }
+    AddShapedPeak<kPeakShape>(
+        peak,
+        amplitude,
+        sample_positions.data(),
+        num_samples,
+        sample_values.data());
+    double response = 0.0;
+    for (int j = 0; j < num_samples; ++j) {
+      response += sample_weights[j] * sample_values[j];
+    }
+    values[i] += response / total_weight;
+  }
+}
+
+template <>
+void AddShapedPeakResponse<PEAK_SHAPE_GAUSSIAN>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  AddGaussianPeakResponse(
+      peak.position,
+      amplitude,
+      peak.width,
+      x_values,
+      response_variances,
+      num_values,
+      values);
+}
+
+// Only the Lorentzian component needs to be integrated numerically.
+template <>
+void AddShapedPeakResponse<PEAK_SHAPE_PSEUDO_VOIGT>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  const double lorentzian_weight = peak.shape_parameter;
+  AddGaussianPeakResponse(
+      peak.position,
+      (1.0 - lorentzian_weight) * amplitude,
+      peak.width,
+      x_values,
+      response_variances,
+      num_values,
+      values);
+  AddShapedPeakResponse<PEAK_SHAPE_LORENTZIAN>(
+      peak,
+      lorentzian_weight * amplitude,
+      x_values,
+      response_variances,
+      num_values,
+      values);
+}
+
+// Returns the response of a band (with the given response variance, which
+// must be positive) to one half of a Gaussian with an amplitude of 1: the
+// left half (x < position) if left_half is true, or the right half otherwise.
+// The offset is the peak's position minus the band's center. The full
+// Gaussian's response is split between the halves by the normal CDF.
+double GetHalfGaussianResponse(
+    const double offset,
+    const double variance,
+    const double response_variance,
+    const bool left_half) {
+
+  if (variance <= 0.0) {
+    return 0.0;
+  }
+  const double total_variance = variance + response_variance;
+  const double response = std::sqrt(variance / total_variance) *
+      std::exp(-0.5 * offset * offset / total_variance);
+  const double z = std::sqrt(variance) * offset /
+      std::sqrt(2.0 * response_variance * total_variance);
+  return response * 0.5 * std::erfc(left_half ? -z : z);
+}
+
+// Each side of the peak is integrated in closed form. Unlike the symmetric
+// Gaussian, this needs erfc(), so it is not vectorized.
+template <>
+void AddShapedPeakResponse<PEAK_SHAPE_ASYMMETRIC_GAUSSIAN>(
+    const PeakDistribution& peak,
+    const double amplitude,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  const double asymmetry = peak.shape_parameter;
+  const double left_variance =
+      peak.width * (1.0 - asymmetry) * (1.0 - asymmetry);
+  const double right_variance =
+      peak.width * (1.0 + asymmetry) * (1.0 + asymmetry);
+  for (int i = 0; i < num_values; ++i) {
+    if (response_variances[i] <= 0.0) {
+      AddShapedPeak<PEAK_SHAPE_ASYMMETRIC_GAUSSIAN>(
+          peak, amplitude, x_values + i, 1, values + i);
+      continue;
+    }
+    const double offset = peak.position - x_values[i];
+    values[i] += amplitude * (
+        GetHalfGaussianResponse(
+            offset, left_variance, response_variances[i], true) +
+        GetHalfGaussianResponse(
+            offset, right_variance, response_variances[i], false));
+  }
+}
+
+// Same as AddPeakOverSupport(), but adds the response of sensor bands to the
+// peak. The support is widened by the widest band's response function.
+template <PeakShape kPeakShape>
+void AddPeakResponseOverSupport(
+    const PeakDistribution& peak,
+    const double max_num_sigmas,
+    const double max_error,
+    const std::vector<double>& band_positions,
+    const std::vector<double>& response_variances,
+    const double max_response_sigma,
+    double* values) {
+
+  const PeakSupport support =
+      GetPeakSupport<kPeakShape>(peak, max_num_sigmas, max_error);
+  const double response_radius = GetGaussianSupportRadius(
+      max_response_sigma, peak.amplitude, max_num_sigmas, max_error);
+  if (support.left < 0.0 || support.right < 0.0 || response_radius < 0.0) {
+    return;
+  }
+  const int start_band = std::lower_bound(
+      band_positions.begin(),
+      band_positions.end(),
+      peak.position - support.left - response_radius) - band_positions.begin();
+  const int end_band = std::upper_bound(
+      band_positions.begin() + start_band,
+      band_positions.end(),
+      peak.position + support.right + response_radius) -
+      band_positions.begin();
+  AddShapedPeakResponse<kPeakShape>(
+      peak,
+      peak.amplitude,
+      band_positions.data() + start_band,
+      response_variances.data() + start_band,
+      end_band - start_band,
+      values + start_band);
 }
 
 }  // namespace
 
+QString GetPeakShapeName(const PeakShape shape) {
+  switch (shape) {
+  case PEAK_SHAPE_LORENTZIAN:
+    return kLorentzianPeakShapeName;
+  case PEAK_SHAPE_PSEUDO_VOIGT:
+    return kPseudoVoigtPeakShapeName;
+  case PEAK_SHAPE_ASYMMETRIC_GAUSSIAN:
+    return kAsymmetricGaussianPeakShapeName;
+  case PEAK_SHAPE_GAUSSIAN:
+  default:
+    return kGaussianPeakShapeName;
+  }
+}
+
+bool GetPeakShapeFromName(const QString& name, PeakShape* shape) {
+  if (name == kGaussianPeakShapeName) {
+    *shape = PEAK_SHAPE_GAUSSIAN;
+  } else if (name == kLorentzianPeakShapeName) {
+    *shape = PEAK_SHAPE_LORENTZIAN;
+  } else if (name == kPseudoVoigtPeakShapeName) {
+    *shape = PEAK_SHAPE_PSEUDO_VOIGT;
+  } else if (name == kAsymmetricGaussianPeakShapeName) {
+    *shape = PEAK_SHAPE_ASYMMETRIC_GAUSSIAN;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 Spectrum::Spectrum() : spectrum_class_name_(kDefaultSpectrumName) {
   spectrum_class_color_ = GetRandomColor();
 }
@@ -54,11 +730,19 @@ Spectrum::Spectrum(const QString& spectrum_class_name)
 }
 
 void Spectrum::AddPeak(
-    const double position, const double amplitude, const double width) {
+    const double position,
+    const double amplitude,
+    const double width,
+    const PeakShape shape,
+    const double shape_parameter) {
 
   // We use UpdatePeak, which will automatically ensure the peak's values are
-  // within valid ranges.
-  spectral_peaks_.push_back(PeakDistribution());
+  // within valid ranges. The new peak has no amplitude until then, so its
+  // shape can be set directly.
+  PeakDistribution peak;
+  peak.shape = shape;
+  peak.shape_parameter = GetValidShapeParameter(shape, shape_parameter);
+  spectral_peaks_.push_back(peak);
   UpdatePeak(spectral_peaks_.size() - 1, position, amplitude, width);
 }
 
@@ -73,6 +757,10 @@ void Spectrum::UpdatePeak(
                << "must be between 0 and " << (spectral_peaks_.size() - 1);
     return;
   }
+  const bool update_accumulated_spectrum = CanUpdateAccumulatedSpectrum();
+  if (update_accumulated_spectrum) {
+    AddPeakToAccumulatedSpectrum(spectral_peaks_[peak_index], -1.0);
+  }
   if (new_position >= 0.0 && new_position <= 1.0) {
     spectral_peaks_[peak_index].position = new_position;
   }
@@ -82,6 +770,38 @@ void Spectrum::UpdatePeak(
   if (new_width >= 0.0 && new_width <= 1.0) {
     spectral_peaks_[peak_index].width = new_width;
   }
+  ++revision_;
+  if (update_accumulated_spectrum) {
+    AddPeakToAccumulatedSpectrum(spectral_peaks_[peak_index], 1.0);
+    accumulated_spectrum_revision_ = revision_;
+    ++num_incremental_updates_;
+  }
+}
+
+void Spectrum::SetPeakShape(
+    const int peak_index,
+    const PeakShape shape,
+    const double shape_parameter) {
+
+  const int num_peaks = spectral_peaks_.size();
+  if (peak_index < 0 || peak_index >= num_peaks) {
+    qWarning() << "Peak index " << peak_index << " is out of range: "
+               << "must be between 0 and " << (num_peaks - 1);
+    return;
+  }
+  const bool update_accumulated_spectrum = CanUpdateAccumulatedSpectrum();
+  if (update_accumulated_spectrum) {
+    AddPeakToAccumulatedSpectrum(spectral_peaks_[peak_index], -1.0);
+  }
+  spectral_peaks_[peak_index].shape = shape;
+  spectral_peaks_[peak_index].shape_parameter =
+      GetValidShapeParameter(shape, shape_parameter);
+  ++revision_;
+  if (update_accumulated_spectrum) {
+    AddPeakToAccumulatedSpectrum(spectral_peaks_[peak_index], 1.0);
+    accumulated_spectrum_revision_ = revision_;
+    ++num_incremental_updates_;
+  }
 }
 
 void Spectrum::DeletePeak(const int peak_index) {
@@ -90,38 +810,205 @@ void Spectrum::DeletePeak(const int peak_index) {
                << "must be between 0 and " << (spectral_peaks_.size() - 1);
     return;
   }
+  const bool update_accumulated_spectrum = CanUpdateAccumulatedSpectrum();
+  if (update_accumulated_spectrum) {
+    AddPeakToAccumulatedSpectrum(spectral_peaks_[peak_index], -1.0);
+  }
   spectral_peaks_.erase(spectral_peaks_.begin() + peak_index);
+  ++revision_;
+  if (update_accumulated_spectrum) {
+    accumulated_spectrum_revision_ = revision_;
+    ++num_incremental_updates_;
+  }
+}
+
+void Spectrum::SetTabulatedValues(const std::vector<double>& values) {
+  tabulated_values_ = values;
+  ++revision_;
+}
+
+void Spectrum::SetSpectralLines(const SpectralLines& lines) {
+  if (lines.positions.size() != lines.amplitudes.size()) {
+    qWarning() << "Spectral lines have " << lines.positions.size()
+               << " positions but " << lines.amplitudes.size()
+               << " amplitudes.";
+    return;
+  }
+  spectral_lines_ = lines;
+  ++revision_;
 }
 
 void Spectrum::Reset() {
   spectral_peaks_.clear();
+  tabulated_values_.clear();
+  spectral_lines_ = SpectralLines();
+  ++revision_;
 }
 
-std::vector<double> Spectrum::GenerateSpectrum(const int num_bands) const {
-  std::vector<double> spectrum(num_bands);
+void Spectrum::SetPeakSupportCutoff(
+    const double max_num_sigmas, const double max_error) {
+
+  peak_support_max_num_sigmas_ = max_num_sigmas;
+  peak_support_max_error_ = max_error;
+  ++revision_;
+}
+
+const std::vector<double>& Spectrum::GenerateSpectrum(
+    const int num_bands) const {
+
+  if (cached_spectrum_revision_ == revision_ &&
+      cached_spectrum_num_bands_ == num_bands) {
+    return cached_spectrum_;
+  }
+  if (accumulated_spectrum_revision_ != revision_ ||
+      accumulated_spectrum_num_bands_ != num_bands) {
+    RegenerateAccumulatedSpectrum(num_bands);
+  }
+  // Normalize the spectrum between 0 and 1. Incremental updates can leave
+  // tiny negative rounding errors where the spectrum is 0, so those are
+  // clamped (the sum of the peaks is never actually negative).
   double max_value = 0.0;
   for (int band = 0; band < num_bands; ++band) {
-    const double normalized_x =
-        static_cast<double>(band) / static_cast<double>(num_bands);;
-    spectrum[band] = 0.0;
-    for (const PeakDistribution& peak : spectral_peaks_) {
-      const double peak_value =
-          GetNormalDistributionValue(normalized_x, peak.position, peak.width);
-      const double peak_max_value =
-          GetNormalDistributionValue(peak.position, peak.position, peak.width);
-      const double relative_peak_value =
-          std::min(1.0, (peak_value / peak_max_value));
-      spectrum[band] += peak.amplitude * relative_peak_value;
+    max_value = std::max(accumulated_spectrum_[band], max_value);
+  }
+  const double divisor = std::max(max_value, 1.0);
+  cached_spectrum_.resize(num_bands);
+  for (int band = 0; band < num_bands; ++band) {
+    cached_spectrum_[band] =
+        std::max(accumulated_spectrum_[band], 0.0) / divisor;
+  }
+  cached_spectrum_revision_ = revision_;
+  cached_spectrum_num_bands_ = num_bands;
+  return cached_spectrum_;
+}
+
+std::vector<double> Spectrum::IntegrateSpectrum(
+    const SpectralBands& bands, const bool normalize) const {
+
+  std::vector<double> band_positions;
+  std::vector<double> response_variances;
+  bands.GetNormalizedBands(&band_positions, &response_variances);
+  const int num_bands = band_positions.size();
+  double max_response_variance = 0.0;
+  for (const double response_variance : response_variances) {
+    max_response_variance = std::max(response_variance, max_response_variance);
+  }
+  const double max_response_sigma = std::sqrt(max_response_variance);
+  const double max_num_sigmas = peak_support_max_num_sigmas_;
+  const double max_error = peak_support_max_error_;
+  std::vector<double> spectrum(num_bands, 0.0);
+  AddTabulatedValuesResponse(
+      tabulated_values_, band_positions, response_variances, spectrum.data());
+  for (const PeakDistribution& peak : spectral_peaks_) {
+    switch (peak.shape) {
+    case PEAK_SHAPE_LORENTZIAN:
+      AddPeakResponseOverSupport<PEAK_SHAPE_LORENTZIAN>(
+          peak, max_num_sigmas, max_error, band_positions, response_variances,
+          max_response_sigma, spectrum.data());
+      break;
+    case PEAK_SHAPE_PSEUDO_VOIGT:
+      AddPeakResponseOverSupport<PEAK_SHAPE_PSEUDO_VOIGT>(
+          peak, max_num_sigmas, max_error, band_positions, response_variances,
+          max_response_sigma, spectrum.data());
+      break;
+    case PEAK_SHAPE_ASYMMETRIC_GAUSSIAN:
+      AddPeakResponseOverSupport<PEAK_SHAPE_ASYMMETRIC_GAUSSIAN>(
+          peak, max_num_sigmas, max_error, band_positions, response_variances,
+          max_response_sigma, spectrum.data());
+      break;
+    case PEAK_SHAPE_GAUSSIAN:
+    default:
+      AddPeakResponseOverSupport<PEAK_SHAPE_GAUSSIAN>(
+          peak, max_num_sigmas, max_error, band_positions, response_variances,
+          max_response_sigma, spectrum.data());
+      break;
     }
+  }
+  // Each spectral line is integrated exactly, as a Gaussian peak.
+  PeakDistribution line;
+  line.width = spectral_lines_.width;
+  const int num_lines = spectral_lines_.positions.size();
+  for (int i = 0; i < num_lines; ++i) {
+    line.position = spectral_lines_.positions[i];
+    line.amplitude = spectral_lines_.amplitudes[i];
+    AddPeakResponseOverSupport<PEAK_SHAPE_GAUSSIAN>(
+        line, max_num_sigmas, max_error, band_positions, response_variances,
+        max_response_sigma, spectrum.data());
+  }
+  if (!normalize) {
+    return spectrum;
+  }
+  // Normalize the spectrum between 0 and 1, as in GenerateSpectrum().
+  double max_value = 0.0;
+  for (int band = 0; band < num_bands; ++band) {
     max_value = std::max(spectrum[band], max_value);
   }
-  // Normalize the spectrum between 0 and 1.
-  if (max_value > 1.0) {
-    for (int band = 0; band < num_bands; ++band) {
-      spectrum[band] /= max_value;
-    }
+  const double divisor = std::max(max_value, 1.0);
+  for (int band = 0; band < num_bands; ++band) {
+    spectrum[band] = std::max(spectrum[band], 0.0) / divisor;
   }
   return spectrum;
 }
 
+bool Spectrum::CanUpdateAccumulatedSpectrum() const {
+  return accumulated_spectrum_revision_ == revision_ &&
+         num_incremental_updates_ < kMaxNumIncrementalUpdates;
+}
+
+void Spectrum::AddPeakToAccumulatedSpectrum(
+    const PeakDistribution& peak, const double sign) const {
+
+  // Each peak is scaled so that its maximum is its amplitude. It is only
+  // added over the bands within its support.
+  const double max_num_sigmas = peak_support_max_num_sigmas_;
+  const double max_error = peak_support_max_error_;
+  double* values = accumulated_spectrum_.data();
+  switch (peak.shape) {
+  case PEAK_SHAPE_LORENTZIAN:
+    AddPeakOverSupport<PEAK_SHAPE_LORENTZIAN>(
+        peak, sign, max_num_sigmas, max_error, band_positions_, values);
+    break;
+  case PEAK_SHAPE_PSEUDO_VOIGT:
+    AddPeakOverSupport<PEAK_SHAPE_PSEUDO_VOIGT>(
+        peak, sign, max_num_sigmas, max_error, band_positions_, values);
+    break;
+  case PEAK_SHAPE_ASYMMETRIC_GAUSSIAN:
+    AddPeakOverSupport<PEAK_SHAPE_ASYMMETRIC_GAUSSIAN>(
+        peak, sign, max_num_sigmas, max_error, band_positions_, values);
+    break;
+  case PEAK_SHAPE_GAUSSIAN:
+  default:
+    AddPeakOverSupport<PEAK_SHAPE_GAUSSIAN>(
+        peak, sign, max_num_sigmas, max_error, band_positions_, values);
+    break;
+  }
+}
+
+void Spectrum::RegenerateAccumulatedSpectrum(const int num_bands) const {
+  if (accumulated_spectrum_num_bands_ != num_bands) {
+    GetBandPositions(num_bands, &band_positions_);
+  }
+  accumulated_spectrum_.resize(num_bands);
+  std::fill(accumulated_spectrum_.begin(), accumulated_spectrum_.end(), 0.0);
+  AddTabulatedValues(
+      tabulated_values_, band_positions_, accumulated_spectrum_.data());
+  AddSpectralLines(spectral_lines_, num_bands, accumulated_spectrum_.data());
+  // The peaks are added in order of position so that consecutive peaks touch
+  // nearby bands.
+  std::vector<int> peak_order(spectral_peaks_.size());
+  std::iota(peak_order.begin(), peak_order.end(), 0);
+  std::sort(
+      peak_order.begin(),
+      peak_order.end(),
+      [this](const int a, const int b) {
+        return spectral_peaks_[a].position < spectral_peaks_[b].position;
+      });
+  for (const int peak_index : peak_order) {
+    AddPeakToAccumulatedSpectrum(spectral_peaks_[peak_index], 1.0);
+  }
+  accumulated_spectrum_revision_ = revision_;
+  accumulated_spectrum_num_bands_ = num_bands;
+  num_incremental_updates_ = 0;
+}
+
 }  // namespace hsi_data_generator
@@ -1,6 +1,8 @@
-// This class defines a Spectrum as a series of peaks. The spectrum can be
-// returned at any desired resolution, and is used to display and export the
-// spectral classes and their metadata across all of the GUI components.
+// This class defines a Spectrum as a series of peaks, optionally on top of a
+// tabulated (e.g. measured) spectrum and a list of spectral lines. The
+// spectrum can be returned at any desired resolution, and is used to display
+// and export the spectral classes and their metadata across all of the GUI
+// components.
 
 #ifndef SRC_HSI_SPECTRUM_H_
 #define SRC_HSI_SPECTRUM_H_
@@ -8,17 +10,52 @@
 #include <QColor>
 #include <QString>
 
+#include <cstdint>
 #include <vector>
 
+#include "hsi/spectral_bands.h"
+#include "hsi/spectral_lines.h"
+
 namespace hsi_data_generator {
 
+// The shape of a single spectrum peak. Every shape has its maximum (the
+// peak's amplitude) at the peak's position, and all shapes with the same width
+// have the same full width at half maximum.
+enum PeakShape {
+  PEAK_SHAPE_GAUSSIAN,
+  PEAK_SHAPE_LORENTZIAN,
+
+  // A weighted sum of a Lorentzian and a Gaussian. The shape parameter is the
+  // weight of the Lorentzian, between 0 (Gaussian) and 1 (Lorentzian).
+  PEAK_SHAPE_PSEUDO_VOIGT,
+
+  // A Gaussian with a different standard deviation on each side of its
+  // center. The shape parameter (between -0.95 and 0.95) is the asymmetry:
+  // the standard deviation is multiplied by (1 - asymmetry) to the left of
+  // the center and by (1 + asymmetry) to the right.
+  PEAK_SHAPE_ASYMMETRIC_GAUSSIAN
+};
+
+// Returns the name of the given peak shape as it is stored in project files
+// (e.g. "gaussian" or "pseudo_voigt").
+QString GetPeakShapeName(const PeakShape shape);
+
+// Finds the peak shape with the given name (see GetPeakShapeName()). Returns
+// false if the name is not recognized.
+bool GetPeakShapeFromName(const QString& name, PeakShape* shape);
+
 // The distribution variables for a single spectrum peak. These values encode a
-// Gaussian distribution that represents a single peak in the spectrum. All
-// values should be normalized between 0 and 1.
+// distribution (by default a Gaussian) that represents a single peak in the
+// spectrum. All values should be normalized between 0 and 1.
 struct PeakDistribution {
   // Default constructor initializes everything to 0. This is effectively a
   // zero (null) distribution.
-  PeakDistribution() : position(0), amplitude(0), width(0) {}
+  PeakDistribution()
+      : position(0),
+        amplitude(0),
+        width(0),
+        shape(PEAK_SHAPE_GAUSSIAN),
+        shape_parameter(0) {}
 
   // The position is the x-position of the peak. The peak will be centered at
   // this position. It is the mean of the Guassian.
@@ -30,13 +67,18 @@ struct PeakDistribution {
   // height.
   double amplitude;
 
-  // The width is the standard deviation of the Gaussian, and encodes how thin
-  // or thick the peak will be. Sharp, instantaneous peaks should have a small
-  // width.
+  // The width is the variance (the squared standard deviation) of the
+  // Gaussian, and encodes how thin or thick the peak will be. Sharp,
+  // instantaneous peaks should have a small width. Other shapes use the width
+  // of the Gaussian that has the same full width at half maximum.
   //
   // A peak's width should be smaller than the span of the entire spectrum,
   // which is a normalized width of 1.0.
   double width;
+
+  // The shape of the peak, and its shape-specific parameter (see PeakShape).
+  PeakShape shape;
+  double shape_parameter;
 };
 
 class Spectrum {
@@ -59,12 +101,24 @@ class Spectrum {
   Spectrum(const Spectrum& other)
       : spectrum_class_name_(other.spectrum_class_name_),
         spectrum_class_color_(other.spectrum_class_color_),
-        spectral_peaks_(other.spectral_peaks_) {}
+        spectral_peaks_(other.spectral_peaks_),
+        tabulated_values_(other.tabulated_values_),
+        spectral_lines_(other.spectral_lines_),
+        peak_support_max_num_sigmas_(other.peak_support_max_num_sigmas_),
+        peak_support_max_error_(other.peak_support_max_error_),
+        revision_(other.revision_),
+        cached_spectrum_(other.cached_spectrum_),
+        cached_spectrum_revision_(other.cached_spectrum_revision_),
+        cached_spectrum_num_bands_(other.cached_spectrum_num_bands_) {}
 
   // Adds a peak to the spectrum. The definitions of each of the required
   // values are described in the PeakDistribution struct above.
   void AddPeak(
-      const double position, const double amplitude, const double width);
+      const double position,
+      const double amplitude,
+      const double width,
+      const PeakShape shape = PEAK_SHAPE_GAUSSIAN,
+      const double shape_parameter = 0.0);
 
   // Updates an existing peak at the given index. If the given index is not
   // valid, nothing will happen (but a warning will be displayed).
@@ -78,11 +132,44 @@ class Spectrum {
       const double new_amplitude,
       const double new_width);
 
+  // Changes the shape of the peak at the given index. The shape parameter is
+  // clamped to the valid range of the shape (see PeakShape). If the given
+  // index is not valid, nothing will happen (but a warning will be displayed).
+  void SetPeakShape(
+      const int peak_index,
+      const PeakShape shape,
+      const double shape_parameter);
+
   // Deletes the peak at the given index. If the given index is not valid,
   // nothing will happen (but a warning will be displayed).
   void DeletePeak(const int peak_index);
 
-  // Resets the spectrum. All peaks will be removed.
+  // Sets the tabulated values that the peaks are added to. The values are
+  // evenly spaced samples of the spectrum over its range: value i is at the
+  // normalized position i / values.size(), the same positions that
+  // GenerateSpectrum(values.size()) samples. Other resolutions interpolate
+  // linearly between them. An empty list removes the tabulated values.
+  void SetTabulatedValues(const std::vector<double>& values);
+
+  // Returns the tabulated values (see SetTabulatedValues()).
+  const std::vector<double>& GetTabulatedValues() const {
+    return tabulated_values_;
+  }
+
+  // Sets the spectral lines that are added to the spectrum (see
+  // SpectralLines). Unlike peaks, any number of lines can be generated at
+  // about the same cost, as long as they share one width. Empty lines remove
+  // the current ones. If the lines' positions and amplitudes do not match in
+  // size, nothing will happen (but a warning will be displayed).
+  void SetSpectralLines(const SpectralLines& lines);
+
+  // Returns the spectral lines (see SetSpectralLines()).
+  const SpectralLines& GetSpectralLines() const {
+    return spectral_lines_;
+  }
+
+  // Resets the spectrum. All peaks, tabulated values, and spectral lines will
+  // be removed.
   void Reset();
 
   // Change the spectrum's class name. This will be the name identifying this
@@ -97,11 +184,46 @@ class Spectrum {
     spectrum_class_color_ = spectrum_class_color;
   }
 
+  // Limits the evaluation of each peak to the bands near its center, which
+  // makes narrow peaks much cheaper to generate. A peak is skipped at bands
+  // where its value is below max_error (relative to the full amplitude of 1),
+  // and at bands more than max_num_sigmas standard deviations (of the peak's
+  // Gaussian width) away from its center. Either limit is disabled by a value
+  // of 0.
+  //
+  // By default, only the error bound is used, with a max_error (1e-12) well
+  // below the precision of any exported data type.
+  void SetPeakSupportCutoff(
+      const double max_num_sigmas, const double max_error);
+
   // Generates the spectrum from the spectral_peaks_ (distributions). The
   // spectral resolution is determined by the given number of bands.
   //
   // All values of the returned spectrum will be normalized between 0 and 1.
-  std::vector<double> GenerateSpectrum(const int num_bands) const;
+  //
+  // The generated spectrum is cached, so repeated calls with the same number of
+  // bands are free until the peaks are modified. Changing, adding, or deleting
+  // a single peak after that only updates the bands that the peak touches (plus
+  // a pass to normalize the spectrum), which keeps editing fast at high band
+  // counts. The returned reference is only valid until the next call or peak
+  // modification. Since the cache is updated by this (const) method, it must
+  // not be called on the same Spectrum from multiple threads at once.
+  const std::vector<double>& GenerateSpectrum(const int num_bands) const;
+
+  // Generates the spectrum as it is measured by the given sensor bands. Each
+  // value is the integral of the peaks against the band's spectral response
+  // function, rather than a point sample at the band's center (see
+  // SpectralBands). Peaks are integrated in closed form, except for the
+  // Lorentzian parts of peaks, which are integrated numerically. Spectral
+  // lines are integrated like Gaussian peaks, and the linearly interpolated
+  // tabulated values are integrated in closed form as well.
+  //
+  // The spectrum is normalized in the same way as GenerateSpectrum(), unless
+  // normalize is false, in which case the raw integrals are returned (e.g. to
+  // be resampled and then normalized, see SpectrumTable::Normalize()). It is
+  // not cached, and this can be called from multiple threads at once.
+  std::vector<double> IntegrateSpectrum(
+      const SpectralBands& bands, const bool normalize = true) const;
 
   // Returns the name of this spectrum.
   QString GetName() const {
@@ -122,12 +244,34 @@ class Spectrum {
     return spectral_peaks_.size();
   }
 
-  // Returns true if the spectrum is empty (i.e. it currently has no peaks).
+  // Returns true if the spectrum is empty (i.e. it currently has no peaks, no
+  // tabulated values, and no spectral lines).
   bool IsEmpty() const {
-    return spectral_peaks_.empty();
+    return spectral_peaks_.empty() && tabulated_values_.empty() &&
+           spectral_lines_.IsEmpty();
+  }
+
+  // Returns the revision of the peaks. It changes every time a peak is added,
+  // updated, or deleted (or the tabulated values, spectral lines, or peak
+  // support cutoff change), so it can be used to tell if anything derived from
+  // the peaks is out of date.
+  int64_t GetRevision() const {
+    return revision_;
   }
 
  private:
+  // Returns true if the accumulated spectrum is up to date and can be updated
+  // incrementally when a peak changes.
+  bool CanUpdateAccumulatedSpectrum() const;
+
+  // Adds (sign = 1) or subtracts (sign = -1) the given peak's contribution to
+  // the accumulated spectrum.
+  void AddPeakToAccumulatedSpectrum(
+      const PeakDistribution& peak, const double sign) const;
+
+  // Generates the accumulated spectrum from scratch from all of the peaks.
+  void RegenerateAccumulatedSpectrum(const int num_bands) const;
+
   // The name and color associated with this spectrum. The "class" refers to
   // the element (endmember) that this spectrum represents, which is
   // application-specific.
@@ -137,6 +281,38 @@ class Spectrum {
   // The peaks that define this spectrum. These peaks are a basis that can be
   // used to generate the spectrum at any spectral resolution.
   std::vector<PeakDistribution> spectral_peaks_;
+
+  // The tabulated spectrum that the peaks are added to (see
+  // SetTabulatedValues()).
+  std::vector<double> tabulated_values_;
+
+  // The spectral lines that are added to the spectrum (see
+  // SetSpectralLines()).
+  SpectralLines spectral_lines_;
+
+  // The limits of each peak's evaluated bands (see SetPeakSupportCutoff()).
+  double peak_support_max_num_sigmas_ = 0.0;
+  double peak_support_max_error_ = 1e-12;
+
+  // Incremented every time the peaks are modified.
+  int64_t revision_ = 0;
+
+  // The sum of all the peaks (before normalization) at each band, the
+  // normalized position of each band, and the peak revision and number of
+  // bands they are valid for. Single peak changes are applied to this sum
+  // incrementally, and it is regenerated every so often to discard the
+  // accumulated rounding errors.
+  mutable std::vector<double> band_positions_;
+  mutable std::vector<double> accumulated_spectrum_;
+  mutable int64_t accumulated_spectrum_revision_ = -1;
+  mutable int accumulated_spectrum_num_bands_ = -1;
+  mutable int num_incremental_updates_ = 0;
+
+  // The most recently generated spectrum (see GenerateSpectrum()), and the
+  // peak revision and number of bands it was generated for.
+  mutable std::vector<double> cached_spectrum_;
+  mutable int64_t cached_spectrum_revision_ = -1;
+  mutable int cached_spectrum_num_bands_ = -1;
 };
 
 }  // namespace hsi_data_generator
@@ -0,0 +1,307 @@
+#include "hsi/spectrum_kernels.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <cmath>
+
+namespace hsi_data_generator {
+namespace {
+
+// The signature shared by every implementation of AddGaussianPeak(). The
+// variance is given as 1 / (2 * variance), which is constant for each peak.
+typedef void (*GaussianPeakKernel)(
+    const double position,
+    const double amplitude,
+    const double inverse_two_variance,
+    const double* x_values,
+    const int num_values,
+    double* values);
+
+// The signature shared by every implementation of AddGaussianPeakResponse().
+// The variance must be positive.
+typedef void (*GaussianPeakResponseKernel)(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values);
+
+// The portable version. In release builds, the compiler vectorizes this loop
+// for the baseline instruction set (SSE2 on x86-64) with its vector math
+// library.
+void AddGaussianPeakGeneric(
+    const double position,
+    const double amplitude,
+    const double inverse_two_variance,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  for (int i = 0; i < num_values; ++i) {
+    const double offset = x_values[i] - position;
+    values[i] += amplitude * std::exp(-offset * offset * inverse_two_variance);
+  }
+}
+
+void AddGaussianPeakResponseGeneric(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  for (int i = 0; i < num_values; ++i) {
+    const double offset = x_values[i] - position;
+    const double inverse_total_variance =
+        1.0 / (variance + response_variances[i]);
+    values[i] += amplitude * std::sqrt(variance * inverse_total_variance) *
+        std::exp(-0.5 * offset * offset * inverse_total_variance);
+  }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+// Constants for the vectorized exp(x) below. The argument is split into
+// x = n * ln(2) + r, with |r| <= ln(2) / 2, so exp(x) = 2^n * exp(r). exp(r)
+// is a degree 12 Taylor polynomial, which is accurate to a few ulp over that
+// range. Arguments below kMinExpArgument are treated as 0, which is what
+// std::exp() rounds them to (at double precision, with subnormals flushed).
+constexpr double kMinExpArgument = -708.0;
+constexpr double kLog2E = 1.4426950408889634;
+constexpr double kLn2High = 6.93145751953125e-1;
+constexpr double kLn2Low = 1.42860682030941723212e-6;
+constexpr int kExpBias = 1023;
+constexpr int kExpMantissaBits = 52;
+constexpr int kNumExpCoefficients = 13;
+constexpr double kExpCoefficients[kNumExpCoefficients] = {
+    1.0 / 479001600.0,  // 1 / 12!
+    1.0 / 39916800.0,
+    1.0 / 3628800.0,
+    1.0 / 362880.0,
+    1.0 / 40320.0,
+    1.0 / 5040.0,
+    1.0 / 720.0,
+    1.0 / 120.0,
+    1.0 / 24.0,
+    1.0 / 6.0,
+    1.0 / 2.0,
+    1.0,
+    1.0,                // 1 / 0!
+};
+
+__attribute__((target("avx2,fma")))
+__m256d ExpAVX2(const __m256d x) {
+  const __m256d min_argument = _mm256_set1_pd(kMinExpArgument);
+  const __m256d in_range = _mm256_cmp_pd(x, min_argument, _CMP_GE_OQ);
+  const __m256d clamped_x = _mm256_max_pd(x, min_argument);
+  const __m128i n_int = _mm256_cvtpd_epi32(
+      _mm256_mul_pd(clamped_x, _mm256_set1_pd(kLog2E)));
+  const __m256d n = _mm256_cvtepi32_pd(n_int);
+  __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kLn2High), clamped_x);
+  r = _mm256_fnmadd_pd(n, _mm256_set1_pd(kLn2Low), r);
+  __m256d polynomial = _mm256_set1_pd(kExpCoefficients[0]);
+  for (int i = 1; i < kNumExpCoefficients; ++i) {
+    polynomial = _mm256_fmadd_pd(
+        polynomial, r, _mm256_set1_pd(kExpCoefficients[i]));
+  }
+  // 2^n is built directly from its exponent bits.
+  const __m256i scale_bits = _mm256_slli_epi64(
+      _mm256_cvtepi32_epi64(_mm_add_epi32(n_int, _mm_set1_epi32(kExpBias))),
+      kExpMantissaBits);
+  const __m256d scale = _mm256_castsi256_pd(scale_bits);
+  return _mm256_and_pd(_mm256_mul_pd(polynomial, scale), in_range);
+}
+
+__attribute__((target("avx2,fma")))
+void AddGaussianPeakAVX2(
+    const double position,
+    const double amplitude,
+    const double inverse_two_variance,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  const __m256d position_vector = _mm256_set1_pd(position);
+  const __m256d amplitude_vector = _mm256_set1_pd(amplitude);
+  const __m256d scale_vector = _mm256_set1_pd(-inverse_two_variance);
+  int i = 0;
+  for (; i + 4 <= num_values; i += 4) {
+    const __m256d offset =
+        _mm256_sub_pd(_mm256_loadu_pd(x_values + i), position_vector);
+    const __m256d exponent =
+        _mm256_mul_pd(_mm256_mul_pd(offset, offset), scale_vector);
+    const __m256d sum = _mm256_fmadd_pd(
+        ExpAVX2(exponent), amplitude_vector, _mm256_loadu_pd(values + i));
+    _mm256_storeu_pd(values + i, sum);
+  }
+  AddGaussianPeakGeneric(
+      position,
+      amplitude,
+      inverse_two_variance,
+      x_values + i,
+      num_values - i,
+      values + i);
+}
+
+__attribute__((target("avx2,fma")))
+void AddGaussianPeakResponseAVX2(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  const __m256d position_vector = _mm256_set1_pd(position);
+  const __m256d amplitude_vector = _mm256_set1_pd(amplitude);
+  const __m256d variance_vector = _mm256_set1_pd(variance);
+  const __m256d minus_half = _mm256_set1_pd(-0.5);
+  const __m256d one = _mm256_set1_pd(1.0);
+  int i = 0;
+  for (; i + 4 <= num_values; i += 4) {
+    const __m256d offset =
+        _mm256_sub_pd(_mm256_loadu_pd(x_values + i), position_vector);
+    const __m256d total_variance = _mm256_add_pd(
+        variance_vector, _mm256_loadu_pd(response_variances + i));
+    const __m256d inverse_total_variance = _mm256_div_pd(one, total_variance);
+    const __m256d exponent = _mm256_mul_pd(
+        _mm256_mul_pd(_mm256_mul_pd(offset, offset), minus_half),
+        inverse_total_variance);
+    const __m256d scale = _mm256_mul_pd(
+        amplitude_vector,
+        _mm256_sqrt_pd(_mm256_mul_pd(variance_vector, inverse_total_variance)));
+    const __m256d sum = _mm256_fmadd_pd(
+        ExpAVX2(exponent), scale, _mm256_loadu_pd(values + i));
+    _mm256_storeu_pd(values + i, sum);
+  }
+  AddGaussianPeakResponseGeneric(
+      position,
+      amplitude,
+      variance,
+      x_values + i,
+      response_variances + i,
+      num_values - i,
+      values + i);
+}
+
+#endif  // defined(__GNUC__) && defined(__x86_64__)
+
+// The kernel implementations picked for this CPU.
+struct KernelSelection {
+  GaussianPeakKernel add_gaussian_peak;
+  GaussianPeakResponseKernel add_gaussian_peak_response;
+  const char* name;
+};
+
+KernelSelection SelectKernels() {
+#if defined(__GNUC__) && defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {AddGaussianPeakAVX2, AddGaussianPeakResponseAVX2, "avx2"};
+  }
+#endif
+  return {AddGaussianPeakGeneric, AddGaussianPeakResponseGeneric, "generic"};
+}
+
+// The CPU is only checked once, the first time any kernel is used.
+const KernelSelection& GetKernelSelection() {
+  static const KernelSelection kernel_selection = SelectKernels();
+  return kernel_selection;
+}
+
+// Adds the amplitude to the values whose x is exactly at the given position.
+// This is the limit of every peak shape as its width goes to 0.
+void AddInfinitelyThinPeak(
+    const double position,
+    const double amplitude,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  for (int i = 0; i < num_values; ++i) {
+    if (x_values[i] == position) {
+      values[i] += amplitude;
+    }
+  }
+}
+
+}  // namespace
+
+void AddGaussianPeak(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  if (variance <= 0.0) {
+    AddInfinitelyThinPeak(position, amplitude, x_values, num_values, values);
+    return;
+  }
+  GetKernelSelection().add_gaussian_peak(
+      position, amplitude, 0.5 / variance, x_values, num_values, values);
+}
+
+void AddGaussianPeakResponse(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values) {
+
+  if (variance <= 0.0) {
+    // An infinitely thin peak has no area, so it is only seen by the bands
+    // that sample it directly.
+    for (int i = 0; i < num_values; ++i) {
+      if (response_variances[i] <= 0.0 && x_values[i] == position) {
+        values[i] += amplitude;
+      }
+    }
+    return;
+  }
+  GetKernelSelection().add_gaussian_peak_response(
+      position,
+      amplitude,
+      variance,
+      x_values,
+      response_variances,
+      num_values,
+      values);
+}
+
+void AddLorentzianPeak(
+    const double position,
+    const double amplitude,
+    const double half_width,
+    const double* x_values,
+    const int num_values,
+    double* values) {
+
+  if (half_width <= 0.0) {
+    AddInfinitelyThinPeak(position, amplitude, x_values, num_values, values);
+    return;
+  }
+  // There is no exp() here, so the compiler vectorizes this loop on its own.
+  const double inverse_half_width_squared = 1.0 / (half_width * half_width);
+  for (int i = 0; i < num_values; ++i) {
+    const double offset = x_values[i] - position;
+    values[i] +=
+        amplitude / (1.0 + offset * offset * inverse_half_width_squared);
+  }
+}
+
+const char* GetSpectrumKernelName() {
+  return GetKernelSelection().name;
+}
+
+}  // namespace hsi_data_generator
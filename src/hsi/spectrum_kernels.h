@@ -0,0 +1,69 @@
+// Low-level kernels that evaluate spectrum peaks over many bands at once.
+// These are the inner loops of Spectrum::GenerateSpectrum() and
+// Spectrum::IntegrateSpectrum(). The Gaussian kernels use hand-vectorized AVX2
+// code when the CPU supports it (checked once at runtime), and fall back to
+// portable code otherwise.
+
+#ifndef SRC_HSI_SPECTRUM_KERNELS_H_
+#define SRC_HSI_SPECTRUM_KERNELS_H_
+
+namespace hsi_data_generator {
+
+// Adds a Gaussian peak, normalized so that its maximum is the given
+// amplitude, to each value:
+//
+//   values[i] += amplitude * exp(-(x_values[i] - position)^2 / (2 * variance))
+//
+// A peak with a variance of 0 (or less) is infinitely thin: it only adds its
+// amplitude to values whose x is exactly at the peak's position.
+void AddGaussianPeak(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const int num_values,
+    double* values);
+
+// Adds the response of sensor bands to a Gaussian peak: the integral of the
+// peak against each band's Gaussian spectral response function, which is
+// centered at x_values[i] with the variance response_variances[i] and
+// normalized to an area of 1. This has a closed form, since the convolution
+// of two Gaussians is a Gaussian whose variance is the sum of theirs:
+//
+//   t = variance + response_variances[i]
+//   values[i] += amplitude * sqrt(variance / t) *
+//                exp(-(x_values[i] - position)^2 / (2 * t))
+//
+// Bands with a response variance of 0 sample the peak at their center, as in
+// AddGaussianPeak().
+void AddGaussianPeakResponse(
+    const double position,
+    const double amplitude,
+    const double variance,
+    const double* x_values,
+    const double* response_variances,
+    const int num_values,
+    double* values);
+
+// Adds a Lorentzian peak, normalized so that its maximum is the given
+// amplitude, to each value:
+//
+//   values[i] += amplitude / (1 + ((x_values[i] - position) / half_width)^2)
+//
+// As with AddGaussianPeak(), a half width of 0 (or less) adds the amplitude
+// only at the peak's exact position.
+void AddLorentzianPeak(
+    const double position,
+    const double amplitude,
+    const double half_width,
+    const double* x_values,
+    const int num_values,
+    double* values);
+
+// Returns the name of the Gaussian kernel implementations used on this CPU
+// ("avx2" or "generic").
+const char* GetSpectrumKernelName();
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_SPECTRUM_KERNELS_H_
@@ -0,0 +1,116 @@
+#include "hsi/spectrum_table.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "hsi/spectral_bands.h"
+#include "hsi/spectrum.h"
+#include "util/parallel_for.h"
+
+namespace hsi_data_generator {
+namespace {
+
+// The number of consecutive spectra generated by each parallel task. A task
+// writes 16 consecutive values of every band's row, which is a whole number of
+// cache lines for float and double values. The blocks are only aligned to
+// cache lines when each row (num_spectra values) is a multiple of 64 bytes,
+// though. Otherwise, neighboring tasks can share the cache line at each end of
+// their block, which only costs some false sharing.
+constexpr int kNumSpectraPerTask = 16;
+
+// Fills the band-major table with the spectra returned by the given function,
+// which is called once for each spectrum index.
+template <typename ValueType, typename GenerateFunction>
+void FillSpectrumTable(
+    const int num_spectra,
+    const int num_bands,
+    const int num_threads,
+    const GenerateFunction& generate_spectrum,
+    ValueType* table) {
+
+  const int num_tasks =
+      (num_spectra + kNumSpectraPerTask - 1) / kNumSpectraPerTask;
+  util::ParallelFor(
+      num_tasks,
+      num_threads,
+      [&](const int task_index, const int thread_index) {
+        const int start_spectrum = task_index * kNumSpectraPerTask;
+        const int end_spectrum =
+            std::min(start_spectrum + kNumSpectraPerTask, num_spectra);
+        for (int s = start_spectrum; s < end_spectrum; ++s) {
+          const std::vector<double>& spectrum = generate_spectrum(s);
+          ValueType* values = table + s;
+          for (int band = 0; band < num_bands; ++band) {
+            values[band * num_spectra] =
+                static_cast<ValueType>(spectrum[band]);
+          }
+        }
+        return true;
+      });
+}
+
+}  // namespace
+
+template <typename ValueType>
+SpectrumTable<ValueType>::SpectrumTable(
+    const std::vector<std::shared_ptr<Spectrum>>& spectra,
+    const int num_bands,
+    const int num_threads)
+    : num_spectra_(spectra.size()),
+      num_bands_(num_bands),
+      values_(static_cast<size_t>(spectra.size()) * num_bands) {
+
+  FillSpectrumTable(
+      num_spectra_,
+      num_bands_,
+      num_threads,
+      [&spectra, num_bands](const int s) -> const std::vector<double>& {
+        return spectra[s]->GenerateSpectrum(num_bands);
+      },
+      values_.data());
+}
+
+template <typename ValueType>
+SpectrumTable<ValueType>::SpectrumTable(
+    const std::vector<std::shared_ptr<Spectrum>>& spectra,
+    const SpectralBands& bands,
+    const int num_threads,
+    const bool normalize)
+    : num_spectra_(spectra.size()),
+      num_bands_(bands.GetNumBands()),
+      values_(static_cast<size_t>(spectra.size()) * bands.GetNumBands()) {
+
+  FillSpectrumTable(
+      num_spectra_,
+      num_bands_,
+      num_threads,
+      [&spectra, &bands, normalize](const int s) {
+        return spectra[s]->IntegrateSpectrum(bands, normalize);
+      },
+      values_.data());
+}
+
+template <typename ValueType>
+void SpectrumTable<ValueType>::Normalize() {
+  // The table is band-major, so the maximum of every spectrum is found in one
+  // pass over the bands, and then every band's row is scaled.
+  std::vector<ValueType> divisors(num_spectra_, 1);
+  for (int band = 0; band < num_bands_; ++band) {
+    const ValueType* values = GetBandValues(band);
+    for (int s = 0; s < num_spectra_; ++s) {
+      divisors[s] = std::max(values[s], divisors[s]);
+    }
+  }
+  for (int band = 0; band < num_bands_; ++band) {
+    ValueType* values = GetMutableBandValues(band);
+    for (int s = 0; s < num_spectra_; ++s) {
+      values[s] = std::max(values[s], static_cast<ValueType>(0)) / divisors[s];
+    }
+  }
+}
+
+template class SpectrumTable<float>;
+template class SpectrumTable<double>;
+
+}  // namespace hsi_data_generator
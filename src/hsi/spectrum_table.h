@@ -0,0 +1,92 @@
+// The SpectrumTable holds every spectrum of a spectral dictionary generated at
+// a fixed number of bands, in a single contiguous matrix. Code that needs the
+// values of many spectra at once (e.g. the exporter) should read this table
+// instead of generating each spectrum separately.
+
+#ifndef SRC_HSI_SPECTRUM_TABLE_H_
+#define SRC_HSI_SPECTRUM_TABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "hsi/spectral_bands.h"
+#include "hsi/spectrum.h"
+#include "util/aligned_allocator.h"
+
+namespace hsi_data_generator {
+
+// The values are stored in band-major order, so the values of every spectrum
+// at a single band are next to each other: the value of spectrum s at band b
+// is at index b * num_spectra + s. The table is aligned to a cache line.
+//
+// ValueType is float or double.
+template <typename ValueType>
+class SpectrumTable {
+ public:
+  // Generates every given spectrum at the given number of bands. Spectra are
+  // generated in parallel on up to num_threads threads (all cores if less
+  // than 1), so the spectra must be distinct objects that are not modified
+  // while the table is being built.
+  SpectrumTable(
+      const std::vector<std::shared_ptr<Spectrum>>& spectra,
+      const int num_bands,
+      const int num_threads = 0);
+
+  // Same as above, but generates every spectrum as it is measured by the
+  // given sensor bands (see Spectrum::IntegrateSpectrum()). If normalize is
+  // false, the spectra are not normalized.
+  SpectrumTable(
+      const std::vector<std::shared_ptr<Spectrum>>& spectra,
+      const SpectralBands& bands,
+      const int num_threads = 0,
+      const bool normalize = true);
+
+  // Creates a table of the given size with every value set to 0, to be filled
+  // through GetMutableBandValues() (e.g. by a SpectralResampler).
+  SpectrumTable(const int num_spectra, const int num_bands)
+      : num_spectra_(num_spectra),
+        num_bands_(num_bands),
+        values_(static_cast<size_t>(num_spectra) * num_bands) {}
+
+  int GetNumSpectra() const {
+    return num_spectra_;
+  }
+
+  int GetNumBands() const {
+    return num_bands_;
+  }
+
+  // Returns the values of every spectrum at the given band (num_spectra
+  // values).
+  const ValueType* GetBandValues(const int band) const {
+    return &values_[band * num_spectra_];
+  }
+
+  ValueType* GetMutableBandValues(const int band) {
+    return &values_[band * num_spectra_];
+  }
+
+  // Returns the value of a single spectrum at the given band.
+  ValueType GetValue(const int spectrum_index, const int band) const {
+    return values_[band * num_spectra_ + spectrum_index];
+  }
+
+  // Normalizes every spectrum between 0 and 1 in the same way as
+  // Spectrum::GenerateSpectrum(): negative values are clamped to 0, and
+  // spectra whose maximum is above 1 are divided by it.
+  void Normalize();
+
+  // Returns the whole band-major table.
+  const util::AlignedVector<ValueType>& GetValues() const {
+    return values_;
+  }
+
+ private:
+  const int num_spectra_;
+  const int num_bands_;
+  util::AlignedVector<ValueType> values_;
+};
+
+}  // namespace hsi_data_generator
+
+#endif  // SRC_HSI_SPECTRUM_TABLE_H_
@@ -0,0 +1,607 @@
+// Benchmarks for the performance-critical parts of the generator: spectrum
+// generation, layout rendering, and exporting the data cube. Every result is
+// printed to stdout as a single JSON object per line, so the output of
+// different runs (or releases) can be saved and compared to catch
+// regressions. Progress and warnings are printed to stderr.
+//
+// Example:
+//   hsi_bench --disk-dir /data/scratch > results.jsonl
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "hsi/hsi_exporter.h"
+#include "hsi/image_layout.h"
+#include "hsi/spectrum.h"
+#include "hsi/spectrum_kernels.h"
+#include "util/parallel_for.h"
+
+namespace {
+
+using hsi_data_generator::HSIDataExporter;
+using hsi_data_generator::HSIDataType;
+using hsi_data_generator::HSIInterleaveFormat;
+using hsi_data_generator::ImageLayout;
+using hsi_data_generator::Spectrum;
+
+static const QString kApplicationName = "hsi_bench";
+static const QString kApplicationDescription =
+    "Measures spectrum generation, layout rendering, and export speed. "
+    "Results are printed as one JSON object per line.";
+
+static const QString kSpectrumBenchmarkName = "generate_spectrum";
+static const QString kRenderBenchmarkName = "render_layout";
+static const QString kNestedRenderBenchmarkName = "render_nested_layout";
+static const QString kQueryBenchmarkName = "query_class";
+static const QString kExportBenchmarkName = "save_file";
+
+static const QString kDefaultBenchmarks = "spectrum,render,export";
+static const QString kDefaultMinTime = "0.5";
+static const QString kDefaultTmpfsDirectory = "/dev/shm";
+static const QString kDefaultDiskDirectory = ".";
+static const QString kDefaultExportImageSize = "1024";
+static const QString kDefaultExportNumBands = "64";
+static const QString kDefaultExportNumRuns = "3";
+static const QString kDefaultNumThreads = "0";
+
+// The name of the file written by the export benchmark in each directory.
+static const QString kExportFileName = "hsi_bench_export.bsq";
+static const QString kHeaderFileExtension = ".hdr";
+
+// The parameters that each benchmark is run over.
+static const std::vector<int> kSpectrumNumPeaks = {1, 4, 16, 64};
+static const std::vector<int> kSpectrumNumBands = {50, 200, 1000, 5000};
+static const std::vector<int> kRenderNumPrimitives = {1, 10, 100, 1000, 10000};
+static const std::vector<int> kRenderImageSizes = {500, 2000, 5000};
+static const std::vector<int> kNestedRenderDepths = {1, 2, 3};
+static const std::vector<int> kQueryImageSizes = {5000, 100000};
+
+// The number of spectra (classes) and peaks per spectrum used in the layout
+// and export benchmarks.
+constexpr int kNumClasses = 8;
+constexpr int kNumPeaksPerClass = 16;
+
+// Rendered primitives are sized so that they cover the image about this many
+// times over in total, regardless of how many there are.
+constexpr double kRenderCoverage = 4.0;
+
+// The peak support cutoff of the benchmarked spectra (the defaults of
+// Spectrum::SetPeakSupportCutoff()). Setting it again before each call
+// invalidates the spectrum's cache, so every call regenerates the spectrum.
+constexpr double kSpectrumPeakSupportMaxNumSigmas = 0.0;
+constexpr double kSpectrumPeakSupportMaxError = 1e-12;
+
+// In the nested render benchmarks, every layout is split into a grid of this
+// many sub-layouts per side (down to the benchmarked depth), and every layout
+// has this many primitives.
+constexpr int kNestedRenderGridSize = 2;
+constexpr int kNestedRenderNumPrimitives = 100;
+
+// The number of random pixels looked up in each call of the query benchmark.
+constexpr int kNumQueryPixels = 1000;
+
+// Each timed batch of calls should take at least this fraction of the minimum
+// benchmark time, so that the clock overhead does not skew fast calls.
+constexpr double kMinBatchTimeFraction = 0.1;
+
+// All random inputs use a fixed seed, so that every run measures the same
+// work.
+constexpr unsigned int kRandomSeed = 12345;
+
+// Benchmarked results are accumulated here so that the compiler cannot drop
+// the work that produced them.
+volatile double benchmark_sink = 0;
+
+// The timing result of a single benchmark configuration. Times are in seconds
+// per call.
+struct TimingResult {
+  int64_t num_iterations = 0;
+  double mean_seconds = 0;
+  double min_seconds = 0;
+};
+
+// Calls the given function repeatedly for at least min_time seconds. Calls are
+// timed in batches large enough to make the clock overhead negligible, and the
+// fastest batch gives the minimum time per call. The first call is a warm-up
+// and is not timed.
+TimingResult TimeFunction(
+    const std::function<void()>& function,
+    const double min_time) {
+
+  typedef std::chrono::steady_clock Clock;
+  function();
+  TimingResult result;
+  int64_t batch_size = 1;
+  double total_seconds = 0;
+  bool have_min_seconds = false;
+  while (total_seconds <= min_time) {
+    const Clock::time_point start_time = Clock::now();
+    for (int64_t i = 0; i < batch_size; ++i) {
+      function();
+    }
+    const double batch_seconds = std::chrono::duration<double>(
+        Clock::now() - start_time).count();
+    total_seconds += batch_seconds;
+    result.num_iterations += batch_size;
+    const double seconds_per_call =
+        batch_seconds / static_cast<double>(batch_size);
+    if (!have_min_seconds || seconds_per_call < result.min_seconds) {
+      result.min_seconds = seconds_per_call;
+      have_min_seconds = true;
+    }
+    if (batch_seconds < min_time * kMinBatchTimeFraction) {
+      batch_size *= 2;
+    }
+  }
+  result.mean_seconds =
+      total_seconds / static_cast<double>(result.num_iterations);
+  return result;
+}
+
+// Formats values for the JSON output.
+std::string JsonString(const QString& value) {
+  std::string escaped = "\"";
+  for (const char c : value.toStdString()) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped + "\"";
+}
+
+template<typename T>
+std::string JsonNumber(const T value) {
+  std::ostringstream stream;
+  stream.precision(6);
+  stream << value;
+  return stream.str();
+}
+
+// Prints a single benchmark result as a JSON object on its own line. The
+// field values must already be formatted with JsonString() or JsonNumber().
+void PrintResult(
+    const QString& benchmark_name,
+    const std::vector<std::pair<QString, std::string>>& fields) {
+
+  std::cout << "{\"benchmark\": " << JsonString(benchmark_name);
+  for (const auto& name_and_value : fields) {
+    std::cout << ", " << JsonString(name_and_value.first) << ": "
+              << name_and_value.second;
+  }
+  std::cout << "}" << std::endl;
+}
+
+// Returns a spectrum with the given number of randomly placed peaks.
+std::shared_ptr<Spectrum> MakeRandomSpectrum(
+    const int num_peaks, std::mt19937* random_generator) {
+
+  std::uniform_real_distribution<double> position_distribution(0.0, 1.0);
+  std::uniform_real_distribution<double> amplitude_distribution(0.1, 1.0);
+  std::uniform_real_distribution<double> width_distribution(0.0005, 0.05);
+  std::shared_ptr<Spectrum> spectrum(new Spectrum("Benchmark"));
+  for (int i = 0; i < num_peaks; ++i) {
+    spectrum->AddPeak(
+        position_distribution(*random_generator),
+        amplitude_distribution(*random_generator),
+        width_distribution(*random_generator));
+  }
+  return spectrum;
+}
+
+void RunSpectrumBenchmarks(const double min_time) {
+  std::mt19937 random_generator(kRandomSeed);
+  for (const int num_peaks : kSpectrumNumPeaks) {
+    const std::shared_ptr<Spectrum> spectrum =
+        MakeRandomSpectrum(num_peaks, &random_generator);
+    for (const int num_bands : kSpectrumNumBands) {
+      const TimingResult result = TimeFunction(
+          [&spectrum, num_bands]() {
+            spectrum->SetPeakSupportCutoff(
+                kSpectrumPeakSupportMaxNumSigmas,
+                kSpectrumPeakSupportMaxError);
+            benchmark_sink = spectrum->GenerateSpectrum(num_bands).back();
+          },
+          min_time);
+      PrintResult(kSpectrumBenchmarkName, {
+          {"kernel", JsonString(
+              hsi_data_generator::GetSpectrumKernelName())},
+          {"num_peaks", JsonNumber(num_peaks)},
+          {"num_bands", JsonNumber(num_bands)},
+          {"iterations", JsonNumber(result.num_iterations)},
+          {"mean_ns", JsonNumber(result.mean_seconds * 1e9)},
+          {"min_ns", JsonNumber(result.min_seconds * 1e9)}});
+    }
+  }
+}
+
+void RunRenderBenchmarks(const double min_time) {
+  for (const int num_primitives : kRenderNumPrimitives) {
+    const double primitive_size = std::min(
+        1.0, std::sqrt(kRenderCoverage / static_cast<double>(num_primitives)));
+    for (const int image_size : kRenderImageSizes) {
+      // Every image size gets the same primitives.
+      std::mt19937 random_generator(kRandomSeed);
+      std::uniform_real_distribution<double> position_distribution(
+          0.0, 1.0 - primitive_size);
+      ImageLayout image_layout(image_size, image_size);
+      for (int i = 0; i < num_primitives; ++i) {
+        image_layout.AddLayoutPrimitive(
+            position_distribution(random_generator),
+            position_distribution(random_generator),
+            primitive_size,
+            primitive_size,
+            i % kNumClasses);
+      }
+      const TimingResult result = TimeFunction(
+          [&image_layout]() { image_layout.Render(); }, min_time);
+      const double num_pixels =
+          static_cast<double>(image_size) * static_cast<double>(image_size);
+      PrintResult(kRenderBenchmarkName, {
+          {"num_primitives", JsonNumber(num_primitives)},
+          {"width", JsonNumber(image_size)},
+          {"height", JsonNumber(image_size)},
+          {"iterations", JsonNumber(result.num_iterations)},
+          {"mean_ms", JsonNumber(result.mean_seconds * 1e3)},
+          {"min_ms", JsonNumber(result.min_seconds * 1e3)},
+          {"megapixels_per_second",
+           JsonNumber(num_pixels / result.min_seconds / 1e6)}});
+    }
+  }
+}
+
+// Adds random primitives to the currently displayed layout, and (if depth is
+// above 0) a grid of sub-layouts that are filled in the same way, with one
+// less depth. The zoom path holds the points to zoom in to from the root to
+// display the layout that is being filled.
+void AddNestedLayout(
+    const int depth,
+    std::vector<std::pair<double, double>>* zoom_path,
+    std::mt19937* random_generator,
+    ImageLayout* image_layout) {
+
+  const double primitive_size = std::min(1.0, std::sqrt(
+      kRenderCoverage / static_cast<double>(kNestedRenderNumPrimitives)));
+  std::uniform_real_distribution<double> position_distribution(
+      0.0, 1.0 - primitive_size);
+  for (int i = 0; i < kNestedRenderNumPrimitives; ++i) {
+    image_layout->AddLayoutPrimitive(
+        position_distribution(*random_generator),
+        position_distribution(*random_generator),
+        primitive_size,
+        primitive_size,
+        i % kNumClasses);
+  }
+  if (depth <= 0) {
+    return;
+  }
+  const double sub_layout_size = 1.0 / kNestedRenderGridSize;
+  for (int row = 0; row < kNestedRenderGridSize; ++row) {
+    for (int col = 0; col < kNestedRenderGridSize; ++col) {
+      image_layout->AddSubLayout(
+          col * sub_layout_size,
+          row * sub_layout_size,
+          sub_layout_size,
+          sub_layout_size);
+      zoom_path->push_back(std::make_pair(
+          (col + 0.5) * sub_layout_size, (row + 0.5) * sub_layout_size));
+      image_layout->ZoomInToSubLayout(
+          zoom_path->back().first, zoom_path->back().second);
+      AddNestedLayout(depth - 1, zoom_path, random_generator, image_layout);
+      // Zoom back out to the layout that is being filled.
+      zoom_path->pop_back();
+      image_layout->ZoomOutToRoot();
+      for (const auto& zoom_point : *zoom_path) {
+        image_layout->ZoomInToSubLayout(zoom_point.first, zoom_point.second);
+      }
+    }
+  }
+}
+
+void RunNestedRenderBenchmarks(const double min_time) {
+  for (const int depth : kNestedRenderDepths) {
+    for (const int image_size : kRenderImageSizes) {
+      // Every image size gets the same layouts.
+      std::mt19937 random_generator(kRandomSeed);
+      ImageLayout image_layout(image_size, image_size);
+      std::vector<std::pair<double, double>> zoom_path;
+      AddNestedLayout(depth, &zoom_path, &random_generator, &image_layout);
+      const TimingResult result = TimeFunction(
+          [&image_layout]() { image_layout.Render(); }, min_time);
+      const double num_pixels =
+          static_cast<double>(image_size) * static_cast<double>(image_size);
+      PrintResult(kNestedRenderBenchmarkName, {
+          {"depth", JsonNumber(depth)},
+          {"primitives_per_layout", JsonNumber(kNestedRenderNumPrimitives)},
+          {"width", JsonNumber(image_size)},
+          {"height", JsonNumber(image_size)},
+          {"iterations", JsonNumber(result.num_iterations)},
+          {"mean_ms", JsonNumber(result.mean_seconds * 1e3)},
+          {"min_ms", JsonNumber(result.min_seconds * 1e3)},
+          {"megapixels_per_second",
+           JsonNumber(num_pixels / result.min_seconds / 1e6)}});
+    }
+  }
+}
+
+// Measures looking up the class of random pixels of a nested layout at sizes
+// up to gigapixels, without rendering it, with and without a spatial index.
+void RunQueryBenchmarks(const double min_time) {
+  for (const int depth : kNestedRenderDepths) {
+    std::mt19937 random_generator(kRandomSeed);
+    ImageLayout image_layout(1, 1);
+    std::vector<std::pair<double, double>> zoom_path;
+    AddNestedLayout(depth, &zoom_path, &random_generator, &image_layout);
+    for (const bool use_index : {false, true}) {
+      if (use_index) {
+        image_layout.BuildSpatialIndex();
+      }
+      for (const int image_size : kQueryImageSizes) {
+        std::uniform_int_distribution<int> pixel_distribution(
+            0, image_size - 1);
+        std::vector<std::pair<int, int>> pixels;
+        for (int i = 0; i < kNumQueryPixels; ++i) {
+          pixels.push_back(std::make_pair(
+              pixel_distribution(random_generator),
+              pixel_distribution(random_generator)));
+        }
+        const TimingResult result = TimeFunction(
+            [&image_layout, &pixels, image_size]() {
+              int class_sum = 0;
+              for (const auto& pixel : pixels) {
+                class_sum += image_layout.ComputeClassAtPixelRoot(
+                    pixel.first, pixel.second, image_size, image_size);
+              }
+              benchmark_sink = class_sum;
+            },
+            min_time);
+        PrintResult(kQueryBenchmarkName, {
+            {"depth", JsonNumber(depth)},
+            {"primitives_per_layout", JsonNumber(kNestedRenderNumPrimitives)},
+            {"indexed", use_index ? "true" : "false"},
+            {"width", JsonNumber(image_size)},
+            {"height", JsonNumber(image_size)},
+            {"iterations", JsonNumber(result.num_iterations)},
+            {"mean_ns_per_pixel",
+             JsonNumber(result.mean_seconds * 1e9 / kNumQueryPixels)},
+            {"min_ns_per_pixel",
+             JsonNumber(result.min_seconds * 1e9 / kNumQueryPixels)}});
+      }
+    }
+  }
+}
+
+// The export configurations measured in each target directory.
+struct ExportConfiguration {
+  QString interleave_name;
+  HSIInterleaveFormat interleave_format;
+  QString data_type_name;
+  HSIDataType data_type;
+};
+
+static const std::vector<ExportConfiguration> kExportConfigurations = {
+    {"bsq", hsi_data_generator::HSI_INTERLEAVE_BSQ,
+     "float32", hsi_data_generator::HSI_DATA_TYPE_FLOAT32},
+    {"bil", hsi_data_generator::HSI_INTERLEAVE_BIL,
+     "float32", hsi_data_generator::HSI_DATA_TYPE_FLOAT32},
+    {"bip", hsi_data_generator::HSI_INTERLEAVE_BIP,
+     "float32", hsi_data_generator::HSI_DATA_TYPE_FLOAT32},
+    {"bsq", hsi_data_generator::HSI_INTERLEAVE_BSQ,
+     "uint16", hsi_data_generator::HSI_DATA_TYPE_UINT16},
+    {"bip", hsi_data_generator::HSI_INTERLEAVE_BIP,
+     "uint16", hsi_data_generator::HSI_DATA_TYPE_UINT16},
+};
+
+// Flushes the given file to the storage device. Returns false if the file
+// cannot be opened or synced.
+bool SyncFile(const QString& file_name) {
+  const int file_descriptor = open(file_name.toStdString().c_str(), O_RDONLY);
+  if (file_descriptor < 0) {
+    return false;
+  }
+  const bool synced = (fdatasync(file_descriptor) == 0);
+  close(file_descriptor);
+  return synced;
+}
+
+// Measures the export throughput into the given directory. Each configuration
+// is exported num_runs times, and the fastest run is reported. Since the page
+// cache can absorb a whole file, the time until the file is flushed to the
+// device is reported separately ("synced").
+void RunExportBenchmarks(
+    const QString& target_name,
+    const QString& directory,
+    const int image_size,
+    const int num_bands,
+    const int num_runs,
+    const int num_threads) {
+
+  std::mt19937 random_generator(kRandomSeed);
+  std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra(
+      new std::vector<std::shared_ptr<Spectrum>>());
+  for (int i = 0; i < kNumClasses; ++i) {
+    spectra->push_back(
+        MakeRandomSpectrum(kNumPeaksPerClass, &random_generator));
+  }
+  std::shared_ptr<ImageLayout> image_layout(
+      new ImageLayout(image_size, image_size));
+  image_layout->GenerateGridLayout(kNumClasses);
+
+  const QString file_name = directory + "/" + kExportFileName;
+  for (const ExportConfiguration& configuration : kExportConfigurations) {
+    HSIDataExporter exporter(spectra, image_layout, num_bands);
+    exporter.SetInterleaveFormat(configuration.interleave_format);
+    exporter.SetDataType(configuration.data_type);
+    exporter.SetNumThreads(num_threads);
+    double min_seconds = 0;
+    double min_synced_seconds = 0;
+    bool synced = true;
+    for (int run = 0; run < num_runs; ++run) {
+      typedef std::chrono::steady_clock Clock;
+      const Clock::time_point start_time = Clock::now();
+      if (!exporter.SaveFile(file_name)) {
+        std::cerr << kApplicationName.toStdString() << ": skipping "
+                  << target_name.toStdString() << " export: "
+                  << exporter.GetErrorMessage().toStdString() << std::endl;
+        return;
+      }
+      const double seconds = std::chrono::duration<double>(
+          Clock::now() - start_time).count();
+      synced = synced && SyncFile(file_name);
+      const double synced_seconds = std::chrono::duration<double>(
+          Clock::now() - start_time).count();
+      if (run == 0 || seconds < min_seconds) {
+        min_seconds = seconds;
+      }
+      if (run == 0 || synced_seconds < min_synced_seconds) {
+        min_synced_seconds = synced_seconds;
+      }
+    }
+    std::remove(file_name.toStdString().c_str());
+    std::remove((file_name + kHeaderFileExtension).toStdString().c_str());
+
+    const double num_bytes = static_cast<double>(exporter.GetTotalNumBytes());
+    std::vector<std::pair<QString, std::string>> fields = {
+        {"target", JsonString(target_name)},
+        {"directory", JsonString(directory)},
+        {"interleave", JsonString(configuration.interleave_name)},
+        {"data_type", JsonString(configuration.data_type_name)},
+        {"width", JsonNumber(image_size)},
+        {"height", JsonNumber(image_size)},
+        {"num_bands", JsonNumber(num_bands)},
+        {"num_threads", JsonNumber(
+            num_threads > 0 ?
+            num_threads : hsi_data_generator::util::GetDefaultNumThreads())},
+        {"runs", JsonNumber(num_runs)},
+        {"bytes", JsonNumber(static_cast<int64_t>(num_bytes))},
+        {"min_seconds", JsonNumber(min_seconds)},
+        {"gb_per_second", JsonNumber(num_bytes / min_seconds / 1e9)}};
+    if (synced) {
+      fields.push_back(
+          {"min_synced_seconds", JsonNumber(min_synced_seconds)});
+      fields.push_back(
+          {"synced_gb_per_second",
+           JsonNumber(num_bytes / min_synced_seconds / 1e9)});
+    }
+    PrintResult(kExportBenchmarkName, fields);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(kApplicationName);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(kApplicationDescription);
+  parser.addHelpOption();
+  const QCommandLineOption benchmarks_option(
+      "benchmarks",
+      "A comma-separated list of the benchmarks to run: spectrum, render, "
+      "and export.",
+      "list",
+      kDefaultBenchmarks);
+  const QCommandLineOption min_time_option(
+      "min-time",
+      "The minimum time in seconds that each spectrum and render "
+      "configuration is measured for.",
+      "seconds",
+      kDefaultMinTime);
+  const QCommandLineOption tmpfs_directory_option(
+      "tmpfs-dir",
+      "A directory in memory (tmpfs) to export to. Empty to skip.",
+      "directory",
+      kDefaultTmpfsDirectory);
+  const QCommandLineOption disk_directory_option(
+      "disk-dir",
+      "A directory on disk to export to. Empty to skip.",
+      "directory",
+      kDefaultDiskDirectory);
+  const QCommandLineOption export_size_option(
+      "export-size",
+      "The width and height of the exported image.",
+      "pixels",
+      kDefaultExportImageSize);
+  const QCommandLineOption export_bands_option(
+      "export-bands",
+      "The number of bands of the exported image.",
+      "count",
+      kDefaultExportNumBands);
+  const QCommandLineOption export_runs_option(
+      "export-runs",
+      "The number of times each export configuration is run.",
+      "count",
+      kDefaultExportNumRuns);
+  const QCommandLineOption threads_option(
+      "threads",
+      "The number of export threads (0 to use all cores).",
+      "count",
+      kDefaultNumThreads);
+  parser.addOption(benchmarks_option);
+  parser.addOption(min_time_option);
+  parser.addOption(tmpfs_directory_option);
+  parser.addOption(disk_directory_option);
+  parser.addOption(export_size_option);
+  parser.addOption(export_bands_option);
+  parser.addOption(export_runs_option);
+  parser.addOption(threads_option);
+  parser.process(app);
+
+  const QStringList benchmarks =
+      parser.value(benchmarks_option).split(",");
+  const double min_time = parser.value(min_time_option).toDouble();
+  if (benchmarks.contains("spectrum")) {
+    std::cerr << "Running spectrum benchmarks..." << std::endl;
+    RunSpectrumBenchmarks(min_time);
+  }
+  if (benchmarks.contains("render")) {
+    std::cerr << "Running render benchmarks..." << std::endl;
+    RunRenderBenchmarks(min_time);
+    RunNestedRenderBenchmarks(min_time);
+    RunQueryBenchmarks(min_time);
+  }
+  if (benchmarks.contains("export")) {
+    const int image_size = parser.value(export_size_option).toInt();
+    const int num_bands = parser.value(export_bands_option).toInt();
+    const int num_runs = std::max(1, parser.value(export_runs_option).toInt());
+    const int num_threads = parser.value(threads_option).toInt();
+    const std::vector<std::pair<QString, QString>> targets = {
+        {"tmpfs", parser.value(tmpfs_directory_option)},
+        {"disk", parser.value(disk_directory_option)}};
+    for (const auto& target_name_and_directory : targets) {
+      if (target_name_and_directory.second.isEmpty()) {
+        continue;
+      }
+      std::cerr << "Running " << target_name_and_directory.first.toStdString()
+                << " export benchmarks..." << std::endl;
+      RunExportBenchmarks(
+          target_name_and_directory.first,
+          target_name_and_directory.second,
+          image_size,
+          num_bands,
+          num_runs,
+          num_threads);
+    }
+  }
+  return 0;
+}
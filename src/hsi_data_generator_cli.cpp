@@ -0,0 +1,386 @@
+// A headless command-line version of the generator. It loads the spectral
+// dictionary from a saved project file, generates an image layout, and
+// exports the HSI data without creating any GUI, so it can run on machines
+// without a display.
+//
+// Example:
+//   HSIDataGeneratorCLI project.xml -o cube.bsq --width 2000 --height 2000 \
+//       --layout grid --interleave bip --type uint16
+//
+// Several sensors can be exported from the same layout at once:
+//   HSIDataGeneratorCLI project.xml -o cube.bsq \
+//       --sensor-bands aviris.txt --sensor-bands hyperion.txt
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QString>
+#include <QStringList>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "hsi/hsi_exporter.h"
+#include "hsi/image_layout.h"
+#include "hsi/project_loader.h"
+#include "hsi/spectrum.h"
+#include "util/util.h"
+
+namespace {
+
+using hsi_data_generator::HSIByteOrder;
+using hsi_data_generator::HSIDataExporter;
+using hsi_data_generator::HSIDataType;
+using hsi_data_generator::HSIInterleaveFormat;
+using hsi_data_generator::ImageLayout;
+using hsi_data_generator::ProjectLoader;
+using hsi_data_generator::SensorExport;
+using hsi_data_generator::Spectrum;
+
+static const QString kApplicationName = "HSIDataGeneratorCLI";
+static const QString kApplicationDescription =
+    "Generates a hyperspectral image from a project file without a GUI.";
+
+static const QString kProjectFileArgumentName = "project";
+static const QString kProjectFileArgumentDescription =
+    "The project file (*.xml) that defines the spectral dictionary.";
+
+// Default values match the GUI's defaults.
+static const QString kDefaultImageSize = "500";
+static const QString kDefaultLayoutType = "horizontal";
+static const QString kDefaultLayoutSize = "0";
+static const QString kDefaultInterleaveFormat = "bsq";
+static const QString kDefaultDataType = "float32";
+static const QString kDefaultScaleFactor = "0";
+static const QString kDefaultByteOrder = "little";
+static const QString kDefaultNumThreads = "0";
+static const QString kDefaultNumMasterBands = "0";
+
+// Converts a command line value into the matching exporter enum. Each returns
+// false if the value is not recognized.
+bool ParseInterleaveFormat(
+    const QString& value, HSIInterleaveFormat* interleave_format) {
+
+  if (value == "bsq") {
+    *interleave_format = hsi_data_generator::HSI_INTERLEAVE_BSQ;
+  } else if (value == "bil") {
+    *interleave_format = hsi_data_generator::HSI_INTERLEAVE_BIL;
+  } else if (value == "bip") {
+    *interleave_format = hsi_data_generator::HSI_INTERLEAVE_BIP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseDataType(const QString& value, HSIDataType* data_type) {
+  if (value == "uint8") {
+    *data_type = hsi_data_generator::HSI_DATA_TYPE_UINT8;
+  } else if (value == "int16") {
+    *data_type = hsi_data_generator::HSI_DATA_TYPE_INT16;
+  } else if (value == "uint16") {
+    *data_type = hsi_data_generator::HSI_DATA_TYPE_UINT16;
+  } else if (value == "float32") {
+    *data_type = hsi_data_generator::HSI_DATA_TYPE_FLOAT32;
+  } else if (value == "float64") {
+    *data_type = hsi_data_generator::HSI_DATA_TYPE_FLOAT64;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseByteOrder(const QString& value, HSIByteOrder* byte_order) {
+  if (value == "little") {
+    *byte_order = hsi_data_generator::HSI_BYTE_ORDER_LITTLE_ENDIAN;
+  } else if (value == "big") {
+    *byte_order = hsi_data_generator::HSI_BYTE_ORDER_BIG_ENDIAN;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Parses a wavelength range given as "min,max". Returns false if the value is
+// not two increasing numbers.
+bool ParseWavelengthRange(
+    const QString& value, double* min_wavelength, double* max_wavelength) {
+
+  const QStringList parts = value.split(",");
+  if (parts.size() != 2) {
+    return false;
+  }
+  bool min_ok = false;
+  bool max_ok = false;
+  *min_wavelength = parts.at(0).trimmed().toDouble(&min_ok);
+  *max_wavelength = parts.at(1).trimmed().toDouble(&max_ok);
+  return min_ok && max_ok && *max_wavelength > *min_wavelength;
+}
+
+// Returns the output file name of a sensor when several are exported: the
+// name of the sensor's band file (without its extension) is appended to the
+// output file's base name, e.g. "cube.bsq" and "aviris.txt" give
+// "cube_aviris.bsq".
+QString GetSensorOutputFileName(
+    const QString& output_file_name, const QString& bands_file_name) {
+
+  const QFileInfo output_file_info(output_file_name);
+  QString sensor_file_name = output_file_info.path() + "/" +
+      output_file_info.completeBaseName() + "_" +
+      QFileInfo(bands_file_name).completeBaseName();
+  if (!output_file_info.suffix().isEmpty()) {
+    sensor_file_name += "." + output_file_info.suffix();
+  }
+  return sensor_file_name;
+}
+
+// Generates (and renders) the requested layout type. Returns false if the
+// layout type is not recognized.
+bool GenerateLayout(
+    const QString& layout_type,
+    const int num_classes,
+    const double layout_size,
+    ImageLayout* image_layout) {
+
+  if (layout_type == "horizontal") {
+    image_layout->GenerateHorizontalStripesLayout(num_classes, layout_size);
+  } else if (layout_type == "vertical") {
+    image_layout->GenerateVerticalStripesLayout(num_classes, layout_size);
+  } else if (layout_type == "grid") {
+    image_layout->GenerateGridLayout(num_classes, layout_size);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Prints the error message and returns the exit code for a failed run.
+int ExitWithError(const QString& error_message) {
+  std::cerr << kApplicationName.toStdString() << ": "
+            << error_message.toStdString() << std::endl;
+  return 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(kApplicationName);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(kApplicationDescription);
+  parser.addHelpOption();
+  parser.addPositionalArgument(
+      kProjectFileArgumentName, kProjectFileArgumentDescription);
+  const QCommandLineOption output_option(
+      QStringList() << "o" << "output",
+      "The output data file. The header is saved as <file>.hdr.",
+      "file");
+  const QCommandLineOption width_option(
+      "width", "The image width in pixels.", "pixels", kDefaultImageSize);
+  const QCommandLineOption height_option(
+      "height", "The image height in pixels.", "pixels", kDefaultImageSize);
+  const QCommandLineOption bands_option(
+      "bands",
+      "The number of spectral bands (defaults to the project's value).",
+      "count");
+  const QCommandLineOption sensor_bands_option(
+      "sensor-bands",
+      "A text file with the center wavelength and FWHM of each sensor band, "
+      "one band per line. Overrides --bands. Repeat this option to export "
+      "one file per sensor, named <output>_<sensor file name>.",
+      "file");
+  const QCommandLineOption wavelength_range_option(
+      "wavelength-range",
+      "The wavelengths that the spectrum's range (0 to 1) is mapped to, as "
+      "\"min,max\" (defaults to the span of the sensor bands).",
+      "range");
+  const QCommandLineOption master_bands_option(
+      "master-bands",
+      "The number of bands that spectra are generated at before they are "
+      "resampled to multiple sensors (0 for automatic).",
+      "count",
+      kDefaultNumMasterBands);
+  const QCommandLineOption layout_option(
+      "layout",
+      "The layout pattern: horizontal, vertical, or grid.",
+      "type",
+      kDefaultLayoutType);
+  const QCommandLineOption layout_size_option(
+      "layout-size",
+      "The stripe or grid square size (0 to 1; 0 for automatic size).",
+      "size",
+      kDefaultLayoutSize);
+  const QCommandLineOption interleave_option(
+      "interleave",
+      "The interleave format: bsq, bil, or bip.",
+      "format",
+      kDefaultInterleaveFormat);
+  const QCommandLineOption type_option(
+      "type",
+      "The sample data type: uint8, int16, uint16, float32, or float64.",
+      "type",
+      kDefaultDataType);
+  const QCommandLineOption scale_option(
+      "scale",
+      "The factor that spectrum values are multiplied by (0 for automatic).",
+      "factor",
+      kDefaultScaleFactor);
+  const QCommandLineOption byte_order_option(
+      "byte-order",
+      "The sample byte order: little or big.",
+      "order",
+      kDefaultByteOrder);
+  const QCommandLineOption threads_option(
+      "threads",
+      "The number of export threads (0 to use all cores).",
+      "count",
+      kDefaultNumThreads);
+  parser.addOption(output_option);
+  parser.addOption(width_option);
+  parser.addOption(height_option);
+  parser.addOption(bands_option);
+  parser.addOption(sensor_bands_option);
+  parser.addOption(wavelength_range_option);
+  parser.addOption(master_bands_option);
+  parser.addOption(layout_option);
+  parser.addOption(layout_size_option);
+  parser.addOption(interleave_option);
+  parser.addOption(type_option);
+  parser.addOption(scale_option);
+  parser.addOption(byte_order_option);
+  parser.addOption(threads_option);
+  parser.process(app);
+
+  const QStringList positional_arguments = parser.positionalArguments();
+  if (positional_arguments.size() != 1) {
+    return ExitWithError("Exactly one project file must be given.");
+  }
+  if (!parser.isSet(output_option)) {
+    return ExitWithError("An output file must be given with --output.");
+  }
+
+  // Load the spectral dictionary. The loader also needs a layout, but project
+  // files do not store one, so it is generated below.
+  std::shared_ptr<int> num_bands(new int(0));
+  std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> spectra(
+      new std::vector<std::shared_ptr<Spectrum>>());
+  const int image_width = parser.value(width_option).toInt();
+  const int image_height = parser.value(height_option).toInt();
+  if (image_width < hsi_data_generator::util::kMinImageDimensionSize ||
+      image_width > hsi_data_generator::util::kMaxImageDimensionSize ||
+      image_height < hsi_data_generator::util::kMinImageDimensionSize ||
+      image_height > hsi_data_generator::util::kMaxImageDimensionSize) {
+    return ExitWithError("Invalid image width or height.");
+  }
+  std::shared_ptr<ImageLayout> image_layout(
+      new ImageLayout(image_width, image_height));
+  ProjectLoader project_loader(spectra, image_layout, num_bands);
+  if (!project_loader.LoadProjectFromFile(positional_arguments.at(0))) {
+    return ExitWithError(project_loader.GetErrorMessage());
+  }
+  if (parser.isSet(bands_option)) {
+    *num_bands = parser.value(bands_option).toInt();
+  }
+  if (spectra->empty()) {
+    return ExitWithError("The project does not contain any spectra.");
+  }
+
+  if (!GenerateLayout(
+          parser.value(layout_option),
+          spectra->size(),
+          parser.value(layout_size_option).toDouble(),
+          image_layout.get())) {
+    return ExitWithError(
+        "Unknown layout type \"" + parser.value(layout_option) + "\".");
+  }
+
+  HSIInterleaveFormat interleave_format;
+  if (!ParseInterleaveFormat(
+          parser.value(interleave_option), &interleave_format)) {
+    return ExitWithError(
+        "Unknown interleave format \"" + parser.value(interleave_option) +
+        "\".");
+  }
+  HSIDataType data_type;
+  if (!ParseDataType(parser.value(type_option), &data_type)) {
+    return ExitWithError(
+        "Unknown data type \"" + parser.value(type_option) + "\".");
+  }
+  HSIByteOrder byte_order;
+  if (!ParseByteOrder(parser.value(byte_order_option), &byte_order)) {
+    return ExitWithError(
+        "Unknown byte order \"" + parser.value(byte_order_option) + "\".");
+  }
+
+  // Each sensor's bands are loaded from its own file. All sensors must map the
+  // spectra onto the same wavelengths, so unless a range is given, they share
+  // the range that covers all of them.
+  std::vector<SensorExport> sensors;
+  for (const QString& bands_file_name : parser.values(sensor_bands_option)) {
+    SensorExport sensor;
+    if (!sensor.bands.LoadFromFile(bands_file_name)) {
+      return ExitWithError(sensor.bands.GetErrorMessage());
+    }
+    sensor.file_name = GetSensorOutputFileName(
+        parser.value(output_option), bands_file_name);
+    sensors.push_back(sensor);
+  }
+  double min_wavelength = 0.0;
+  double max_wavelength = 0.0;
+  if (parser.isSet(wavelength_range_option)) {
+    if (!ParseWavelengthRange(
+            parser.value(wavelength_range_option),
+            &min_wavelength,
+            &max_wavelength)) {
+      return ExitWithError(
+          "Invalid wavelength range \"" +
+          parser.value(wavelength_range_option) + "\".");
+    }
+  } else if (sensors.size() > 1) {
+    min_wavelength = sensors.front().bands.GetMinWavelength();
+    max_wavelength = sensors.front().bands.GetMaxWavelength();
+    for (const SensorExport& sensor : sensors) {
+      min_wavelength =
+          std::min(sensor.bands.GetMinWavelength(), min_wavelength);
+      max_wavelength =
+          std::max(sensor.bands.GetMaxWavelength(), max_wavelength);
+    }
+  }
+  for (SensorExport& sensor : sensors) {
+    sensor.bands.SetWavelengthRange(min_wavelength, max_wavelength);
+  }
+
+  HSIDataExporter exporter(spectra, image_layout, *num_bands);
+  exporter.SetInterleaveFormat(interleave_format);
+  exporter.SetDataType(data_type);
+  exporter.SetScaleFactor(parser.value(scale_option).toDouble());
+  exporter.SetByteOrder(byte_order);
+  exporter.SetNumThreads(parser.value(threads_option).toInt());
+  exporter.SetNumMasterBands(parser.value(master_bands_option).toInt());
+  if (sensors.size() > 1) {
+    // Several sensors are exported from the same layout in a single pass.
+    if (!exporter.SaveSensorFiles(sensors)) {
+      return ExitWithError(exporter.GetErrorMessage());
+    }
+    for (const SensorExport& sensor : sensors) {
+      std::cout << "Saved " << sensor.file_name.toStdString() << std::endl;
+    }
+    std::cout << "Saved " << exporter.GetTotalNumBytes() << " bytes in total."
+              << std::endl;
+    return 0;
+  }
+  if (!sensors.empty()) {
+    exporter.SetSpectralBands(sensors.front().bands);
+  }
+  const QString output_file_name = parser.value(output_option);
+  if (!exporter.SaveFile(output_file_name)) {
+    return ExitWithError(exporter.GetErrorMessage());
+  }
+  std::cout << "Saved " << exporter.GetTotalNumBytes() << " bytes to "
+            << output_file_name.toStdString() << std::endl;
+  return 0;
+}
@@ -0,0 +1,62 @@
+// An allocator for standard containers that aligns its memory to cache line
+// boundaries. Large tables that are read in tight loops (e.g. the generated
+// spectra while exporting) use it so that rows and vector loads do not
+// straddle cache lines unnecessarily.
+
+#ifndef SRC_UTIL_ALIGNED_ALLOCATOR_H_
+#define SRC_UTIL_ALIGNED_ALLOCATOR_H_
+
+#include <stdlib.h>
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace hsi_data_generator {
+namespace util {
+
+// The alignment (in bytes) of memory allocated by the AlignedAllocator.
+constexpr std::size_t kCacheLineSize = 64;
+
+template <typename T>
+class AlignedAllocator {
+ public:
+  typedef T value_type;
+
+  AlignedAllocator() {}
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U>& other) {}  // NOLINT
+
+  T* allocate(const std::size_t num_values) {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kCacheLineSize, num_values * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(memory);
+  }
+
+  void deallocate(T* memory, const std::size_t num_values) {
+    free(memory);
+  }
+};
+
+// All AlignedAllocators are interchangeable, since they hold no state.
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T>& a, const AlignedAllocator<U>& b) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T>& a, const AlignedAllocator<U>& b) {
+  return false;
+}
+
+// A std::vector whose data is aligned to a cache line.
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+}  // namespace util
+}  // namespace hsi_data_generator
+
+#endif  // SRC_UTIL_ALIGNED_ALLOCATOR_H_
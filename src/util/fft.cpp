@@ -0,0 +1,65 @@
+#include "util/fft.h"
+
+#include <cmath>
+#include <complex>
+#include <utility>
+#include <vector>
+
+namespace hsi_data_generator {
+namespace util {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+}  // namespace
+
+int GetFFTSize(const int min_size) {
+  int size = 1;
+  while (size < min_size) {
+    size *= 2;
+  }
+  return size;
+}
+
+void FFT(const bool inverse, std::vector<std::complex<double>>* data) {
+  const int size = data->size();
+  std::complex<double>* values = data->data();
+
+  // Reorder the values by bit-reversed index.
+  for (int i = 1, j = 0; i < size; ++i) {
+    int bit = size >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(values[i], values[j]);
+    }
+  }
+
+  // Every twiddle factor is computed directly (rather than by repeated
+  // multiplication), which keeps the rounding errors small for large sizes.
+  const double sign = inverse ? 1.0 : -1.0;
+  std::vector<std::complex<double>> twiddles(size / 2);
+  for (int k = 0; k < size / 2; ++k) {
+    const double angle = sign * 2.0 * kPi * k / size;
+    twiddles[k] = std::complex<double>(std::cos(angle), std::sin(angle));
+  }
+
+  // Radix-2 butterflies, doubling the transform length at each stage.
+  for (int length = 2; length <= size; length *= 2) {
+    const int half_length = length / 2;
+    const int twiddle_stride = size / length;
+    for (int start = 0; start < size; start += length) {
+      for (int k = 0; k < half_length; ++k) {
+        const std::complex<double> odd =
+            values[start + k + half_length] * twiddles[k * twiddle_stride];
+        values[start + k + half_length] = values[start + k] - odd;
+        values[start + k] += odd;
+      }
+    }
+  }
+}
+
+}  // namespace util
+}  // namespace hsi_data_generator
@@ -0,0 +1,25 @@
+// A minimal fast Fourier transform, used to convolve finely sampled spectra
+// with a broadening kernel (see AddSpectralLines()).
+
+#ifndef SRC_UTIL_FFT_H_
+#define SRC_UTIL_FFT_H_
+
+#include <complex>
+#include <vector>
+
+namespace hsi_data_generator {
+namespace util {
+
+// Returns the smallest power of 2 that is at least the given size.
+int GetFFTSize(const int min_size);
+
+// Computes the discrete Fourier transform of the data in place, or its inverse
+// if "inverse" is true. The size of the data must be a power of 2. Neither
+// direction is scaled, so a forward and an inverse transform multiply the data
+// by its size.
+void FFT(const bool inverse, std::vector<std::complex<double>>* data);
+
+}  // namespace util
+}  // namespace hsi_data_generator
+
+#endif  // SRC_UTIL_FFT_H_
@@ -0,0 +1,57 @@
+#include "util/mapped_file.h"
+
+#include <QString>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+namespace hsi_data_generator {
+namespace util {
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const QString& file_name) {
+  Close();
+  const int file_descriptor = open(file_name.toStdString().c_str(), O_RDONLY);
+  if (file_descriptor < 0) {
+    return false;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0) {
+    close(file_descriptor);
+    return false;
+  }
+  if (file_status.st_size == 0) {
+    close(file_descriptor);
+    return true;
+  }
+  void* data = mmap(
+      nullptr, file_status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  // The mapping stays valid after the file is closed.
+  close(file_descriptor);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  // The file is read from start to end.
+  madvise(data, file_status.st_size, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(data);
+  size_ = file_status.st_size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+}  // namespace util
+}  // namespace hsi_data_generator
@@ -0,0 +1,50 @@
+// A read-only memory mapping of a whole file. Large input files (e.g. spectral
+// libraries) are parsed directly from the mapping, which avoids copying them
+// into a buffer and lets the OS read ahead.
+
+#ifndef SRC_UTIL_MAPPED_FILE_H_
+#define SRC_UTIL_MAPPED_FILE_H_
+
+#include <QString>
+
+#include <cstdint>
+
+namespace hsi_data_generator {
+namespace util {
+
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0) {}
+
+  // Unmaps the file, if it is open.
+  ~MappedFile();
+
+  MappedFile(const MappedFile& other) = delete;
+  MappedFile& operator=(const MappedFile& other) = delete;
+
+  // Maps the given file, replacing any previously mapped file. Returns false
+  // if the file could not be opened or mapped. Empty files can be opened, but
+  // have no data.
+  bool Open(const QString& file_name);
+
+  // Returns the contents of the file. Note that they are not null-terminated.
+  const char* GetData() const {
+    return data_;
+  }
+
+  int64_t GetSize() const {
+    return size_;
+  }
+
+ private:
+  // Unmaps the current file (if any).
+  void Close();
+
+  const char* data_;
+  int64_t size_;
+};
+
+}  // namespace util
+}  // namespace hsi_data_generator
+
+#endif  // SRC_UTIL_MAPPED_FILE_H_
@@ -0,0 +1,54 @@
+#include "util/parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace hsi_data_generator {
+namespace util {
+
+int GetDefaultNumThreads() {
+  const int num_threads = std::thread::hardware_concurrency();
+  return std::max(num_threads, 1);
+}
+
+bool ParallelFor(
+    const int num_tasks,
+    const int num_threads,
+    const std::function<bool(int task_index, int thread_index)>&
+        task_function) {
+
+  const int max_num_threads =
+      (num_threads < 1) ? GetDefaultNumThreads() : num_threads;
+  const int num_workers = std::min(max_num_threads, num_tasks);
+  std::atomic<int> next_task_index(0);
+  std::atomic<bool> succeeded(true);
+  auto worker = [&](const int thread_index) {
+    while (succeeded) {
+      const int task_index = next_task_index++;
+      if (task_index >= num_tasks) {
+        break;
+      }
+      if (!task_function(task_index, thread_index)) {
+        succeeded = false;
+      }
+    }
+  };
+  // The calling thread acts as the first worker.
+  std::vector<std::thread> threads;
+  for (int thread_index = 1; thread_index < num_workers; ++thread_index) {
+    threads.push_back(std::thread(worker, thread_index));
+  }
+  if (num_workers > 0) {
+    worker(0);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return succeeded;
+}
+
+}  // namespace util
+}  // namespace hsi_data_generator
@@ -0,0 +1,38 @@
+// A minimal parallel loop used to split independent work (e.g. sections of
+// an exported data cube) across all available CPU cores. Each call spawns its
+// own worker threads, which pull task indices from a shared counter until all
+// tasks are done.
+
+#ifndef SRC_UTIL_PARALLEL_FOR_H_
+#define SRC_UTIL_PARALLEL_FOR_H_
+
+#include <functional>
+
+namespace hsi_data_generator {
+namespace util {
+
+// Returns the number of threads that the hardware can run concurrently. This
+// is always at least 1.
+int GetDefaultNumThreads();
+
+// Runs task_function for every task index in [0, num_tasks), distributed over
+// up to num_threads threads. If num_threads is less than 1, the default number
+// of threads (see GetDefaultNumThreads()) is used. Tasks are not run in any
+// particular order.
+//
+// The task function is given the task index and the index of the thread that
+// runs it (between 0 and the number of threads used), which can be used to
+// select per-thread scratch buffers. It returns false to signal a failure, in
+// which case no new tasks will be started.
+//
+// Returns true if every task returned true.
+bool ParallelFor(
+    const int num_tasks,
+    const int num_threads,
+    const std::function<bool(int task_index, int thread_index)>&
+        task_function);
+
+}  // namespace util
+}  // namespace hsi_data_generator
+
+#endif  // SRC_UTIL_PARALLEL_FOR_H_
@@ -6,6 +6,9 @@
 #include <QString>
 #include <QtDebug>
 
+#include <cstdint>
+#include <cstring>
+
 namespace hsi_data_generator {
 namespace util {
 
@@ -46,5 +49,20 @@ QString GetStylesheetRelativePath(const QString& stylesheet_relative_path) {
   return QLatin1String(stylesheet_file.readAll());
 }
 
+bool IsHostBigEndian() {
+  const uint16_t test_value = 1;
+  uint8_t first_byte = 0;
+  std::memcpy(&first_byte, &test_value, 1);
+  return first_byte == 0;
+}
+
+bool IsFinite(const double value) {
+  // Infinities and NaNs are the only values with every exponent bit set.
+  constexpr uint64_t kExponentMask = 0x7ff0000000000000ULL;
+  uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return (bits & kExponentMask) != kExponentMask;
+}
+
 }  // namespace util
 }  // namespace hsi_data_generator
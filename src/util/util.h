@@ -43,6 +43,14 @@ QString GetAbsolutePath(const QString& relative_path);
 // resolved.
 QString GetStylesheetRelativePath(const QString& stylesheet_relative_path);
 
+// Returns true if this machine stores values in big-endian byte order.
+bool IsHostBigEndian();
+
+// Returns true if the given value is neither infinite nor NaN. Unlike
+// std::isfinite(), this checks the value's bits, so it still works when the
+// compiler assumes finite math (e.g. with -Ofast).
+bool IsFinite(const double value);
+
 }  // namespace util
 }  // namespace hsi_data_generator
 
@@ -0,0 +1,106 @@
+// Tests for rendering image layouts. Each test returns false (after printing
+// the failure to stderr) if the rendered layout is wrong.
+
+#include <iostream>
+
+#include "hsi/image_layout.h"
+
+namespace {
+
+using hsi_data_generator::ImageLayout;
+
+constexpr int kLayoutSize = 100;
+constexpr int kSubLayoutClass = 5;
+
+// Returns true if every pixel of the rendered root class map matches the
+// class computed directly from the layout's components.
+bool IsRenderedLayoutCorrect(const ImageLayout& image_layout) {
+  const int width = image_layout.GetWidthRoot();
+  const int height = image_layout.GetHeightRoot();
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const int rendered_class = image_layout.GetClassAtPixelRoot(x, y);
+      const int expected_class =
+          image_layout.ComputeClassAtPixelRoot(x, y, width, height);
+      if (rendered_class != expected_class) {
+        std::cerr << "Pixel (" << x << ", " << y << ") is class "
+                  << rendered_class << ", expected " << expected_class
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Clearing a zoomed-in sub-layout must also clear its pixels in the root
+// layout on the next incremental render.
+bool TestRenderChangesAfterClearingSubLayout() {
+  ImageLayout image_layout(kLayoutSize, kLayoutSize);
+  image_layout.Render();
+  image_layout.AddSubLayout(0.0, 0.0, 0.5, 0.5);
+  if (!image_layout.ZoomInToSubLayout(0.25, 0.25)) {
+    std::cerr << "Could not zoom in to the sub-layout." << std::endl;
+    return false;
+  }
+  image_layout.AddLayoutPrimitive(0.0, 0.0, 1.0, 1.0, kSubLayoutClass);
+  image_layout.ZoomOutToRoot();
+  image_layout.RenderChanges();
+  if (image_layout.GetClassAtPixelRoot(10, 10) != kSubLayoutClass ||
+      !IsRenderedLayoutCorrect(image_layout)) {
+    std::cerr << "The sub-layout was not rendered." << std::endl;
+    return false;
+  }
+
+  image_layout.ZoomInToSubLayout(0.25, 0.25);
+  image_layout.ResetLayout();
+  image_layout.ZoomOutToRoot();
+  image_layout.RenderChanges();
+  if (image_layout.GetClassAtPixelRoot(10, 10) != 0 ||
+      !IsRenderedLayoutCorrect(image_layout)) {
+    std::cerr << "The cleared sub-layout was not rendered." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A primitive that extends past the edge of the layout must not cover the
+// pixels outside of it, with or without a spatial index.
+bool TestComputeClassOutsideOfLayout() {
+  ImageLayout image_layout(kLayoutSize, kLayoutSize);
+  image_layout.AddLayoutPrimitive(0.5, 0.5, 1.0, 1.0, kSubLayoutClass);
+  for (int i = 0; i < 2; ++i) {
+    if (i == 1) {
+      image_layout.BuildSpatialIndex();
+    }
+    const int inside_class = image_layout.ComputeClassAtPixelRoot(
+        kLayoutSize - 1, kLayoutSize - 1, kLayoutSize, kLayoutSize);
+    const int outside_class = image_layout.ComputeClassAtPixelRoot(
+        kLayoutSize, kLayoutSize - 1, kLayoutSize, kLayoutSize);
+    const int negative_class = image_layout.ComputeClassAtPixelRoot(
+        -1, kLayoutSize - 1, kLayoutSize, kLayoutSize);
+    if (inside_class != kSubLayoutClass || outside_class != 0 ||
+        negative_class != 0) {
+      std::cerr << "Pixels outside of the layout are covered"
+                << (i == 1 ? " with" : " without") << " a spatial index."
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  bool passed = true;
+  if (!TestRenderChangesAfterClearingSubLayout()) {
+    std::cerr << "FAILED: TestRenderChangesAfterClearingSubLayout" << std::endl;
+    passed = false;
+  }
+  if (!TestComputeClassOutsideOfLayout()) {
+    std::cerr << "FAILED: TestComputeClassOutsideOfLayout" << std::endl;
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+// Tests that exporting a sensor through the resampled multi-sensor path
+// (HSIDataExporter::SaveSensorFiles()) gives the same values as integrating
+// the spectra over the sensor's bands directly (HSIDataExporter::SaveFile()).
+
+#include <QDir>
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "hsi/hsi_exporter.h"
+#include "hsi/image_layout.h"
+#include "hsi/spectral_bands.h"
+#include "hsi/spectrum.h"
+
+namespace {
+
+using hsi_data_generator::HSIDataExporter;
+using hsi_data_generator::ImageLayout;
+using hsi_data_generator::SensorExport;
+using hsi_data_generator::SpectralBands;
+using hsi_data_generator::Spectrum;
+
+constexpr int kImageSize = 2;
+constexpr int kNumBands = 30;
+constexpr double kMinWavelength = 400.0;
+constexpr double kMaxWavelength = 1000.0;
+constexpr double kBandFWHM = 15.0;
+
+// The resampled values only approximate the integrated ones.
+constexpr double kMaxValueError = 1e-3;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// The tabulated test spectrum is a sine wave sampled at this many values.
+constexpr int kNumTabulatedValues = 64;
+constexpr int kNumTabulatedValuesPerPeriod = 16;
+
+static const QString kHeaderFileExtension = ".hdr";
+
+// Reads all float32 samples of the given data file, or returns an empty list
+// if the file cannot be read.
+std::vector<float> ReadSamples(const QString& file_name) {
+  std::ifstream file(file_name.toStdString(), std::ios::binary);
+  std::vector<float> samples;
+  float sample = 0;
+  while (file.read(reinterpret_cast<char*>(&sample), sizeof(sample))) {
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+void RemoveExportedFile(const QString& file_name) {
+  std::remove(file_name.toStdString().c_str());
+  std::remove((file_name + kHeaderFileExtension).toStdString().c_str());
+}
+
+// Returns the given number of bands spread evenly over the test's wavelength
+// range, each with the given FWHM.
+SpectralBands MakeEvenlySpacedBands(const int num_bands, const double fwhm) {
+  SpectralBands bands;
+  bands.SetWavelengthRange(kMinWavelength, kMaxWavelength);
+  const double band_spacing =
+      (kMaxWavelength - kMinWavelength) / (num_bands - 1);
+  for (int band = 0; band < num_bands; ++band) {
+    bands.AddBand(kMinWavelength + band * band_spacing, fwhm);
+  }
+  return bands;
+}
+
+// Exports the given spectra with the given bands through both SaveFile() and
+// SaveSensorFiles(), and checks that every sample of the two cubes is within
+// max_error. The largest exported value is returned in max_value.
+bool ExportAndCompareBothPaths(
+    const std::vector<std::shared_ptr<Spectrum>>& spectra,
+    const SpectralBands& bands,
+    const double max_error,
+    float* max_value) {
+
+  std::shared_ptr<std::vector<std::shared_ptr<Spectrum>>> exported_spectra(
+      new std::vector<std::shared_ptr<Spectrum>>(spectra));
+  std::shared_ptr<ImageLayout> image_layout(
+      new ImageLayout(kImageSize, kImageSize));
+  image_layout->Render();
+
+  const QString directory = QDir::tempPath();
+  const QString integrated_file_name =
+      directory + "/sensor_export_test_integrated.bsq";
+  const QString resampled_file_name =
+      directory + "/sensor_export_test_resampled.bsq";
+  const int num_bands = bands.GetNumBands();
+  HSIDataExporter exporter(exported_spectra, image_layout, num_bands);
+  exporter.SetSpectralBands(bands);
+  const bool saved_integrated = exporter.SaveFile(integrated_file_name);
+  const bool saved_resampled =
+      exporter.SaveSensorFiles({SensorExport{bands, resampled_file_name}});
+  const std::vector<float> integrated = ReadSamples(integrated_file_name);
+  const std::vector<float> resampled = ReadSamples(resampled_file_name);
+  RemoveExportedFile(integrated_file_name);
+  RemoveExportedFile(resampled_file_name);
+  if (!saved_integrated || !saved_resampled) {
+    std::cerr << "Export failed: "
+              << exporter.GetErrorMessage().toStdString() << std::endl;
+    return false;
+  }
+  const size_t num_samples = kImageSize * kImageSize * num_bands;
+  if (integrated.size() != num_samples || resampled.size() != num_samples) {
+    std::cerr << "Exported files have the wrong size." << std::endl;
+    return false;
+  }
+  *max_value = 0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    *max_value = std::max(integrated[i], *max_value);
+    if (std::fabs(integrated[i] - resampled[i]) > max_error) {
+      std::cerr << "Sample " << i << " is " << resampled[i]
+                << " when resampled, but " << integrated[i]
+                << " when integrated." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Overlapping peaks add up to more than 1, so the spectrum is normalized by
+// its maximum. Both export paths must normalize it the same way.
+bool TestSensorExportOfSpectrumAboveOne() {
+  std::shared_ptr<Spectrum> spectrum(new Spectrum("Overlapping peaks"));
+  spectrum->AddPeak(0.5, 0.8, 0.01);
+  spectrum->AddPeak(0.52, 0.8, 0.01);
+  float max_value = 0;
+  if (!ExportAndCompareBothPaths(
+          {spectrum}, MakeEvenlySpacedBands(kNumBands, kBandFWHM),
+          kMaxValueError, &max_value)) {
+    return false;
+  }
+  if (std::fabs(max_value - 1.0f) > kMaxValueError) {
+    std::cerr << "The spectrum's maximum is " << max_value << ", not 1."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A spectrum with only tabulated values (e.g. imported from a library) has no
+// peaks that set the resolution of the master bands, so the resampled export
+// must still resolve the table itself. Bands with a width must integrate the
+// table against their response in both paths.
+bool TestSensorExportOfTabulatedSpectrum() {
+  std::vector<double> values(kNumTabulatedValues);
+  for (int i = 0; i < kNumTabulatedValues; ++i) {
+    values[i] = 0.5 + 0.4 * std::sin(
+        2.0 * kPi * i / kNumTabulatedValuesPerPeriod);
+  }
+  std::shared_ptr<Spectrum> spectrum(new Spectrum("Tabulated"));
+  spectrum->SetTabulatedValues(values);
+  for (const double fwhm : {0.0, kBandFWHM}) {
+    float max_value = 0;
+    if (!ExportAndCompareBothPaths(
+            {spectrum}, MakeEvenlySpacedBands(kNumBands, fwhm),
+            kMaxValueError, &max_value)) {
+      std::cerr << "The exports with a band FWHM of " << fwhm
+                << " do not match." << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  bool passed = true;
+  if (!TestSensorExportOfSpectrumAboveOne()) {
+    std::cerr << "FAILED: TestSensorExportOfSpectrumAboveOne" << std::endl;
+    passed = false;
+  }
+  if (!TestSensorExportOfTabulatedSpectrum()) {
+    std::cerr << "FAILED: TestSensorExportOfTabulatedSpectrum" << std::endl;
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}